@@ -0,0 +1,98 @@
+#include "Benchmark.h"
+
+#include "../Runtime/Allocator.h"
+#include "../Util/Util.h"
+
+static const size_t AllocatorItemCount = 4096;
+static const size_t StressIterationCount = 200000;
+
+struct StressBlock
+{
+	uint8_t *data;
+	size_t size;
+	uint8_t pattern;
+};
+
+//random allocs and frees, up to big heap sizes. each block is filled with a pattern, checked before free.
+//returns number of corrupted or misaligned blocks.
+static size_t stressAllocator()
+{
+	Vector<StressBlock> blocks;
+	size_t errors = 0;
+	uint32_t state = 0x12345678;
+	for(size_t i = 0; i < StressIterationCount; i ++)
+	{
+		uint32_t random = nextRandom(state);
+		if(blocks.size() == 0 || random % 3 != 0)
+		{
+			StressBlock block;
+			if(random % 61 == 0)
+				block.size = nextRandom(state) % 70000;
+			else
+				block.size = nextRandom(state) % 600;
+			block.pattern = static_cast<uint8_t>(random >> 8);
+			block.data = reinterpret_cast<uint8_t *>(heapAlloc(block.size));
+			if(!block.data || reinterpret_cast<size_t>(block.data) % sizeof(void *) != 0)
+			{
+				errors ++;
+				continue;
+			}
+			setMemory(block.data, block.pattern, block.size);
+			blocks.push_back(block);
+		}
+		else
+		{
+			size_t index = nextRandom(state) % blocks.size();
+			StressBlock block = blocks[index];
+			for(size_t j = 0; j < block.size; j ++)
+			{
+				if(block.data[j] != block.pattern)
+				{
+					errors ++;
+					break;
+				}
+			}
+			heapFree(block.data);
+			blocks[index] = blocks[blocks.size() - 1];
+			blocks.resize(blocks.size() - 1);
+		}
+	}
+	for(size_t i = 0; i < blocks.size(); i ++)
+		heapFree(blocks[i].data);
+	return errors;
+}
+
+void benchmarkAllocator(BenchmarkRunner &runner)
+{
+	Vector<void *> blocks(AllocatorItemCount);
+
+	runner.run("Allocator/alloc free same size", []() {
+		for(size_t i = 0; i < AllocatorItemCount; i ++)
+			heapFree(heapAlloc(48));
+	});
+
+	runner.run("Allocator/alloc all then free all", [&]() {
+		for(size_t i = 0; i < AllocatorItemCount; i ++)
+			blocks[i] = heapAlloc(48);
+		for(size_t i = 0; i < AllocatorItemCount; i ++)
+			heapFree(blocks[i]);
+	});
+
+	//frees in shuffled order, so free lists don't come back in allocation order.
+	runner.run("Allocator/mixed sizes random free", [&]() {
+		uint32_t state = 0x12345678;
+		for(size_t i = 0; i < AllocatorItemCount; i ++)
+			blocks[i] = heapAlloc(nextRandom(state) % 2048);
+		for(size_t i = AllocatorItemCount; i > 1; i --)
+		{
+			size_t j = nextRandom(state) % i;
+			void *temp = blocks[i - 1];
+			blocks[i - 1] = blocks[j];
+			blocks[j] = temp;
+		}
+		for(size_t i = 0; i < AllocatorItemCount; i ++)
+			heapFree(blocks[i]);
+	});
+
+	runner.addValue("Allocator/stress errors", stressAllocator());
+}
@@ -0,0 +1,64 @@
+#include "Benchmark.h"
+
+#include "../Runtime/Allocator.h"
+#include "../Runtime/FormatBase.h"
+#include "../Util/List.h"
+
+static const size_t ArenaItemCount = 4096;
+
+//shell32 has one of the largest export tables among system libraries.
+static const char *LargeExportLibrary = "shell32.dll";
+
+void benchmarkArena(BenchmarkRunner &runner)
+{
+	//small blocks with sizes of list nodes and short names.
+	Vector<void *> blocks(ArenaItemCount);
+	runner.run("heapAlloc/alloc and free small", [&]() {
+		for(size_t i = 0; i < ArenaItemCount; i ++)
+			blocks[i] = heapAlloc(16 + (i % 4) * 16);
+		for(size_t i = 0; i < ArenaItemCount; i ++)
+			heapFree(blocks[i]);
+	});
+
+	runner.run("MemoryArena/alloc and free small", [&]() {
+		MemoryArena arena;
+		for(size_t i = 0; i < ArenaItemCount; i ++)
+			blocks[i] = arena.allocate(16 + (i % 4) * 16);
+		for(size_t i = 0; i < ArenaItemCount; i ++)
+			heapFree(blocks[i]);
+	});
+
+	runner.run("List/push_back and clear", []() {
+		List<uint64_t> list;
+		for(size_t i = 0; i < ArenaItemCount; i ++)
+			list.push_back(i);
+	});
+
+	runner.run("List/push_back and clear in arena", []() {
+		MemoryArena arena;
+		ArenaScope scope(&arena);
+		{
+			List<uint64_t> list;
+			for(size_t i = 0; i < ArenaItemCount; i ++)
+				list.push_back(i);
+		}
+	});
+
+	SharedPtr<FormatBase> library = FormatBase::loadImport(LargeExportLibrary);
+	if(!library.get())
+		return;
+	size_t exportCount = library->getExports().size();
+	runner.addValue(String("PEFormat/") + LargeExportLibrary + " exports", exportCount);
+
+	//allocations served by the format's arena while parsing and converting, all released together.
+	runner.run(String("PEFormat/") + LargeExportLibrary + " load and toImage", []() {
+		SharedPtr<FormatBase> format = FormatBase::loadImport(LargeExportLibrary);
+		Image image = format->toImage();
+		return image.exports.size();
+	});
+
+	Image image = library->toImage();
+	runner.addValue(String("PEFormat/") + LargeExportLibrary + " arena allocations", image.arena->getAllocationCount());
+	runner.addValue(String("PEFormat/") + LargeExportLibrary + " arena bytes", image.arena->getAllocatedSize());
+	runner.addValue(String("PEFormat/") + LargeExportLibrary + " arena chunks", image.arena->getChunkCount());
+}
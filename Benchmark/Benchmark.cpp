@@ -0,0 +1,167 @@
+#include "Benchmark.h"
+
+#include "../Win32/Win32NativeHelper.h"
+#include "../Runtime/File.h"
+
+BenchmarkRunner::BenchmarkRunner(size_t repeat) : repeat_(repeat)
+{
+	//count tsc ticks over 100ms of interrupt time, which is in 100ns units.
+	uint64_t startTime = Win32NativeHelper::get()->getInterruptTime();
+	uint64_t startCycles = __rdtsc();
+	uint64_t now;
+	do
+	{
+		now = Win32NativeHelper::get()->getInterruptTime();
+	} while(now - startTime < 1000000);
+	frequency_ = divide64((__rdtsc() - startCycles) * 10, now - startTime) * 1000000;
+}
+
+String BenchmarkRunner::getThroughput(uint64_t bytes, uint64_t cycles) const
+{
+	if(!bytes || !cycles)
+		return String("-");
+	//bytes per cycle in 20 bit fixed point, so slow cases keep precision without overflowing. one decimal place.
+	uint64_t throughput = divide64(divide64(bytes << 20, cycles) * frequency_ * 10, 1ull << 40);
+	uint64_t integer = divide64(throughput, 10);
+	String result = IntToString(integer);
+	result.append(".");
+	result.append(IntToString(throughput - integer * 10));
+	return result;
+}
+
+void BenchmarkRunner::addResult(const String &name, Vector<uint64_t> &samples, uint64_t bytes)
+{
+	//sample counts are small, insertion sort is enough.
+	for(size_t i = 1; i < samples.size(); i ++)
+	{
+		uint64_t item = samples[i];
+		size_t j = i;
+		for(; j > 0 && samples[j - 1] > item; j --)
+			samples[j] = samples[j - 1];
+		samples[j] = item;
+	}
+	uint64_t median = samples[samples.size() / 2];
+	uint64_t p95 = samples[samples.size() * 95 / 100];
+
+	result_.append(name);
+	result_.append("\t");
+	result_.append(IntToString(median));
+	result_.append("\t");
+	result_.append(IntToString(p95));
+	result_.append("\t");
+	result_.append(getThroughput(bytes, median));
+	result_.append("\t");
+	result_.append(getThroughput(bytes, p95));
+	addBaselineComparison(name, median);
+	result_.append("\n");
+}
+
+void BenchmarkRunner::addValue(const String &name, uint64_t value)
+{
+	result_.append(name);
+	result_.append("\t");
+	result_.append(IntToString(value));
+	result_.append("\t-\t-\t-");
+	addBaselineComparison(name, value);
+	result_.append("\n");
+}
+
+//appends baseline median and change in percent. positive change is slower or larger.
+void BenchmarkRunner::addBaselineComparison(const String &name, uint64_t median)
+{
+	auto it = baseline_.find(name);
+	if(it == baseline_.end())
+		return;
+	uint64_t base = it->value;
+	result_.append("\t");
+	result_.append(IntToString(base));
+	result_.append("\t");
+	if(!base)
+		result_.append("-");
+	else if(median >= base)
+	{
+		result_.append("+");
+		result_.append(IntToString(divide64((median - base) * 100, base)));
+		result_.append("%");
+	}
+	else
+	{
+		result_.append("-");
+		result_.append(IntToString(divide64((base - median) * 100, base)));
+		result_.append("%");
+	}
+}
+
+void BenchmarkRunner::loadBaseline(const char *text)
+{
+	//skip header line. name and median are first two columns of others.
+	while(*text && *text != '\n')
+		text ++;
+	while(*text)
+	{
+		text ++;
+		const char *nameStart = text;
+		while(*text && *text != '\t' && *text != '\n' && *text != '\r')
+			text ++;
+		String name(nameStart, text);
+		if(name == "end")
+			break;
+		if(*text == '\t')
+		{
+			text ++;
+			uint64_t median = 0;
+			for(; *text >= '0' && *text <= '9'; text ++)
+				median = median * 10 + (*text - '0');
+			baseline_.insert(name, median);
+		}
+		while(*text && *text != '\n')
+			text ++;
+	}
+}
+
+String BenchmarkRunner::getResult() const
+{
+	String result("name\tmedian\tp95\tmedian MB/s\tp95 MB/s");
+	if(baseline_.size())
+		result.append("\tbaseline median\tchange");
+	result.append("\n");
+	result.append(result_);
+	result.append("end\n");
+	return result;
+}
+
+#ifdef _WIN32
+void Entry()
+{
+	Win32NativeHelper::get()->init();
+
+	//Benchmark.exe [output] [baseline]
+	List<String> arguments = Win32NativeHelper::get()->getArgumentList();
+	String outputPath("benchmark.txt");
+	String baselinePath;
+	auto it = arguments.begin();
+	if(arguments.size() > 1)
+		outputPath = *(++ it);
+	if(arguments.size() > 2)
+		baselinePath = *(++ it);
+
+	BenchmarkRunner runner(21);
+	if(baselinePath.length())
+	{
+		//file has no size, mapped view is zero filled past end of file.
+		SharedPtr<File> baseline = File::open(baselinePath);
+		SharedPtr<DataView> view = baseline->getView(0, 0);
+		runner.loadBaseline(reinterpret_cast<const char *>(view->get()));
+	}
+
+	benchmarkContainers(runner);
+	benchmarkArena(runner);
+	benchmarkAllocator(runner);
+	benchmarkImage(runner);
+	benchmarkPE(runner);
+
+	String result = runner.getResult();
+	SharedPtr<File> output = File::open(outputPath, true);
+	output->write(result.c_str(), result.length());
+}
+#endif
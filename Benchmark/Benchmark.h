@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../Util/Vector.h"
+#include "../Util/String.h"
+#include "../Util/HashMap.h"
+#include "../Util/Util.h"
+
+#include "../Util/Intrinsic.h"
+
+//xorshift32, keeps key sequences identical between runs.
+inline uint32_t nextRandom(uint32_t &state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+//runs each case several times and reports median and 95th percentile of elapsed cycles.
+//cases given a byte count also report throughput in MB/s, from tsc frequency measured on start.
+//if a baseline result file is loaded, each case is compared with its median there.
+class BenchmarkRunner
+{
+private:
+	size_t repeat_;
+	String result_;
+	uint64_t frequency_; //tsc ticks per second
+	HashMap<String, uint64_t> baseline_;
+
+	void addBaselineComparison(const String &name, uint64_t median);
+	String getThroughput(uint64_t bytes, uint64_t cycles) const;
+public:
+	BenchmarkRunner(size_t repeat);
+
+	template<typename FunctionType>
+	void run(const String &name, FunctionType function)
+	{
+		run(name, 0, function);
+	}
+
+	template<typename FunctionType>
+	void run(const String &name, uint64_t bytes, FunctionType function)
+	{
+		Vector<uint64_t> samples;
+		samples.reserve(repeat_);
+		for(size_t i = 0; i < repeat_; i ++)
+		{
+			uint64_t start = __rdtsc();
+			function();
+			samples.push_back(__rdtsc() - start);
+		}
+		addResult(name, samples, bytes);
+	}
+
+	//for cases timed by caller, like stages of one run. sorts samples.
+	void addResult(const String &name, Vector<uint64_t> &samples, uint64_t bytes);
+	//single measured value, like allocation counts. reported in median column.
+	void addValue(const String &name, uint64_t value);
+	//parses result written by a previous run. text must end with end line or nul.
+	void loadBaseline(const char *text);
+	String getResult() const;
+};
+
+void benchmarkContainers(BenchmarkRunner &runner);
+void benchmarkArena(BenchmarkRunner &runner);
+void benchmarkAllocator(BenchmarkRunner &runner);
+void benchmarkImage(BenchmarkRunner &runner);
+void benchmarkPE(BenchmarkRunner &runner);
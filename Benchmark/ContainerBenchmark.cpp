@@ -0,0 +1,200 @@
+#include "Benchmark.h"
+
+#include "../Util/List.h"
+#include "../Util/Map.h"
+#include "../Util/HashMap.h"
+#include "../Util/UniqueVector.h"
+#include "../Util/DataSource.h"
+
+static const size_t ContainerItemCount = 4096;
+
+void benchmarkContainers(BenchmarkRunner &runner)
+{
+	//sorted keys, like image base addresses and section addresses.
+	runner.run("Map/insert sorted", []() {
+		Map<uint32_t, uint32_t> map;
+		for(uint32_t i = 0; i < ContainerItemCount; i ++)
+			map.insert(i * 0x1000, i);
+	});
+
+	runner.run("Map/insert random", []() {
+		Map<uint32_t, uint32_t> map;
+		uint32_t state = 0x12345678;
+		for(uint32_t i = 0; i < ContainerItemCount; i ++)
+			map.insert(nextRandom(state), i);
+	});
+
+	Map<uint32_t, uint32_t> sortedMap;
+	for(uint32_t i = 0; i < ContainerItemCount; i ++)
+		sortedMap.insert(i * 0x1000, i);
+
+	runner.run("Map/find", [&]() {
+		uint32_t state = 0x12345678;
+		uint32_t found = 0;
+		for(uint32_t i = 0; i < ContainerItemCount; i ++)
+			if(sortedMap.find((nextRandom(state) % ContainerItemCount) * 0x1000) != sortedMap.end())
+				found ++;
+		return found;
+	});
+
+	runner.run("Map/iterate", [&]() {
+		uint32_t sum = 0;
+		for(auto &i : sortedMap)
+			sum += i.value;
+		return sum;
+	});
+
+	runner.run("Map/upper_bound", [&]() {
+		uint32_t sum = 0;
+		for(uint32_t i = 0; i < ContainerItemCount; i ++)
+		{
+			auto it = sortedMap.upper_bound(i * 0x1000 + 1);
+			if(it != sortedMap.end())
+				sum += it->value;
+		}
+		return sum;
+	});
+
+	runner.run("HashMap/insert random", []() {
+		HashMap<uint32_t, uint32_t> map;
+		uint32_t state = 0x12345678;
+		for(uint32_t i = 0; i < ContainerItemCount; i ++)
+			map.insert(nextRandom(state), i);
+	});
+
+	HashMap<uint32_t, uint32_t> hashMap;
+	for(uint32_t i = 0; i < ContainerItemCount; i ++)
+		hashMap.insert(i * 0x1000, i);
+
+	runner.run("HashMap/find", [&]() {
+		uint32_t state = 0x12345678;
+		uint32_t found = 0;
+		for(uint32_t i = 0; i < ContainerItemCount; i ++)
+			if(hashMap.find((nextRandom(state) % ContainerItemCount) * 0x1000) != hashMap.end())
+				found ++;
+		return found;
+	});
+
+	HashSet<String, CaseInsensitiveStringHasher<String>> nameSet;
+	Vector<String> names;
+	for(uint32_t i = 0; i < 256; i ++)
+	{
+		names.push_back(String("Library") + IntToString(i) + ".dll");
+		nameSet.insert(names[i]);
+	}
+
+	runner.run("HashSet/contains case insensitive", [&]() {
+		uint32_t found = 0;
+		for(size_t i = 0; i < names.size(); i ++)
+			if(nameSet.contains(names[i]))
+				found ++;
+		return found;
+	});
+
+	//short names like section and dll names, as loader copies and concatenates them.
+	runner.run("String/short copy and concat", [&]() {
+		size_t length = 0;
+		for(size_t i = 0; i < names.size(); i ++)
+		{
+			String name = names[i];
+			length += (name.substr(0, 4) + ".dll").length();
+		}
+		return length;
+	});
+
+	runner.run("String/view compare", [&]() {
+		uint32_t found = 0;
+		for(size_t i = 0; i < names.size(); i ++)
+			if(names[i].view(0, 4).icompare("libr") == 0)
+				found ++;
+		return found;
+	});
+
+	runner.run("List/push_back", []() {
+		List<uint32_t> list;
+		for(uint32_t i = 0; i < ContainerItemCount; i ++)
+			list.push_back(i);
+	});
+
+	runner.run("Vector/push_back", []() {
+		Vector<uint32_t> vector;
+		for(uint32_t i = 0; i < ContainerItemCount; i ++)
+			vector.push_back(i);
+	});
+
+	Vector<uint32_t> vector;
+	for(uint32_t i = 0; i < ContainerItemCount; i ++)
+		vector.push_back(i);
+
+	runner.run("Vector/index", [&]() {
+		uint32_t sum = 0;
+		for(uint32_t i = 0; i < vector.size(); i ++)
+			sum += vector[i];
+		return sum;
+	});
+
+	//per element cost of copy on write check, as in serializer and RLE loops.
+	runner.run("Vector/byte push_back", []() {
+		Vector<uint8_t> vector;
+		for(uint32_t i = 0; i < ContainerItemCount * 16; i ++)
+			vector.push_back(static_cast<uint8_t>(i));
+	});
+
+	runner.run("UniqueVector/byte push_back", []() {
+		UniqueVector<uint8_t> vector;
+		for(uint32_t i = 0; i < ContainerItemCount * 16; i ++)
+			vector.push_back(static_cast<uint8_t>(i));
+	});
+
+	//chunked appends, as in image serializer.
+	uint8_t chunk[256];
+	for(size_t i = 0; i < sizeof(chunk); i ++)
+		chunk[i] = static_cast<uint8_t>(i);
+
+	runner.run("Vector/byte append", [&]() {
+		Vector<uint8_t> vector;
+		for(uint32_t i = 0; i < ContainerItemCount; i ++)
+			vector.append(chunk, (i % sizeof(chunk)) + 1);
+	});
+
+	runner.run("UniqueVector/byte append", [&]() {
+		UniqueVector<uint8_t> vector;
+		for(uint32_t i = 0; i < ContainerItemCount; i ++)
+			vector.append(chunk, (i % sizeof(chunk)) + 1);
+	});
+
+	runner.run("Vector/index write", [&]() {
+		for(uint32_t i = 0; i < vector.size(); i ++)
+			vector[i] ++;
+	});
+
+	UniqueVector<uint32_t> uniqueVector;
+	for(uint32_t i = 0; i < ContainerItemCount; i ++)
+		uniqueVector.push_back(i);
+
+	runner.run("UniqueVector/index write", [&]() {
+		for(uint32_t i = 0; i < uniqueVector.size(); i ++)
+			uniqueVector[i] ++;
+	});
+
+	//views are made per section and per import while loading.
+	uint8_t viewMemory[256];
+	SharedPtr<MemoryDataSource> viewSource = MakeShared<MemoryDataSource>(viewMemory, sizeof(viewMemory));
+
+	runner.run("SharedPtr/MakeShared view", [&]() {
+		size_t size = 0;
+		for(uint32_t i = 0; i < ContainerItemCount; i ++)
+			size += viewSource->getView(i % sizeof(viewMemory), 1)->size();
+		return size;
+	});
+
+	runner.run("SharedPtr/copy", [&]() {
+		size_t refs = 0;
+		for(uint32_t i = 0; i < ContainerItemCount; i ++)
+		{
+			SharedPtr<DataSource> copy = viewSource;
+			refs += copy.getRef();
+		}
+		return refs;
+	});
+}
@@ -0,0 +1,75 @@
+#include "Benchmark.h"
+
+#include "../Runtime/Image.h"
+#include "../Util/List.h"
+
+//large dlls with many absolute addresses, like mshtml, have this many relocations.
+static const size_t RelocationCount = 200000;
+
+static Image makeRelocationImage(Vector<uint8_t> &headerData, Vector<uint8_t> &sectionData)
+{
+	Image image;
+	image.info.architecture = ArchitectureWin32;
+	image.info.baseAddress = 0x10000000;
+	image.info.entryPoint = 0x1000;
+	image.info.flag = ImageFlagLibrary;
+	image.info.platformData = 0;
+	image.info.platformData1 = 0;
+	image.info.size = 0x1000 + sectionData.size();
+	image.info.timeStamp = 0;
+	image.info.checkSum = 0;
+	image.header = headerData.getView(0, headerData.size());
+
+	Section section;
+	section.name = ".data";
+	section.baseAddress = 0x1000;
+	section.size = sectionData.size();
+	section.flag = SectionFlagData | SectionFlagRead;
+	section.data = sectionData.getView(0, sectionData.size());
+	image.sections.push_back(std::move(section));
+
+	image.relocations.resize_uninitialized(RelocationCount);
+	for(size_t i = 0; i < RelocationCount; i ++)
+		image.relocations[i] = 0x1000 + i * sizeof(uint32_t);
+	return image;
+}
+
+void benchmarkImage(BenchmarkRunner &runner)
+{
+	Vector<uint8_t> headerData(0x400);
+	zeroMemory(headerData.get(), headerData.size());
+	Vector<uint8_t> sectionData(RelocationCount * sizeof(uint32_t));
+	zeroMemory(sectionData.get(), sectionData.size());
+	Image image = makeRelocationImage(headerData, sectionData);
+
+	//previous layout of Image::relocations, one node per entry.
+	List<uint64_t> relocationList;
+	for(auto &i : image.relocations)
+		relocationList.push_back(i);
+
+	runner.run("Image/relocations iterate list", [&]() {
+		uint64_t sum = 0;
+		for(auto &i : relocationList)
+			sum += i;
+		return sum;
+	});
+
+	const Vector<uint64_t> &relocations = image.relocations;
+	runner.run("Image/relocations iterate vector", [&]() {
+		uint64_t sum = 0;
+		for(auto &i : relocations)
+			sum += i;
+		return sum;
+	});
+
+	Vector<uint8_t> serialized = image.serialize();
+	runner.run("Image/unserialize 200k relocations", [&]() {
+		Image result = Image::unserialize(serialized.getView(0, serialized.size()), nullptr);
+		return result.relocations.size();
+	});
+
+	//allocations made while parsing are served by the image's arena, so its count covers unserialize.
+	Image result = Image::unserialize(serialized.getView(0, serialized.size()), nullptr);
+	runner.addValue("Image/unserialize 200k relocations arena allocations", result.arena->getAllocationCount());
+	runner.addValue("Image/unserialize 200k relocations arena bytes", result.arena->getAllocatedSize());
+}
@@ -0,0 +1,139 @@
+#include "Benchmark.h"
+#include "SyntheticPE.h"
+
+#include "../Runtime/PEFormat.h"
+#include "../Runtime/Image.h"
+#include "../Util/Util.h"
+#include "../LZMA/LzmaDec.h"
+#include "../Win32/Stub/Win32Stub.h"
+#include "../Win32/Stub/StubData.h"
+
+struct Corpus
+{
+	const char *name;
+	SyntheticPEOptions options;
+};
+
+//small and large dlls of both architectures, plus one with incompressible sections.
+static const Corpus corpora[] = {
+	{"pe32 small", {ArchitectureWin32, 0x10000, 0x4000, 32, 2000, 4, 20, 50, 1}},
+	{"pe32 large", {ArchitectureWin32, 0x100000, 0x40000, 32, 50000, 16, 100, 2000, 2}},
+	{"pe32+ large", {ArchitectureWin32AMD64, 0x100000, 0x40000, 32, 50000, 16, 100, 2000, 3}},
+	{"pe32 random", {ArchitectureWin32, 0x100000, 0x40000, 256, 10000, 4, 20, 50, 4}},
+};
+
+static void *SzAlloc(void *, size_t size)
+{
+	return heapAlloc(size);
+}
+static void SzFree(void *, void *address)
+{
+	heapFree(address);
+}
+static ISzAlloc benchmarkAlloc = {SzAlloc, SzFree};
+
+static void benchmarkCorpus(BenchmarkRunner &runner, const Corpus &corpus)
+{
+	Vector<uint8_t> file = generateSyntheticPE(corpus.options);
+	String prefix = String("PE/") + corpus.name + "/";
+
+	runner.run(prefix + "load toImage", file.size(), [&]() {
+		PEFormat format;
+		format.load(file.asDataSource(), false);
+		Image image = format.toImage();
+		return image.relocations.size();
+	});
+
+	PEFormat format;
+	format.load(file.asDataSource(), false);
+	Image image = format.toImage();
+
+	UniqueVector<uint8_t> uncompressed = image.serializeUncompressed();
+	runner.run(prefix + "serialize", uncompressed.size(), [&]() {
+		return image.serializeUncompressed().size();
+	});
+
+	//branch filter runs in place. equal number of encodes and decodes leaves code as it was.
+	const SharedPtr<DataView> &code = image.sections[0].data;
+	Vector<uint8_t> codeCopy(code->get(), code->get() + code->size());
+	runner.run(prefix + "branch encode", codeCopy.size(), [&]() {
+		Image::encodeBranches(codeCopy.get(), codeCopy.size());
+		return codeCopy[0];
+	});
+	runner.run(prefix + "branch decode", codeCopy.size(), [&]() {
+		Image::decodeBranches(codeCopy.get(), codeCopy.size());
+		return codeCopy[0];
+	});
+
+	runner.run(prefix + "lzma encode", uncompressed.size(), [&]() {
+		return Image::compress(uncompressed).size();
+	});
+
+	//layout written by Image::compress: uncompressed size, compressed size, props, stream.
+	Vector<uint8_t> serialized = Image::compress(uncompressed);
+	runner.addValue(prefix + "lzma compressed bytes", serialized.size());
+	Vector<uint8_t> decompressed(uncompressed.size());
+	runner.run(prefix + "lzma decode", uncompressed.size(), [&]() {
+		const size_t headerSize = sizeof(uint32_t) * 2;
+		SizeT outSize = decompressed.size();
+		SizeT inSize = serialized.size() - headerSize - LZMA_PROPS_SIZE;
+		ELzmaStatus status;
+		LzmaDecode(decompressed.get(), &outSize, serialized.get() + headerSize + LZMA_PROPS_SIZE, &inSize, serialized.get() + headerSize, LZMA_PROPS_SIZE, LZMA_FINISH_ANY, &status, &benchmarkAlloc);
+		return outSize;
+	});
+
+	runner.run(prefix + "unserialize", uncompressed.size(), [&]() {
+		Image result = Image::unserialize(serialized.getView(0, serialized.size()), nullptr);
+		return result.sections.size();
+	});
+
+	//crypt and decrypt alternate like branch filter, on compressed data the stub decrypts.
+	Vector<uint8_t> cryptData(serialized.get(), serialized.get() + serialized.size());
+	runner.run(prefix + "crypt", cryptData.size(), [&]() {
+		simpleCrypt(0x12345678, cryptData.get(), cryptData.size());
+		return cryptData[0];
+	});
+	runner.run(prefix + "decrypt", cryptData.size(), [&]() {
+		simpleDecrypt(0x12345678, cryptData.get(), cryptData.size());
+		return cryptData[0];
+	});
+
+	//keystream crypt is its own inverse, so repeated runs alternate as well.
+	const KeystreamKernel kernels[] = {KeystreamKernelScalar, KeystreamKernelSSE2, KeystreamKernelAVX2};
+	const char *kernelNames[] = {"scalar", "sse2", "avx2"};
+	for(size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i ++)
+		runner.run(prefix + "keystream crypt " + kernelNames[i], cryptData.size(), [&]() {
+			keystreamCrypt(0x12345678, 0, cryptData.get(), cryptData.size(), kernels[i]);
+			return cryptData[0];
+		});
+
+	PEFormat saveFormat;
+	saveFormat.load(file.asDataSource(), false);
+	Vector<uint8_t> output(saveFormat.estimateSize());
+	runner.run(prefix + "save", output.size(), [&]() {
+		saveFormat.save(output.asDataSource());
+		return output[0];
+	});
+
+	const ChecksumKernel checksumKernels[] = {ChecksumKernelScalar, ChecksumKernelSSE2, ChecksumKernelAVX2};
+	for(size_t i = 0; i < sizeof(checksumKernels) / sizeof(checksumKernels[0]); i ++)
+	{
+		runner.run(prefix + "signature " + kernelNames[i], file.size(), [&]() {
+			return static_cast<uint32_t>(sumWords(file.get(), file.size() / 4, checksumKernels[i]));
+		});
+		runner.run(prefix + "pe checksum " + kernelNames[i], file.size(), [&]() {
+			return finishPEChecksum(updatePEChecksum(0, 0, file.get(), file.size(), checksumKernels[i]), static_cast<uint32_t>(file.size()));
+		});
+	}
+}
+
+void benchmarkPE(BenchmarkRunner &runner)
+{
+	for(size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i ++)
+		benchmarkCorpus(runner, corpora[i]);
+
+	Vector<uint8_t> stub(win32StubSize);
+	runner.run("PE/stub rle decompress", win32StubSize, [&]() {
+		return simpleRLEDecompress(win32StubData, stub.get());
+	});
+}
@@ -0,0 +1,443 @@
+#include "SyntheticPE.h"
+
+#include "Benchmark.h"
+#include "../Runtime/PEHeader.h"
+#include "../Runtime/Signature.h"
+#include "../Util/Util.h"
+#include "../Util/UniqueVector.h"
+#include "../Util/String.h"
+
+static const uint32_t HeaderSize = 0x400;
+static const uint32_t NtHeaderOffset = 0x80;
+static const uint32_t SectionAlignment = 0x1000;
+static const uint32_t FileAlignment = 0x200;
+static const uint32_t CodeBase = 0x1000;
+static const size_t FunctionSize = 32;
+
+//appends zero filled space and returns its offset.
+static size_t reserveSpace(UniqueVector<uint8_t> &buffer, size_t size)
+{
+	size_t offset = buffer.size();
+	buffer.resize(offset + size);
+	return offset;
+}
+
+static void alignSpace(UniqueVector<uint8_t> &buffer, size_t alignment)
+{
+	if(buffer.size() % alignment)
+		reserveSpace(buffer, alignment - buffer.size() % alignment);
+}
+
+static size_t appendString(UniqueVector<uint8_t> &buffer, const String &value)
+{
+	size_t offset = buffer.size();
+	buffer.append(reinterpret_cast<const uint8_t *>(value.c_str()), value.length());
+	buffer.push_back(0);
+	return offset;
+}
+
+static void writePointer(uint8_t *target, uint64_t value, size_t pointerSize)
+{
+	if(pointerSize == sizeof(uint64_t))
+		*reinterpret_cast<uint64_t *>(target) = value;
+	else
+		*reinterpret_cast<uint32_t *>(target) = static_cast<uint32_t>(value);
+}
+
+//fixed width, so names are sorted like a linker emits them.
+static String makeName(const char *prefix, size_t index)
+{
+	String number = IntToString(index);
+	String result(prefix);
+	for(size_t i = number.length(); i < 5; i ++)
+		result.append("0");
+	result.append(number);
+	return result;
+}
+
+//replaces entropy / 256 of bytes with random ones.
+static void addNoise(uint8_t *data, size_t size, uint32_t entropy, uint32_t &random)
+{
+	for(size_t i = 0; i < size; i ++)
+	{
+		uint32_t value = nextRandom(random);
+		if((value & 0xff) < entropy)
+			data[i] = static_cast<uint8_t>(value >> 8);
+	}
+}
+
+static size_t getFunctionCount(size_t codeSize)
+{
+	return max(codeSize / FunctionSize, 1);
+}
+
+//functions of same shape calling each other with call rel32, which the branch filter turns into repeated absolute targets.
+static void generateCode(uint8_t *code, size_t size, uint32_t &random)
+{
+	const uint8_t prologue[] = {0x55, 0x8b, 0xec, 0x83, 0xec, 0x10, 0x8b, 0x45, 0x08}; //push ebp; mov ebp, esp; sub esp, 10h; mov eax, [ebp+8]
+	const uint8_t epilogue[] = {0x8b, 0xe5, 0x5d, 0xc3}; //mov esp, ebp; pop ebp; ret
+	size_t calleeCount = getFunctionCount(size);
+	if(calleeCount > 64)
+		calleeCount = 64;
+
+	size_t offset = 0;
+	for(; offset + FunctionSize <= size; offset += FunctionSize)
+	{
+		uint8_t *function = code + offset;
+		copyMemory(function, prologue, sizeof(prologue));
+		for(size_t i = 0; i < 3; i ++)
+		{
+			size_t callOffset = offset + sizeof(prologue) + i * 5;
+			size_t target = (nextRandom(random) % calleeCount) * FunctionSize;
+			code[callOffset] = 0xe8;
+			*reinterpret_cast<int32_t *>(code + callOffset + 1) = static_cast<int32_t>(target - (callOffset + 5));
+		}
+		copyMemory(function + sizeof(prologue) + 15, epilogue, sizeof(epilogue));
+		for(size_t i = sizeof(prologue) + 15 + sizeof(epilogue); i < FunctionSize; i ++)
+			function[i] = 0xcc;
+	}
+	for(; offset < size; offset ++)
+		code[offset] = 0xcc;
+}
+
+//one block per page. blocks are 4 byte aligned with absolute entry as padding.
+static void generateRelocations(UniqueVector<uint8_t> &reloc, uint32_t start, size_t count, size_t stride, uint16_t type)
+{
+	size_t i = 0;
+	while(i < count)
+	{
+		uint32_t page = static_cast<uint32_t>(start + i * stride) & ~0xfff;
+		size_t blockOffset = reserveSpace(reloc, sizeof(IMAGE_BASE_RELOCATION));
+		size_t entryCount = 0;
+		for(; i < count && (static_cast<uint32_t>(start + i * stride) & ~0xfff) == page; i ++, entryCount ++)
+		{
+			uint16_t entry = static_cast<uint16_t>((type << 12) | ((start + i * stride) & 0xfff));
+			reloc.append(reinterpret_cast<const uint8_t *>(&entry), sizeof(entry));
+		}
+		if(entryCount & 1)
+		{
+			reserveSpace(reloc, sizeof(uint16_t));
+			entryCount ++;
+		}
+
+		IMAGE_BASE_RELOCATION *block = reinterpret_cast<IMAGE_BASE_RELOCATION *>(reloc.get() + blockOffset);
+		block->VirtualAddress = page;
+		block->SizeOfBlock = static_cast<uint32_t>(sizeof(IMAGE_BASE_RELOCATION) + entryCount * sizeof(uint16_t));
+	}
+}
+
+static void generateExports(UniqueVector<uint8_t> &rdata, uint32_t rdataBase, size_t count, size_t codeSize, IMAGE_DATA_DIRECTORY *directory)
+{
+	size_t directoryOffset = reserveSpace(rdata, sizeof(IMAGE_EXPORT_DIRECTORY));
+	size_t functionsOffset = reserveSpace(rdata, count * sizeof(uint32_t));
+	size_t namesOffset = reserveSpace(rdata, count * sizeof(uint32_t));
+	size_t ordinalsOffset = reserveSpace(rdata, count * sizeof(uint16_t));
+	size_t libraryNameOffset = appendString(rdata, "synthetic.dll");
+
+	size_t functionCount = getFunctionCount(codeSize);
+	for(size_t i = 0; i < count; i ++)
+	{
+		size_t nameOffset = appendString(rdata, makeName("Export", i));
+		reinterpret_cast<uint32_t *>(rdata.get() + functionsOffset)[i] = static_cast<uint32_t>(CodeBase + (i % functionCount) * FunctionSize);
+		reinterpret_cast<uint32_t *>(rdata.get() + namesOffset)[i] = static_cast<uint32_t>(rdataBase + nameOffset);
+		reinterpret_cast<uint16_t *>(rdata.get() + ordinalsOffset)[i] = static_cast<uint16_t>(i);
+	}
+
+	IMAGE_EXPORT_DIRECTORY *exportDirectory = reinterpret_cast<IMAGE_EXPORT_DIRECTORY *>(rdata.get() + directoryOffset);
+	exportDirectory->Name = static_cast<uint32_t>(rdataBase + libraryNameOffset);
+	exportDirectory->Base = 1;
+	exportDirectory->NumberOfFunctions = static_cast<uint32_t>(count);
+	exportDirectory->NumberOfNames = static_cast<uint32_t>(count);
+	exportDirectory->AddressOfFunctions = static_cast<uint32_t>(rdataBase + functionsOffset);
+	exportDirectory->AddressOfNames = static_cast<uint32_t>(rdataBase + namesOffset);
+	exportDirectory->AddressOfNameOrdinals = static_cast<uint32_t>(rdataBase + ordinalsOffset);
+
+	directory->VirtualAddress = static_cast<uint32_t>(rdataBase + directoryOffset);
+	directory->Size = static_cast<uint32_t>(rdata.size() - directoryOffset);
+}
+
+static void generateImports(UniqueVector<uint8_t> &rdata, uint32_t rdataBase, size_t libraryCount, size_t functionCount, size_t pointerSize, IMAGE_DATA_DIRECTORY *directory)
+{
+	size_t descriptorOffset = reserveSpace(rdata, (libraryCount + 1) * sizeof(IMAGE_IMPORT_DESCRIPTOR));
+	for(size_t i = 0; i < libraryCount; i ++)
+	{
+		alignSpace(rdata, pointerSize);
+		size_t lookupOffset = reserveSpace(rdata, (functionCount + 1) * pointerSize);
+		size_t iatOffset = reserveSpace(rdata, (functionCount + 1) * pointerSize);
+		for(size_t j = 0; j < functionCount; j ++)
+		{
+			size_t nameOffset = reserveSpace(rdata, sizeof(uint16_t)); //hint
+			appendString(rdata, makeName("Import", i * functionCount + j));
+			alignSpace(rdata, sizeof(uint16_t));
+			writePointer(rdata.get() + lookupOffset + j * pointerSize, rdataBase + nameOffset, pointerSize);
+			writePointer(rdata.get() + iatOffset + j * pointerSize, rdataBase + nameOffset, pointerSize);
+		}
+		size_t libraryNameOffset = appendString(rdata, makeName("library", i) + ".dll");
+
+		IMAGE_IMPORT_DESCRIPTOR *descriptor = reinterpret_cast<IMAGE_IMPORT_DESCRIPTOR *>(rdata.get() + descriptorOffset) + i;
+		descriptor->OriginalFirstThunk = static_cast<uint32_t>(rdataBase + lookupOffset);
+		descriptor->Name = static_cast<uint32_t>(rdataBase + libraryNameOffset);
+		descriptor->FirstThunk = static_cast<uint32_t>(rdataBase + iatOffset);
+	}
+
+	directory->VirtualAddress = static_cast<uint32_t>(rdataBase + descriptorOffset);
+	directory->Size = static_cast<uint32_t>((libraryCount + 1) * sizeof(IMAGE_IMPORT_DESCRIPTOR));
+}
+
+//returns file offset of section data.
+static uint32_t appendSection(UniqueVector<uint8_t> &file, IMAGE_SECTION_HEADER *header, const String &name, uint32_t address, const UniqueVector<uint8_t> &data, uint32_t characteristics)
+{
+	uint32_t rawOffset = static_cast<uint32_t>(file.size());
+	file.append(data);
+	reserveSpace(file, multipleOf(data.size(), FileAlignment) - data.size());
+
+	copyMemory(header->Name, name.c_str(), name.length());
+	header->VirtualSize = static_cast<uint32_t>(data.size());
+	header->VirtualAddress = address;
+	header->SizeOfRawData = static_cast<uint32_t>(multipleOf(data.size(), FileAlignment));
+	header->PointerToRawData = rawOffset;
+	header->Characteristics = characteristics;
+	return rawOffset;
+}
+
+static uint32_t getNextSectionAddress(uint32_t address, size_t size)
+{
+	return address + static_cast<uint32_t>(multipleOf(max(size, 1), SectionAlignment));
+}
+
+template<typename OptionalHeaderType>
+static void fillOptionalHeader(OptionalHeaderType *header, uint16_t magic, uint32_t codeSize, uint32_t dataSize, uint32_t imageSize)
+{
+	header->base.Magic = magic;
+	header->base.SizeOfCode = codeSize;
+	header->base.SizeOfInitializedData = dataSize;
+	header->base.AddressOfEntryPoint = CodeBase;
+	header->base.BaseOfCode = CodeBase;
+	header->SectionAlignment = SectionAlignment;
+	header->FileAlignment = FileAlignment;
+	header->MajorOperatingSystemVersion = 6;
+	header->MajorSubsystemVersion = 6;
+	header->SizeOfImage = imageSize;
+	header->SizeOfHeaders = HeaderSize;
+	header->Subsystem = IMAGE_SUBSYSTEM_WINDOWS_GUI;
+	header->DllCharacteristics = IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE | IMAGE_DLLCHARACTERISTICS_NX_COMPAT;
+	header->SizeOfStackReserve = 0x100000;
+	header->SizeOfStackCommit = 0x1000;
+	header->SizeOfHeapReserve = 0x100000;
+	header->SizeOfHeapCommit = 0x1000;
+	header->NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+}
+
+Vector<uint8_t> generateSyntheticPE(const SyntheticPEOptions &options)
+{
+	bool is64 = options.architecture == ArchitectureWin32AMD64;
+	size_t pointerSize = is64 ? sizeof(uint64_t) : sizeof(uint32_t);
+	uint64_t imageBase = is64 ? 0x180000000ull : 0x10000000;
+	uint32_t random = options.seed ? options.seed : 1;
+	IMAGE_DATA_DIRECTORY dataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+	zeroMemory(dataDirectory, sizeof(dataDirectory));
+
+	//.text
+	UniqueVector<uint8_t> code;
+	code.resize(max(options.codeSize, 1));
+	generateCode(code.get(), code.size(), random);
+	addNoise(code.get(), code.size(), options.entropy, random);
+	uint32_t codeAddress = CodeBase;
+
+	//.data, relocated pointers to code first.
+	UniqueVector<uint8_t> data;
+	data.resize(max(options.dataSize, options.relocationCount * pointerSize));
+	uint32_t dataAddress = getNextSectionAddress(codeAddress, code.size());
+	size_t pointerAreaSize = options.relocationCount * pointerSize;
+	for(size_t i = 0; i < options.relocationCount; i ++)
+		writePointer(data.get() + i * pointerSize, imageBase + CodeBase + (nextRandom(random) % getFunctionCount(code.size())) * FunctionSize, pointerSize);
+	for(size_t i = pointerAreaSize; i < data.size(); i += 16)
+		data[i] = static_cast<uint8_t>(i >> 4);
+	addNoise(data.get() + pointerAreaSize, data.size() - pointerAreaSize, options.entropy, random);
+
+	//.rdata
+	UniqueVector<uint8_t> rdata;
+	uint32_t rdataAddress = getNextSectionAddress(dataAddress, data.size());
+	if(options.exportCount)
+		generateExports(rdata, rdataAddress, options.exportCount, code.size(), &dataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT]);
+	if(options.importLibraryCount)
+	{
+		alignSpace(rdata, sizeof(uint64_t));
+		generateImports(rdata, rdataAddress, options.importLibraryCount, options.importFunctionCount, pointerSize, &dataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT]);
+	}
+	if(!rdata.size())
+		rdata.push_back(0);
+
+	//.reloc, followed by empty block which ends parsing.
+	UniqueVector<uint8_t> reloc;
+	uint32_t relocAddress = getNextSectionAddress(rdataAddress, rdata.size());
+	generateRelocations(reloc, dataAddress, options.relocationCount, pointerSize, is64 ? IMAGE_REL_BASED_DIR64 : IMAGE_REL_BASED_HIGHLOW);
+	dataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].VirtualAddress = relocAddress;
+	dataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].Size = static_cast<uint32_t>(reloc.size());
+	reserveSpace(reloc, sizeof(IMAGE_BASE_RELOCATION));
+	uint32_t imageSize = getNextSectionAddress(relocAddress, reloc.size());
+
+	//headers
+	UniqueVector<uint8_t> file;
+	reserveSpace(file, HeaderSize);
+	IMAGE_DOS_HEADER *dosHeader = reinterpret_cast<IMAGE_DOS_HEADER *>(file.get());
+	dosHeader->e_magic = 0x5a4d; //MZ
+	dosHeader->e_lfanew = NtHeaderOffset;
+	*reinterpret_cast<uint32_t *>(file.get() + NtHeaderOffset) = IMAGE_NT_SIGNATURE;
+
+	IMAGE_FILE_HEADER *fileHeader = reinterpret_cast<IMAGE_FILE_HEADER *>(file.get() + NtHeaderOffset + sizeof(uint32_t));
+	fileHeader->Machine = is64 ? IMAGE_FILE_MACHINE_AMD64 : IMAGE_FILE_MACHINE_I386;
+	fileHeader->NumberOfSections = 4;
+	uint16_t optionalHeaderSize = static_cast<uint16_t>(is64 ? sizeof(IMAGE_OPTIONAL_HEADER64) : sizeof(IMAGE_OPTIONAL_HEADER32));
+	fileHeader->SizeOfOptionalHeader = optionalHeaderSize;
+	fileHeader->Characteristics = IMAGE_FILE_EXECUTABLE_IMAGE | IMAGE_FILE_DLL | (is64 ? IMAGE_FILE_LARGE_ADDRESS_AWARE : IMAGE_FILE_32BIT_MACHINE);
+
+	size_t optionalHeaderOffset = NtHeaderOffset + sizeof(uint32_t) + sizeof(IMAGE_FILE_HEADER);
+	uint32_t initializedDataSize = static_cast<uint32_t>(data.size() + rdata.size() + reloc.size());
+	if(is64)
+	{
+		IMAGE_OPTIONAL_HEADER64 *optionalHeader = reinterpret_cast<IMAGE_OPTIONAL_HEADER64 *>(file.get() + optionalHeaderOffset);
+		fillOptionalHeader(optionalHeader, IMAGE_NT_OPTIONAL_HDR64_MAGIC, static_cast<uint32_t>(code.size()), initializedDataSize, imageSize);
+		optionalHeader->ImageBase = imageBase;
+		copyMemory(optionalHeader->DataDirectory, dataDirectory, sizeof(dataDirectory));
+	}
+	else
+	{
+		IMAGE_OPTIONAL_HEADER32 *optionalHeader = reinterpret_cast<IMAGE_OPTIONAL_HEADER32 *>(file.get() + optionalHeaderOffset);
+		fillOptionalHeader(optionalHeader, IMAGE_NT_OPTIONAL_HDR32_MAGIC, static_cast<uint32_t>(code.size()), initializedDataSize, imageSize);
+		optionalHeader->ImageBase = static_cast<uint32_t>(imageBase);
+		optionalHeader->BaseOfData = dataAddress;
+		copyMemory(optionalHeader->DataDirectory, dataDirectory, sizeof(dataDirectory));
+	}
+
+	//appending section data moves file buffer, so section headers are copied in last.
+	IMAGE_SECTION_HEADER sectionHeaders[4];
+	zeroMemory(sectionHeaders, sizeof(sectionHeaders));
+	appendSection(file, &sectionHeaders[0], ".text", codeAddress, code, IMAGE_SCN_CNT_CODE | IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_MEM_READ);
+	appendSection(file, &sectionHeaders[1], ".data", dataAddress, data, IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_WRITE);
+	appendSection(file, &sectionHeaders[2], ".rdata", rdataAddress, rdata, IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ);
+	appendSection(file, &sectionHeaders[3], ".reloc", relocAddress, reloc, IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_DISCARDABLE);
+	copyMemory(file.get() + optionalHeaderOffset + optionalHeaderSize, sectionHeaders, sizeof(sectionHeaders));
+
+	return Vector<uint8_t>(std::move(file));
+}
+
+//every function slot gets code address, so exports by ordinal not asked for resolve as well.
+static void generateLibraryExports(UniqueVector<uint8_t> &edata, uint32_t edataBase, const String &fileName, const Vector<String> &names, uint32_t ordinalBase, size_t functionCount, IMAGE_DATA_DIRECTORY *directory)
+{
+	size_t directoryOffset = reserveSpace(edata, sizeof(IMAGE_EXPORT_DIRECTORY));
+	size_t functionsOffset = reserveSpace(edata, functionCount * sizeof(uint32_t));
+	size_t namesOffset = reserveSpace(edata, names.size() * sizeof(uint32_t));
+	size_t ordinalsOffset = reserveSpace(edata, names.size() * sizeof(uint16_t));
+	size_t libraryNameOffset = appendString(edata, fileName);
+
+	for(size_t i = 0; i < functionCount; i ++)
+		reinterpret_cast<uint32_t *>(edata.get() + functionsOffset)[i] = static_cast<uint32_t>(CodeBase + i * FunctionSize);
+	//named exports follow ordinals given, in last function slots.
+	size_t namedBase = functionCount - names.size();
+	for(size_t i = 0; i < names.size(); i ++)
+	{
+		size_t nameOffset = appendString(edata, names[i]);
+		reinterpret_cast<uint32_t *>(edata.get() + namesOffset)[i] = static_cast<uint32_t>(edataBase + nameOffset);
+		reinterpret_cast<uint16_t *>(edata.get() + ordinalsOffset)[i] = static_cast<uint16_t>(namedBase + i);
+	}
+
+	IMAGE_EXPORT_DIRECTORY *exportDirectory = reinterpret_cast<IMAGE_EXPORT_DIRECTORY *>(edata.get() + directoryOffset);
+	exportDirectory->Name = static_cast<uint32_t>(edataBase + libraryNameOffset);
+	exportDirectory->Base = ordinalBase;
+	exportDirectory->NumberOfFunctions = static_cast<uint32_t>(functionCount);
+	exportDirectory->NumberOfNames = static_cast<uint32_t>(names.size());
+	exportDirectory->AddressOfFunctions = static_cast<uint32_t>(edataBase + functionsOffset);
+	exportDirectory->AddressOfNames = static_cast<uint32_t>(edataBase + namesOffset);
+	exportDirectory->AddressOfNameOrdinals = static_cast<uint32_t>(edataBase + ordinalsOffset);
+
+	directory->VirtualAddress = static_cast<uint32_t>(edataBase + directoryOffset);
+	directory->Size = static_cast<uint32_t>(edata.size() - directoryOffset);
+}
+
+Vector<uint8_t> generateSyntheticLibrary(ArchitectureType architecture, const String &fileName, const Vector<String> &names, const Vector<uint16_t> &ordinals, uint32_t timeStamp, uint32_t checkSum)
+{
+	bool is64 = architecture == ArchitectureWin32AMD64;
+	IMAGE_DATA_DIRECTORY dataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+	zeroMemory(dataDirectory, sizeof(dataDirectory));
+
+	uint32_t ordinalBase = 1;
+	uint32_t lastOrdinal = 0;
+	for(auto &i : ordinals)
+	{
+		if(i < ordinalBase)
+			ordinalBase = i;
+		if(i > lastOrdinal)
+			lastOrdinal = i;
+	}
+	size_t functionCount = (lastOrdinal >= ordinalBase ? lastOrdinal + 1 - ordinalBase : 0) + names.size();
+
+	//.text, one return per function. export directory is apart from it, so no export reads as a forwarder.
+	UniqueVector<uint8_t> code;
+	code.resize(max(functionCount * FunctionSize, 1));
+	for(size_t i = 0; i < code.size(); i ++)
+		code[i] = 0xc3;
+	uint32_t codeAddress = CodeBase;
+
+	UniqueVector<uint8_t> edata;
+	uint32_t edataAddress = getNextSectionAddress(codeAddress, code.size());
+	generateLibraryExports(edata, edataAddress, fileName, names, ordinalBase, functionCount, &dataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT]);
+	uint32_t imageSize = getNextSectionAddress(edataAddress, edata.size());
+
+	//file offsets equal addresses, so the buffer is its own mapped image.
+	UniqueVector<uint8_t> image;
+	reserveSpace(image, imageSize);
+	IMAGE_DOS_HEADER *dosHeader = reinterpret_cast<IMAGE_DOS_HEADER *>(image.get());
+	dosHeader->e_magic = 0x5a4d; //MZ
+	dosHeader->e_lfanew = NtHeaderOffset;
+	*reinterpret_cast<uint32_t *>(image.get() + NtHeaderOffset) = IMAGE_NT_SIGNATURE;
+
+	IMAGE_FILE_HEADER *fileHeader = reinterpret_cast<IMAGE_FILE_HEADER *>(image.get() + NtHeaderOffset + sizeof(uint32_t));
+	fileHeader->Machine = is64 ? IMAGE_FILE_MACHINE_AMD64 : IMAGE_FILE_MACHINE_I386;
+	fileHeader->NumberOfSections = 2;
+	fileHeader->TimeDateStamp = timeStamp;
+	uint16_t optionalHeaderSize = static_cast<uint16_t>(is64 ? sizeof(IMAGE_OPTIONAL_HEADER64) : sizeof(IMAGE_OPTIONAL_HEADER32));
+	fileHeader->SizeOfOptionalHeader = optionalHeaderSize;
+	fileHeader->Characteristics = IMAGE_FILE_EXECUTABLE_IMAGE | IMAGE_FILE_DLL | (is64 ? IMAGE_FILE_LARGE_ADDRESS_AWARE : IMAGE_FILE_32BIT_MACHINE);
+
+	size_t optionalHeaderOffset = NtHeaderOffset + sizeof(uint32_t) + sizeof(IMAGE_FILE_HEADER);
+	if(is64)
+	{
+		IMAGE_OPTIONAL_HEADER64 *optionalHeader = reinterpret_cast<IMAGE_OPTIONAL_HEADER64 *>(image.get() + optionalHeaderOffset);
+		fillOptionalHeader(optionalHeader, IMAGE_NT_OPTIONAL_HDR64_MAGIC, static_cast<uint32_t>(code.size()), static_cast<uint32_t>(edata.size()), imageSize);
+		optionalHeader->ImageBase = 0x180000000ull;
+		optionalHeader->FileAlignment = SectionAlignment;
+		optionalHeader->SizeOfHeaders = SectionAlignment;
+		optionalHeader->CheckSum = checkSum;
+		copyMemory(optionalHeader->DataDirectory, dataDirectory, sizeof(dataDirectory));
+	}
+	else
+	{
+		IMAGE_OPTIONAL_HEADER32 *optionalHeader = reinterpret_cast<IMAGE_OPTIONAL_HEADER32 *>(image.get() + optionalHeaderOffset);
+		fillOptionalHeader(optionalHeader, IMAGE_NT_OPTIONAL_HDR32_MAGIC, static_cast<uint32_t>(code.size()), static_cast<uint32_t>(edata.size()), imageSize);
+		optionalHeader->ImageBase = 0x10000000;
+		optionalHeader->BaseOfData = edataAddress;
+		optionalHeader->FileAlignment = SectionAlignment;
+		optionalHeader->SizeOfHeaders = SectionAlignment;
+		optionalHeader->CheckSum = checkSum;
+		copyMemory(optionalHeader->DataDirectory, dataDirectory, sizeof(dataDirectory));
+	}
+
+	IMAGE_SECTION_HEADER *sectionHeaders = reinterpret_cast<IMAGE_SECTION_HEADER *>(image.get() + optionalHeaderOffset + optionalHeaderSize);
+	copyMemory(sectionHeaders[0].Name, ".text", 5);
+	sectionHeaders[0].VirtualSize = static_cast<uint32_t>(code.size());
+	sectionHeaders[0].VirtualAddress = codeAddress;
+	sectionHeaders[0].SizeOfRawData = static_cast<uint32_t>(multipleOf(code.size(), SectionAlignment));
+	sectionHeaders[0].PointerToRawData = codeAddress;
+	sectionHeaders[0].Characteristics = IMAGE_SCN_CNT_CODE | IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_MEM_READ;
+	copyMemory(sectionHeaders[1].Name, ".edata", 6);
+	sectionHeaders[1].VirtualSize = static_cast<uint32_t>(edata.size());
+	sectionHeaders[1].VirtualAddress = edataAddress;
+	sectionHeaders[1].SizeOfRawData = static_cast<uint32_t>(multipleOf(edata.size(), SectionAlignment));
+	sectionHeaders[1].PointerToRawData = edataAddress;
+	sectionHeaders[1].Characteristics = IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ;
+
+	copyMemory(image.get() + codeAddress, code.get(), code.size());
+	copyMemory(image.get() + edataAddress, edata.get(), edata.size());
+	return Vector<uint8_t>(std::move(image));
+}
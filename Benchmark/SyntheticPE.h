@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../Runtime/Image.h"
+#include "../Util/Vector.h"
+#include "../Util/String.h"
+
+//shape of generated PE file. same options and seed always give same file.
+struct SyntheticPEOptions
+{
+	ArchitectureType architecture;
+	size_t codeSize;
+	size_t dataSize; //grown to hold relocated words if smaller
+	uint32_t entropy; //0 for repeated instruction patterns, 256 for random bytes
+	size_t relocationCount;
+	size_t importLibraryCount;
+	size_t importFunctionCount; //per library
+	size_t exportCount;
+	uint32_t seed;
+};
+
+//builds PE32 or PE32+ dll file with .text, .data, .rdata(imports, exports) and .reloc sections.
+Vector<uint8_t> generateSyntheticPE(const SyntheticPEOptions &options);
+
+//builds mapped image of a dll exporting functions by name and by ordinal, laid out as the system loader maps it, so it
+//stands in for a system library loaded from memory. named exports take ordinals after the largest one given.
+Vector<uint8_t> generateSyntheticLibrary(ArchitectureType architecture, const String &fileName, const Vector<String> &names, const Vector<uint16_t> &ordinals, uint32_t timeStamp, uint32_t checkSum);
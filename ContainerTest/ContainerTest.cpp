@@ -0,0 +1,321 @@
+#include "../Util/Util.h"
+#include "../Util/Vector.h"
+#include "../Util/String.h"
+#include "../Runtime/Allocator.h"
+#include "../Benchmark/Benchmark.h"
+
+#include <stdio.h>
+#include <pthread.h>
+
+//checks for memory and container helpers on edge cases benchmarks don't reach.
+//exits nonzero on first failure. from repository root, with any compiler:
+//  g++ -g -O1 -std=c++11 -pthread -o containertest ContainerTest/ContainerTest.cpp Runtime/Allocator.cpp Win32/Win32PosixPlatform.cpp
+
+namespace
+{
+	bool failed = false;
+
+	void check(bool condition, const char *what, size_t a, size_t b)
+	{
+		if(condition)
+			return;
+		printf("failed: %s (%u, %u)\n", what, static_cast<uint32_t>(a), static_cast<uint32_t>(b));
+		failed = true;
+	}
+
+	//every source and destination misalignment, sizes around the word size.
+	void testCopyMemory()
+	{
+		uint8_t source[64];
+		uint8_t destination[64 + 2];
+		for(size_t i = 0; i < sizeof(source); i ++)
+			source[i] = static_cast<uint8_t>(i + 1);
+
+		for(size_t offset = 0; offset < sizeof(size_t) * 2; offset ++)
+			for(size_t size = 0; size <= sizeof(size_t) * 3; size ++)
+			{
+				setMemory(destination, 0xcc, sizeof(destination));
+				copyMemory(destination + 1, source + offset, size);
+				bool match = destination[0] == 0xcc && destination[size + 1] == 0xcc;
+				for(size_t i = 0; i < size; i ++)
+					match = match && destination[i + 1] == source[offset + i];
+				check(match, "copyMemory", offset, size);
+			}
+	}
+
+	void testSetMemory()
+	{
+		uint8_t destination[64];
+		for(size_t offset = 0; offset < sizeof(size_t) * 2; offset ++)
+			for(size_t size = 0; size <= sizeof(size_t) * 3; size ++)
+			{
+				for(size_t i = 0; i < sizeof(destination); i ++)
+					destination[i] = 0xcc;
+				setMemory(destination + offset, 0x11, size);
+				bool match = true;
+				for(size_t i = 0; i < sizeof(destination); i ++)
+					match = match && destination[i] == (i >= offset && i < offset + size ? 0x11 : 0xcc);
+				check(match, "setMemory", offset, size);
+			}
+	}
+
+	//pod append goes through copyMemory, with capacity exactly what is appended.
+	void testVectorAppend()
+	{
+		uint8_t source[32];
+		for(size_t i = 0; i < sizeof(source); i ++)
+			source[i] = static_cast<uint8_t>(i + 1);
+
+		for(size_t offset = 0; offset < sizeof(size_t) * 2; offset ++)
+			for(size_t size = 1; size <= sizeof(size_t) + 1; size ++)
+			{
+				Vector<uint8_t> vector;
+				vector.reserve(size);
+				vector.append(source + offset, size);
+				bool match = vector.size() == size;
+				for(size_t i = 0; i < size && match; i ++)
+					match = vector[i] == source[offset + i];
+				check(match, "Vector::append", offset, size);
+			}
+	}
+
+	//source inside the string itself, both while inline and when growth replaces heap buffer.
+	void testStringAliasing()
+	{
+		String string("abcdef");
+		for(int i = 0; i < 5; i ++)
+			string.append(string);
+		bool match = string.length() == 6 * 32;
+		for(size_t i = 0; i < string.length() && match; i ++)
+			match = string[i] == "abcdef"[i % 6];
+		check(match, "String::append self", string.length(), 0);
+
+		String part("0123456789abcdefghij");
+		part.append(part.c_str() + 10, 10);
+		check(part == String("0123456789abcdefghijabcdefghij"), "String::append part of self", part.length(), 0);
+
+		part.assign(part.c_str() + 20, 10);
+		check(part == String("abcdefghij"), "String::assign part of self", part.length(), 0);
+	}
+
+	//copy on write data shared out of an arena stays valid after arena is destroyed, and every chunk is released.
+	void testArenaSharing()
+	{
+		size_t heapSize = getHeapSize();
+		Vector<uint32_t> copy;
+		{
+			MemoryArena arena;
+			ArenaScope scope(&arena);
+			Vector<uint32_t> vector;
+			for(uint32_t i = 0; i < 1000; i ++)
+				vector.push_back(i);
+			copy = vector;
+			check(arena.getAllocationCount() != 0, "arena used", arena.getAllocationCount(), 0);
+		}
+		bool match = copy.size() == 1000;
+		for(uint32_t i = 0; i < copy.size() && match; i ++)
+			match = copy[i] == i;
+		check(match, "Vector shared out of arena", copy.size(), 0);
+
+		copy = Vector<uint32_t>();
+		check(getHeapSize() == heapSize, "arena chunks released", getHeapSize(), heapSize);
+	}
+
+	//mapped size of a big block over 4GB doesn't fit 32 bits, heap size must still return to where it was.
+	void testBigBlock()
+	{
+		size_t heapSize = getHeapSize();
+		check(heapAlloc(static_cast<size_t>(-1) - 16) == nullptr, "heapAlloc wrapping size", 0, 0);
+		if(sizeof(size_t) < sizeof(uint64_t))
+			return;
+		size_t size = static_cast<size_t>(0x100000000ull) + 0x1000;
+		uint8_t *block = reinterpret_cast<uint8_t *>(heapAlloc(size));
+		check(block != nullptr, "heapAlloc over 4GB", size, 0);
+		if(!block)
+			return;
+		block[0] = 1;
+		block[size - 1] = 1;
+		check(getHeapSize() - heapSize >= size, "heap size of big block", getHeapSize() - heapSize, size);
+		heapFree(block);
+		check(getHeapSize() == heapSize, "big block released", getHeapSize(), heapSize);
+	}
+
+	const size_t exchangeSize = 256;
+
+	//blocks one thread passes to the next, so each thread also frees blocks another one allocated.
+	struct Exchange
+	{
+		pthread_mutex_t lock;
+		uint8_t *blocks[exchangeSize];
+		size_t count;
+	};
+
+	struct StressThread
+	{
+		size_t index;
+		size_t iterations;
+		Exchange *exchanges;
+		size_t exchangeCount;
+		pthread_barrier_t *barrier;
+		size_t corruptCount;
+	};
+
+	//mostly size class blocks, every 64th a big block. all hold size and a byte pattern to check on free.
+	size_t getStressSize(uint32_t &random)
+	{
+		uint32_t value = nextRandom(random);
+		if((value & 63) == 0)
+			return 40000 + (value >> 20);
+		return 16 + (value >> 8) % 3000;
+	}
+
+	void fillBlock(uint8_t *block, size_t size, uint8_t seed)
+	{
+		*reinterpret_cast<size_t *>(block) = size;
+		block[sizeof(size_t)] = seed;
+		for(size_t i = sizeof(size_t) + 1; i < size; i ++)
+			block[i] = static_cast<uint8_t>(seed ^ i);
+	}
+
+	bool isBlockIntact(const uint8_t *block)
+	{
+		size_t size = *reinterpret_cast<const size_t *>(block);
+		uint8_t seed = block[sizeof(size_t)];
+		if(size < 16 || size > 50000)
+			return false;
+		for(size_t i = sizeof(size_t) + 1; i < size; i ++)
+			if(block[i] != static_cast<uint8_t>(seed ^ i))
+				return false;
+		return true;
+	}
+
+	void freeChecked(StressThread *thread, uint8_t *block)
+	{
+		if(!isBlockIntact(block))
+			thread->corruptCount ++;
+		heapFree(block);
+	}
+
+	void drainExchange(StressThread *thread)
+	{
+		Exchange &exchange = thread->exchanges[thread->index];
+		uint8_t *blocks[exchangeSize];
+		pthread_mutex_lock(&exchange.lock);
+		size_t count = exchange.count;
+		copyMemory(blocks, exchange.blocks, count * sizeof(uint8_t *));
+		exchange.count = 0;
+		pthread_mutex_unlock(&exchange.lock);
+		for(size_t i = 0; i < count; i ++)
+			freeChecked(thread, blocks[i]);
+	}
+
+	//false if next thread's exchange is full.
+	bool passBlock(StressThread *thread, uint8_t *block)
+	{
+		Exchange &exchange = thread->exchanges[(thread->index + 1) % thread->exchangeCount];
+		pthread_mutex_lock(&exchange.lock);
+		bool passed = exchange.count < exchangeSize;
+		if(passed)
+			exchange.blocks[exchange.count ++] = block;
+		pthread_mutex_unlock(&exchange.lock);
+		return passed;
+	}
+
+	void *runStressThread(void *argument)
+	{
+		StressThread *thread = reinterpret_cast<StressThread *>(argument);
+		uint32_t random = static_cast<uint32_t>(thread->index * 7919 + 1);
+		uint8_t *live[64] = {};
+
+		//every thread holds a cache slot, or found none left, before any starts working.
+		heapFree(heapAlloc(16));
+		pthread_barrier_wait(thread->barrier);
+
+		for(size_t i = 0; i < thread->iterations; i ++)
+		{
+			size_t slot = nextRandom(random) % 64;
+			if(live[slot])
+			{
+				if((random & 0x100) == 0 || !passBlock(thread, live[slot]))
+					freeChecked(thread, live[slot]);
+			}
+			size_t size = getStressSize(random);
+			live[slot] = reinterpret_cast<uint8_t *>(heapAlloc(size));
+			if(!live[slot])
+			{
+				thread->corruptCount ++;
+				continue;
+			}
+			fillBlock(live[slot], size, static_cast<uint8_t>(thread->index + i));
+			if((i & 15) == 0)
+				drainExchange(thread);
+		}
+		for(size_t i = 0; i < 64; i ++)
+			if(live[i])
+				freeChecked(thread, live[i]);
+
+		//nothing is passed after this, so the last drain empties the exchange.
+		pthread_barrier_wait(thread->barrier);
+		drainExchange(thread);
+		return nullptr;
+	}
+
+	//concurrent alloc and free across size classes and big blocks, with frees from other threads than the allocating one.
+	//blocks are checked on free, so a block handed out twice or overlapping another shows as corrupt.
+	void runStress(size_t threadCount, size_t iterations, const char *what)
+	{
+		pthread_barrier_t barrier;
+		pthread_barrier_init(&barrier, nullptr, static_cast<unsigned>(threadCount));
+		Vector<Exchange> exchanges;
+		Vector<StressThread> threads;
+		Vector<pthread_t> handles;
+		exchanges.resize(threadCount);
+		threads.resize(threadCount);
+		handles.resize(threadCount);
+		for(size_t i = 0; i < threadCount; i ++)
+		{
+			pthread_mutex_init(&exchanges[i].lock, nullptr);
+			exchanges[i].count = 0;
+			threads[i].index = i;
+			threads[i].iterations = iterations;
+			threads[i].exchanges = &exchanges[0];
+			threads[i].exchangeCount = threadCount;
+			threads[i].barrier = &barrier;
+			threads[i].corruptCount = 0;
+		}
+		for(size_t i = 0; i < threadCount; i ++)
+			pthread_create(&handles[i], nullptr, runStressThread, &threads[i]);
+		size_t corruptCount = 0;
+		for(size_t i = 0; i < threadCount; i ++)
+		{
+			pthread_join(handles[i], nullptr);
+			corruptCount += threads[i].corruptCount;
+		}
+		for(size_t i = 0; i < threadCount; i ++)
+			pthread_mutex_destroy(&exchanges[i].lock);
+		pthread_barrier_destroy(&barrier);
+		check(corruptCount == 0, what, corruptCount, threadCount);
+	}
+
+	void testAllocatorThreads()
+	{
+		runStress(8, 40000, "allocator threads");
+		//more threads than allocator has cache slots(64), so some go to central pool directly. run last, as slots stay taken.
+		runStress(72, 2000, "allocator threads without cache slot");
+	}
+}
+
+int main()
+{
+	testCopyMemory();
+	testSetMemory();
+	testVectorAppend();
+	testStringAliasing();
+	testArenaSharing();
+	testBigBlock();
+	testAllocatorThreads();
+	if(failed)
+		return 1;
+	printf("ok\n");
+	return 0;
+}
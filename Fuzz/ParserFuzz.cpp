@@ -0,0 +1,311 @@
+#include "../Runtime/Image.h"
+#include "../Runtime/PEFormat.h"
+#include "../Runtime/Allocator.h"
+#include "../Util/DataSource.h"
+#include "../Util/Intrinsic.h"
+#include "../Benchmark/Benchmark.h"
+#include "../Benchmark/SyntheticPE.h"
+
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+
+//fuzz target for PEFormat and Image::unserialize. first input byte selects parser:
+//  0 PEFormat::load and toImage
+//  1 Image::unserialize on input as is, compressed stream with its size header
+//  2 Image::unserialize on input compressed first, so mutations reach metadata fields
+//each input has cycle and heap budgets linear in its size. exceeding one aborts, so a fuzzer keeps the input like a crash.
+//
+//with libfuzzer, from repository root:
+//  cc -g -O1 -c LZMA/LzmaDec.c LZMA/LzmaEnc.c LZMA/LzFind.c
+//  clang++ -g -O1 -std=c++11 -fsanitize=fuzzer -DPARSER_FUZZ_LIBFUZZER -o parserfuzz Fuzz/ParserFuzz.cpp Win32/Win32PosixPlatform.cpp Benchmark/SyntheticPE.cpp Runtime/Image.cpp Runtime/PEFormat.cpp Runtime/Allocator.cpp Win32/Win32File.cpp LzmaDec.o LzmaEnc.o LzFind.o
+//standalone, with any compiler: same sources without -fsanitize=fuzzer and the define.
+//  parserfuzz [-runs count] [-seed value] [input...]
+//it replays inputs if given, otherwise mutates synthetic PE files and serialized images. failing input is written to fuzz-failure.bin.
+
+namespace
+{
+	enum Target
+	{
+		TargetPE,
+		TargetImage,
+		TargetImageUncompressed,
+
+		TargetMax
+	};
+
+	struct Budget
+	{
+		uint64_t baseCycles;
+		uint64_t cyclesPerByte;
+		size_t baseHeap;
+		size_t heapPerByte;
+	};
+
+	//per byte budgets are generous constant factors over well formed inputs. only superlinear growth should cross them.
+	//compressed image may legitimately expand up to Image.cpp maxCompressionRatio times before parsing.
+	const Budget budgets[TargetMax] = {
+		{100000000, 4000, 1 << 20, 256}, //PE
+		{100000000, 4000 << 14, 1 << 20, 256 << 14}, //Image
+		{100000000, 4000, 1 << 20, 256}, //Image, uncompressed
+	};
+	const char *targetNames[TargetMax] = {"PE", "Image", "Image uncompressed"};
+
+	size_t lengthOf(const char *str)
+	{
+		size_t length = 0;
+		while(str[length])
+			length ++;
+		return length;
+	}
+
+	void parsePE(const uint8_t *data, size_t size)
+	{
+		PEFormat format;
+		if(!format.load(MakeShared<MemoryDataSource>(const_cast<uint8_t *>(data), size), false))
+			return;
+		Image image = format.toImage();
+	}
+
+	void parseImage(const uint8_t *data, size_t size)
+	{
+		if(!size)
+			return;
+		size_t processedSize;
+		Image image = Image::unserialize(MakeShared<MemoryDataSource>(const_cast<uint8_t *>(data), size)->getView(0, size), &processedSize);
+	}
+
+	//runs one input under budget. returns nullptr if within it, otherwise what was exceeded.
+	const char *runInput(const uint8_t *data, size_t size)
+	{
+		if(!size)
+			return nullptr;
+		Target target = static_cast<Target>(data[0] % TargetMax);
+		data ++;
+		size --;
+
+		Vector<uint8_t> compressed;
+		if(target == TargetImageUncompressed)
+		{
+			UniqueVector<uint8_t> uncompressed;
+			uncompressed.append(data, size);
+			compressed = Image::compress(uncompressed);
+		}
+
+		size_t heapBefore = getHeapSize();
+		resetPeakHeapSize();
+		uint64_t start = __rdtsc();
+		if(target == TargetPE)
+			parsePE(data, size);
+		else if(target == TargetImage)
+			parseImage(data, size);
+		else
+			parseImage(compressed.get(), compressed.size());
+		uint64_t cycles = __rdtsc() - start;
+		size_t heap = getPeakHeapSize() - heapBefore;
+
+		const Budget &budget = budgets[target];
+		if(cycles > budget.baseCycles + budget.cyclesPerByte * size)
+			return "cycle budget exceeded";
+		if(heap > budget.baseHeap + budget.heapPerByte * size)
+			return "heap budget exceeded";
+		return nullptr;
+	}
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	const char *failure = runInput(data, size);
+	if(failure)
+	{
+		::write(2, failure, lengthOf(failure));
+		abort();
+	}
+	return 0;
+}
+
+#ifndef PARSER_FUZZ_LIBFUZZER
+namespace
+{
+	const uint8_t *currentInput;
+	size_t currentInputSize;
+
+	void writeInput(const char *path, const uint8_t *data, size_t size)
+	{
+		int descriptor = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(descriptor < 0)
+			return;
+		::write(descriptor, data, size);
+		close(descriptor);
+	}
+
+	//input which crashed the parser is saved before dying, like libfuzzer does.
+	void crashHandler(int)
+	{
+		if(currentInput)
+			writeInput("fuzz-failure.bin", currentInput, currentInputSize);
+		const char message[] = "crashed, input written to fuzz-failure.bin\n";
+		::write(2, message, sizeof(message) - 1);
+		_exit(1);
+	}
+
+	bool readInput(const char *path, Vector<uint8_t> &result)
+	{
+		int descriptor = open(path, O_RDONLY);
+		if(descriptor < 0)
+			return false;
+		struct stat info;
+		bool success = fstat(descriptor, &info) == 0;
+		if(success)
+		{
+			result.resize(static_cast<size_t>(info.st_size));
+			success = !result.size() || read(descriptor, &result[0], result.size()) == static_cast<ssize_t>(result.size());
+		}
+		close(descriptor);
+		return success;
+	}
+
+	Vector<uint8_t> makeInput(Target target, const uint8_t *data, size_t size)
+	{
+		Vector<uint8_t> result;
+		uint8_t selector = static_cast<uint8_t>(target);
+		result.append(&selector, 1);
+		result.append(data, size);
+		return result;
+	}
+
+	//small PE32 and PE32+ files with every directory the parser reads, and their serialized images.
+	Vector<Vector<uint8_t>> makeSeeds()
+	{
+		Vector<Vector<uint8_t>> result;
+		ArchitectureType architectures[] = {ArchitectureWin32, ArchitectureWin32AMD64};
+		for(size_t i = 0; i < 2; i ++)
+		{
+			SyntheticPEOptions options;
+			options.architecture = architectures[i];
+			options.codeSize = 0x800;
+			options.dataSize = 0x400;
+			options.entropy = 64;
+			options.relocationCount = 64;
+			options.importLibraryCount = 3;
+			options.importFunctionCount = 8;
+			options.exportCount = 16;
+			options.seed = static_cast<uint32_t>(i + 1);
+			Vector<uint8_t> file = generateSyntheticPE(options);
+			result.push_back(makeInput(TargetPE, file.get(), file.size()));
+
+			PEFormat format;
+			format.load(file.asDataSource(), false);
+			Image image = format.toImage();
+			UniqueVector<uint8_t> uncompressed = image.serializeUncompressed();
+			Vector<uint8_t> compressed = Image::compress(uncompressed);
+			result.push_back(makeInput(TargetImage, compressed.get(), compressed.size()));
+			result.push_back(makeInput(TargetImageUncompressed, uncompressed.get(), uncompressed.size()));
+		}
+		return result;
+	}
+
+	//counts and offsets are what parsers trust, so word overwrites use boundary values.
+	void mutate(Vector<uint8_t> &input, uint32_t &random)
+	{
+		const uint32_t interesting[] = {0, 1, 0x7f, 0x80, 0xff, 0x7fff, 0x8000, 0xffff, 0x7fffffff, 0x80000000, 0xfffffffe, 0xffffffff};
+		size_t count = 1 + nextRandom(random) % 8;
+		for(size_t i = 0; i < count && input.size() > 1; i ++)
+		{
+			//first 0x400 bytes hold PE headers and most metadata of small images, so half the mutations land there.
+			size_t range = input.size() - 1;
+			if(range > 0x400 && nextRandom(random) % 2)
+				range = 0x400;
+			size_t offset = 1 + nextRandom(random) % range;
+			switch(nextRandom(random) % 4)
+			{
+			case 0:
+				input[offset] ^= static_cast<uint8_t>(1 << (nextRandom(random) % 8));
+				break;
+			case 1:
+				input[offset] = static_cast<uint8_t>(nextRandom(random));
+				break;
+			case 2:
+				if(offset + sizeof(uint32_t) <= input.size())
+				{
+					uint32_t value = interesting[nextRandom(random) % (sizeof(interesting) / sizeof(interesting[0]))];
+					copyMemory(&input[offset], &value, sizeof(value));
+				}
+				break;
+			case 3:
+				input.resize(offset + 1); //truncate
+				break;
+			}
+		}
+	}
+
+	bool check(const Vector<uint8_t> &input)
+	{
+		currentInput = input.get();
+		currentInputSize = input.size();
+		const char *failure = runInput(input.get(), input.size());
+		currentInput = nullptr;
+		if(!failure)
+			return true;
+		writeInput("fuzz-failure.bin", input.get(), input.size());
+		String message = String(targetNames[input[0] % TargetMax]) + ": " + failure + ", input written to fuzz-failure.bin\n";
+		::write(2, message.c_str(), message.length());
+		return false;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	size_t runs = 100000;
+	uint32_t random = 0x12345678;
+	List<String> inputs;
+	for(int i = 1; i < argc; i ++)
+	{
+		String argument(argv[i]);
+		if(argument == "-runs" && i + 1 < argc)
+			runs = static_cast<size_t>(StringToInt(String(argv[++ i])));
+		else if(argument == "-seed" && i + 1 < argc)
+			random = static_cast<uint32_t>(StringToInt(String(argv[++ i]))) | 1;
+		else
+			inputs.push_back(argument);
+	}
+
+	signal(SIGSEGV, crashHandler);
+	signal(SIGBUS, crashHandler);
+	signal(SIGFPE, crashHandler);
+
+	if(inputs.size())
+	{
+		for(auto &i : inputs)
+		{
+			Vector<uint8_t> input;
+			if(!readInput(i.c_str(), input))
+			{
+				String message = String("can't read ") + i + "\n";
+				::write(2, message.c_str(), message.length());
+				return 1;
+			}
+			if(!check(input))
+				return 1;
+		}
+		return 0;
+	}
+
+	Vector<Vector<uint8_t>> seeds = makeSeeds();
+	for(auto &i : seeds)
+		if(!check(i))
+			return 1;
+	for(size_t i = 0; i < runs; i ++)
+	{
+		Vector<uint8_t> input(seeds[i % seeds.size()].get(), seeds[i % seeds.size()].get() + seeds[i % seeds.size()].size());
+		mutate(input, random);
+		if(!check(input))
+			return 1;
+	}
+	String message = IntToString(runs) + " inputs within budget\n";
+	::write(1, message.c_str(), message.length());
+	return 0;
+}
+#endif
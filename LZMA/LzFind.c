@@ -4,7 +4,11 @@
 #include "LzFind.h"
 #include "LzHash.h"
 
+#ifdef _MSC_VER
 void *__cdecl memmove(void *dst, const void *src, size_t size); //XXX dlunch: remove string.h inclusion
+#else
+#include <string.h>
+#endif
 
 #define kEmptyHashValue 0
 #define kMaxValForNormalize ((UInt32)0xFFFFFFFF)
@@ -80,8 +80,10 @@ UInt32 LzmaEncProps_GetDictSize(const CLzmaEncProps *props2)
   return props.dictSize;
 }
 
+#ifdef _MSC_VER
 #define LZMA_LOG_BSR
 /* Define it for Intel's CPU */
+#endif
 
 
 #ifdef LZMA_LOG_BSR
@@ -0,0 +1,658 @@
+#include "../Benchmark/Benchmark.h"
+#include "../Runtime/Image.h"
+#include "../Runtime/PEFormat.h"
+#include "../Runtime/File.h"
+#include "../Runtime/Allocator.h"
+#include "../Util/List.h"
+#include "../Util/HashMap.h"
+#include "../Win32/Win32SysCall.h"
+#include "../Win32/Win32ImageLoader.h"
+#include "../Win32/Stub/Win32Stub.h"
+#include "../Benchmark/SyntheticPE.h"
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//measures time from packed payload to entry point on linux, following Stage2 Execute and Win32Loader.
+//it models stage2 source of this tree, not the stub compiled into StubData.h, so its results, -stream included, apply to
+//packed output only once StubData.h is regenerated.
+//stages: decrypt, unserialize(main and imports), map, relocate, bind, protect. entry points are not run.
+//map, relocate, bind and protect are Win32ImageLoader functions Win32Loader runs, on the posix system caller.
+//only system libraries are stubbed: generated dlls exporting what payload imports, with stamps of its prebound imports,
+//are placed in memory before timing. api sets resolve to kernelbase.dll. bind parses them like Win32Loader parses mapped ones.
+//
+//build from repository root:
+//  cc -O2 -c LZMA/LzmaDec.c LZMA/LzmaEnc.c LZMA/LzFind.c
+//  c++ -O2 -std=c++11 -pthread -o loaderbenchmark LoaderBenchmark/LoaderBenchmark.cpp Win32/Win32PosixPlatform.cpp Win32/Win32ImageLoader.cpp Benchmark/Benchmark.cpp Benchmark/SyntheticPE.cpp Runtime/Image.cpp Runtime/PEFormat.cpp Runtime/Keystream.cpp Runtime/Allocator.cpp Win32/Win32File.cpp LzmaDec.o LzmaEnc.o LzFind.o
+//usage:
+//  loaderbenchmark [-n repeat] [-o output] [-baseline result] [-threads count] [-stream] packed.exe
+//  loaderbenchmark [-n repeat] [-o output] [-baseline result] [-threads count] [-stream] [-cipher chain|keystream] -main mainData [-imp impData]
+//blobs are mainData and impData of PackerMain::outputPE before encryption. they are encrypted once on load, so decrypt stage is measured as well.
+//-threads splits keystream decryption into ranges decrypted in parallel. chain cipher always runs on one thread.
+//-stream decrypts while decoding through Win32StubPayloadStream like Stage2 does, so decrypt stage is empty and its time moves to unserialize.
+//loader/payload traffic bytes counts payload reads and writes outside cache in decrypt and unserialize stages: copying,
+//decrypting in place and decoding touch it 5 times, streaming reads it once as its blocks stay in cache.
+//chain cipher payload is copied and decrypted whole even with -stream.
+//packed.exe must embed a stub of this tree's WIN32_STUB_FORMAT, which means StubData.h regenerated from this stage2.
+//payload is decoded once before timing, and input that doesn't decode, like output of an older stub format, is rejected.
+
+namespace
+{
+	const uint32_t blobSeed = 0x5eed5eed;
+	const size_t maxThreads = 64;
+
+	//data is encrypted part of a section, without Win32StubPayloadHeader.
+	struct Payload
+	{
+		Vector<uint8_t> mainData;
+		uint32_t mainSeed;
+		uint32_t mainCipher;
+		Vector<uint8_t> impData; //empty if packed without imports
+		uint32_t impSeed;
+		uint32_t impCipher;
+	};
+
+	enum Stage
+	{
+		StageDecrypt,
+		StageUnserialize,
+		StageMap,
+		StageRelocate,
+		StageBind,
+		StageProtect,
+		StageTotal,
+
+		StageMax
+	};
+
+	const char *stageNames[StageMax] = {"loader/decrypt", "loader/unserialize", "loader/map", "loader/relocate", "loader/bind", "loader/protect", "loader/total"};
+
+	//File has no size query, so blobs are read with posix calls.
+	bool readFile(const String &path, Vector<uint8_t> &result)
+	{
+		int descriptor = open(path.c_str(), O_RDONLY);
+		if(descriptor < 0)
+			return false;
+		struct stat info;
+		bool success = fstat(descriptor, &info) == 0 && info.st_size > 0;
+		if(success)
+		{
+			result.resize(static_cast<size_t>(info.st_size));
+			success = read(descriptor, &result[0], result.size()) == static_cast<ssize_t>(result.size());
+		}
+		close(descriptor);
+		return success;
+	}
+
+	bool readPayloadSection(const Section &section, Vector<uint8_t> &data, uint32_t &seed, uint32_t &cipher)
+	{
+		if(section.data->size() < sizeof(Win32StubPayloadHeader))
+			return false;
+		const Win32StubPayloadHeader *header = reinterpret_cast<const Win32StubPayloadHeader *>(section.data->get());
+		if(header->size > section.data->size() - sizeof(Win32StubPayloadHeader) || header->cipher > WIN32_STUB_CIPHER_KEYSTREAM)
+			return false;
+		data.assign(section.data->get() + sizeof(Win32StubPayloadHeader), header->size);
+		seed = *reinterpret_cast<const uint32_t *>(section.name.c_str());
+		cipher = header->cipher;
+		return true;
+	}
+
+	//same section layout Stage2 Entry expects: 4th section is main image, 5th is imports. seed is the section name.
+	bool loadPacked(const String &path, Payload &payload)
+	{
+		if(!File::isPathExists(path))
+			return false;
+		PEFormat format;
+		if(!format.load(File::open(path), false))
+			return false;
+		const Vector<Section> &sections = format.getSections();
+		if(sections.size() < 5)
+			return false;
+		return readPayloadSection(sections[3], payload.mainData, payload.mainSeed, payload.mainCipher) &&
+			readPayloadSection(sections[4], payload.impData, payload.impSeed, payload.impCipher);
+	}
+
+	bool loadBlobs(const String &mainPath, const String &impPath, uint32_t cipher, Payload &payload)
+	{
+		if(!readFile(mainPath, payload.mainData))
+			return false;
+		payload.mainSeed = blobSeed;
+		payload.mainCipher = cipher;
+		cryptPayload(cipher, payload.mainSeed, &payload.mainData[0], payload.mainData.size());
+		payload.impSeed = blobSeed;
+		payload.impCipher = cipher;
+		if(impPath.length())
+		{
+			if(!readFile(impPath, payload.impData))
+				return false;
+			cryptPayload(cipher, payload.impSeed, &payload.impData[0], payload.impData.size());
+		}
+		return true;
+	}
+
+	struct DecryptRange
+	{
+		uint32_t seed;
+		size_t offset;
+		uint8_t *data;
+		size_t size;
+	};
+
+	void *decryptRange(void *argument)
+	{
+		DecryptRange *range = reinterpret_cast<DecryptRange *>(argument);
+		keystreamCrypt(range->seed, range->offset, range->data + range->offset, range->size);
+		return nullptr;
+	}
+
+	//keystream payload is split into block aligned ranges, one per thread. calling thread takes first one.
+	bool decryptParallel(uint32_t cipher, uint32_t seed, uint8_t *data, size_t size, size_t threads)
+	{
+		if(cipher != WIN32_STUB_CIPHER_KEYSTREAM || threads < 2)
+			return decryptPayload(cipher, seed, data, size);
+
+		DecryptRange ranges[maxThreads];
+		pthread_t handles[maxThreads];
+		size_t rangeSize = multipleOf((size + threads - 1) / threads, 64);
+		size_t count = 0;
+		for(size_t offset = 0; offset < size; offset += rangeSize, count ++)
+		{
+			ranges[count].seed = seed;
+			ranges[count].offset = offset;
+			ranges[count].data = data;
+			ranges[count].size = size - offset < rangeSize ? size - offset : rangeSize;
+		}
+		for(size_t i = 1; i < count; i ++)
+			pthread_create(&handles[i], nullptr, decryptRange, &ranges[i]);
+		decryptRange(&ranges[0]);
+		for(size_t i = 1; i < count; i ++)
+			pthread_join(handles[i], nullptr);
+		return true;
+	}
+
+	//generated stand-ins for system libraries payload imports, at 64k aligned bases like the system loader's.
+	class SystemLibraries
+	{
+	private:
+		struct Exports
+		{
+			Exports() : timeStamp(0), checkSum(0) {}
+			Vector<String> names;
+			HashSet<uint32_t> nameHashes;
+			Vector<uint16_t> ordinals;
+			uint32_t timeStamp;
+			uint32_t checkSum;
+		};
+
+		HashMap<String, uint64_t, CaseInsensitiveStringHasher<String>> bases_;
+		Vector<String> apiSets_; //contract names, as api set schema has them
+
+		static bool isBundled(const String &normalizedFilename, const List<Image> &bundledImages)
+		{
+			for(auto &i : bundledImages)
+				if(i.fileName.icompare(normalizedFilename) == 0)
+					return true;
+			return false;
+		}
+
+		//api set contracts are hosted by kernelbase.dll. returns exports function is added to, or null if library is bundled.
+		Exports *getExports(HashMap<String, Exports, CaseInsensitiveStringHasher<String>> &libraries, const String &libraryName, const List<Image> &bundledImages)
+		{
+			String normalizedFilename = Win32ImportResolver::normalizeLibraryName(libraryName);
+			if(isBundled(normalizedFilename, bundledImages))
+				return nullptr;
+			StringView prefix = normalizedFilename.view(0, 4);
+			if(prefix.icompare("api-") == 0 || prefix.icompare("ext-") == 0)
+			{
+				size_t length = normalizedFilename.length() - 4;
+				if(length > 4 && normalizedFilename.view(normalizedFilename.length() - 4).icompare(".dll") == 0)
+					length -= 4;
+				apiSets_.push_back(normalizedFilename.substr(4, static_cast<int>(length)));
+				return &libraries["kernelbase.dll"];
+			}
+			return &libraries[normalizedFilename];
+		}
+
+		static void addFunction(Exports &exports, const String &name, int32_t ordinal)
+		{
+			if(name.length())
+			{
+				if(exports.nameHashes.insert(fnv1a(name.c_str(), name.length())))
+					exports.names.push_back(name);
+			}
+			else if(ordinal >= 0)
+				exports.ordinals.push_back(static_cast<uint16_t>(ordinal));
+		}
+
+		void collect(HashMap<String, Exports, CaseInsensitiveStringHasher<String>> &libraries, const Image &image, const List<Image> &bundledImages)
+		{
+			for(auto &i : image.imports)
+			{
+				if(i.bindImage >= 0)
+					continue;
+				Exports *exports = getExports(libraries, i.libraryName, bundledImages);
+				if(!exports)
+					continue;
+				if(i.timeStamp || i.checkSum)
+				{
+					exports->timeStamp = i.timeStamp;
+					exports->checkSum = i.checkSum;
+				}
+				for(auto &j : i.functions)
+					addFunction(*exports, j.name, j.name.length() ? -1 : j.ordinal);
+			}
+			for(auto &i : image.exports)
+			{
+				if(!i.forwardLibrary.length())
+					continue;
+				Exports *exports = getExports(libraries, i.forwardLibrary, bundledImages);
+				if(exports)
+					addFunction(*exports, i.forwardNameHash ? i.forward.substr(i.forward.find('.') + 1) : String(), i.forwardOrdinal);
+			}
+		}
+	public:
+		~SystemLibraries()
+		{
+			for(auto &i : bases_)
+				free(reinterpret_cast<void *>(i.value));
+		}
+
+		//from imports of every image and forwarders of bundled ones.
+		void generate(const Image &mainImage, const List<Image> &bundledImages)
+		{
+			HashMap<String, Exports, CaseInsensitiveStringHasher<String>> libraries;
+			collect(libraries, mainImage, bundledImages);
+			for(auto &i : bundledImages)
+				collect(libraries, i, bundledImages);
+
+			for(auto &i : libraries)
+			{
+				Vector<uint8_t> library = generateSyntheticLibrary(mainImage.info.architecture, i.key, i.value.names, i.value.ordinals, i.value.timeStamp, i.value.checkSum);
+				void *memory = nullptr;
+				if(posix_memalign(&memory, 0x10000, library.size()) != 0)
+					continue;
+				copyMemory(reinterpret_cast<uint8_t *>(memory), library.get(), library.size());
+				bases_.insert(i.key, reinterpret_cast<uint64_t>(memory));
+			}
+		}
+
+		uint64_t find(const String &normalizedFilename) const
+		{
+			auto it = bases_.find(normalizedFilename);
+			if(it == bases_.end())
+				return 0;
+			return it->value;
+		}
+
+		const Vector<String> &getApiSets() const
+		{
+			return apiSets_;
+		}
+	};
+
+	//Win32Loader's import resolution with system libraries looked up in SystemLibraries. bundled images are mapped
+	//before bind, so they are only looked up by index or name.
+	class BenchmarkResolver : public Win32ImportResolver
+	{
+	private:
+		const SystemLibraries &systemLibraries_;
+		const Vector<Image *> &images_; //main image first, then bundled images by bind index
+		const Vector<uint64_t> &bases_;
+		size_t missingCount_;
+	protected:
+		virtual uint64_t findSystemLibrary(const String &normalizedFilename)
+		{
+			return systemLibraries_.find(normalizedFilename);
+		}
+
+		virtual void loadApiSet()
+		{
+			for(auto &i : systemLibraries_.getApiSets())
+			{
+				Vector<String> hosts;
+				hosts.push_back("kernelbase.dll");
+				apiSetHosts_.insert(i, std::move(hosts));
+			}
+		}
+
+		virtual uint64_t loadBundledImage(int32_t index, bool asDataFile)
+		{
+			return bases_[index + 1];
+		}
+
+		virtual uint64_t loadOtherLibrary(const String &filename, bool asDataFile)
+		{
+			for(size_t i = 1; i < images_.size(); i ++)
+				if(images_[i]->fileName.icompare(filename) == 0)
+					return bases_[i];
+			return 0;
+		}
+
+		virtual uint64_t getProxyFunction(const Image &image, uint32_t functionNameHash)
+		{
+			return 0;
+		}
+
+		virtual void onLibraryNotFound(const String &libraryName)
+		{
+			missingCount_ ++;
+		}
+	public:
+		BenchmarkResolver(const SystemLibraries &systemLibraries, const Vector<Image *> &images, const Vector<uint64_t> &bases) :
+			systemLibraries_(systemLibraries), images_(images), bases_(bases), missingCount_(0) {}
+
+		size_t getMissingCount() const
+		{
+			return missingCount_;
+		}
+	};
+
+	class LoaderRun
+	{
+	private:
+		const Payload &payload_;
+		size_t threads_;
+		bool stream_;
+		Vector<uint8_t> mainData_;
+		Vector<uint8_t> impData_;
+		Image mainImage_;
+		List<Image> importImages_;
+		Vector<Image *> images_; //main image first, then bundled images by bind index
+		Vector<uint64_t> bases_;
+		BenchmarkResolver resolver_;
+	public:
+		LoaderRun(const Payload &payload, const SystemLibraries &systemLibraries, size_t threads, bool stream) :
+			payload_(payload), threads_(threads), stream_(stream), resolver_(systemLibraries, images_, bases_) {}
+
+		~LoaderRun()
+		{
+			for(auto &i : bases_)
+				if(i)
+					Win32SystemCaller::get()->freeVirtual(reinterpret_cast<void *>(i));
+		}
+
+		void decrypt()
+		{
+			if(stream_)
+				return;
+			mainData_.assign(payload_.mainData.get(), payload_.mainData.size());
+			decryptParallel(payload_.mainCipher, payload_.mainSeed, &mainData_[0], mainData_.size(), threads_);
+			if(payload_.impData.size())
+			{
+				impData_.assign(payload_.impData.get(), payload_.impData.size());
+				decryptParallel(payload_.impCipher, payload_.impSeed, &impData_[0], impData_.size(), threads_);
+			}
+		}
+
+		void unserialize()
+		{
+			if(stream_)
+				unserializeStream();
+			else
+				unserializeCopy();
+
+			//bundled images are mapped eagerly. packer only bundles images something imports.
+			images_.push_back(&mainImage_);
+			for(auto &i : importImages_)
+				images_.push_back(&i);
+			bases_.resize(images_.size());
+		}
+
+		void unserializeStream()
+		{
+			Win32StubPayloadStream mainStream(payload_.mainCipher, payload_.mainSeed, payload_.mainData.get(), payload_.mainData.size());
+			mainImage_ = Image::unserialize(mainStream.get(), nullptr);
+			if(payload_.impData.size())
+			{
+				Win32StubPayloadStream impStream(payload_.impCipher, payload_.impSeed, payload_.impData.get(), payload_.impData.size());
+				uint32_t count = 0;
+				impStream.read(&count, sizeof(count));
+				for(size_t j = 0; j < count; ++ j)
+					importImages_.push_back(Image::unserialize(impStream.get(), nullptr));
+			}
+		}
+
+		void unserializeCopy()
+		{
+			mainImage_ = Image::unserialize(MakeShared<MemoryDataSource>(&mainData_[0])->getView(0), nullptr);
+			if(impData_.size())
+			{
+				SharedPtr<MemoryDataSource> impDataSource = MakeShared<MemoryDataSource>(&impData_[0]);
+				uint32_t count = *reinterpret_cast<uint32_t *>(&impData_[0]);
+				size_t off = sizeof(count);
+				size_t size = 0;
+				for(size_t j = 0; j < count; ++ j)
+				{
+					importImages_.push_back(Image::unserialize(impDataSource->getView(off), &size));
+					off += size;
+				}
+			}
+		}
+
+		void mapAll()
+		{
+			for(size_t i = 0; i < images_.size(); i ++)
+			{
+				bases_[i] = mapImage(Win32SystemCaller::get(), *images_[i]);
+				resolver_.addLoadedImage(bases_[i], images_[i]);
+			}
+		}
+
+		void relocateAll()
+		{
+			for(size_t i = 0; i < images_.size(); i ++)
+				relocateImage(bases_[i], *images_[i]);
+		}
+
+		void bindAll()
+		{
+			for(size_t i = 0; i < images_.size(); i ++)
+				resolver_.bindImports(bases_[i], *images_[i]);
+		}
+
+		void protectAll()
+		{
+			for(size_t i = 0; i < images_.size(); i ++)
+				protectImage(Win32SystemCaller::get(), bases_[i], *images_[i]);
+		}
+
+		//unserialize gives empty images if payload is corrupt, or in another layout than this tree's.
+		bool isDecoded() const
+		{
+			if(!mainImage_.header.get())
+				return false;
+			for(auto &i : importImages_)
+				if(!i.header.get())
+					return false;
+			return true;
+		}
+
+		//every library found and every import address table entry filled.
+		bool isBound() const
+		{
+			if(resolver_.getMissingCount())
+				return false;
+			for(size_t i = 0; i < images_.size(); i ++)
+				for(auto &j : images_[i]->imports)
+					for(auto &k : j.functions)
+					{
+						uint64_t address = bases_[i] + k.iat;
+						if(images_[i]->info.architecture == ArchitectureWin32 ? !*reinterpret_cast<uint32_t *>(address) : !*reinterpret_cast<uint64_t *>(address))
+							return false;
+					}
+			return true;
+		}
+
+		const Image &getMainImage() const
+		{
+			return mainImage_;
+		}
+
+		const List<Image> &getImportImages() const
+		{
+			return importImages_;
+		}
+
+		uint64_t getMappedSize() const
+		{
+			uint64_t result = 0;
+			for(auto &i : images_)
+				result += i->info.size;
+			return result;
+		}
+	};
+
+	uint64_t getPayloadTraffic(size_t size, uint32_t cipher, bool stream)
+	{
+		return static_cast<uint64_t>(size) * (stream && cipher == WIN32_STUB_CIPHER_KEYSTREAM ? 1 : 5);
+	}
+
+	uint64_t getPeakResidentSize()
+	{
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		return static_cast<uint64_t>(usage.ru_maxrss) * 1024; //kilobytes on linux
+	}
+
+	void printUsage()
+	{
+		const char usage[] = "usage: loaderbenchmark [-n repeat] [-o output] [-baseline result] [-threads count] [-stream] (packed.exe | [-cipher chain|keystream] -main mainData [-imp impData])\n";
+		::write(2, usage, sizeof(usage) - 1);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	Payload payload;
+	String inputPath, mainPath, impPath, outputPath, baselinePath;
+	size_t repeat = 21;
+	size_t threads = 1;
+	bool stream = false;
+	uint32_t cipher = WIN32_STUB_CIPHER_KEYSTREAM;
+	for(int i = 1; i < argc; i ++)
+	{
+		String argument(argv[i]);
+		bool hasValue = i + 1 < argc;
+		if(argument == "-n" && hasValue)
+			repeat = static_cast<size_t>(StringToInt(String(argv[++ i])));
+		else if(argument == "-o" && hasValue)
+			outputPath = argv[++ i];
+		else if(argument == "-baseline" && hasValue)
+			baselinePath = argv[++ i];
+		else if(argument == "-threads" && hasValue)
+			threads = static_cast<size_t>(StringToInt(String(argv[++ i])));
+		else if(argument == "-stream")
+			stream = true;
+		else if(argument == "-cipher" && hasValue)
+			cipher = String(argv[++ i]) == "chain" ? WIN32_STUB_CIPHER_CHAIN : WIN32_STUB_CIPHER_KEYSTREAM;
+		else if(argument == "-main" && hasValue)
+			mainPath = argv[++ i];
+		else if(argument == "-imp" && hasValue)
+			impPath = argv[++ i];
+		else
+			inputPath = argument;
+	}
+	if(!repeat || !threads || threads > maxThreads || (!inputPath.length() && !mainPath.length()))
+	{
+		printUsage();
+		return 1;
+	}
+
+	if(mainPath.length() ? !loadBlobs(mainPath, impPath, cipher, payload) : !loadPacked(inputPath, payload))
+	{
+		const char message[] = "can't read input, or it is not a packed PE file\n";
+		::write(2, message, sizeof(message) - 1);
+		return 1;
+	}
+
+	SystemLibraries systemLibraries;
+	{
+		LoaderRun run(payload, systemLibraries, threads, stream);
+		run.decrypt();
+		run.unserialize();
+		if(!run.isDecoded())
+		{
+			const char message[] = "payload doesn't decode, input must be packed with stub of this tree's format\n";
+			::write(2, message, sizeof(message) - 1);
+			return 1;
+		}
+		systemLibraries.generate(run.getMainImage(), run.getImportImages());
+		run.mapAll();
+		run.relocateAll();
+		run.bindAll();
+		if(!run.isBound())
+		{
+			const char message[] = "imports of payload don't resolve against generated system libraries\n";
+			::write(2, message, sizeof(message) - 1);
+			return 1;
+		}
+	}
+
+	BenchmarkRunner runner(repeat);
+	if(baselinePath.length())
+	{
+		//file has no size, mapped view is zero filled past end of file.
+		SharedPtr<File> baseline = File::open(baselinePath);
+		SharedPtr<DataView> view = baseline->getView(0, 0);
+		runner.loadBaseline(reinterpret_cast<const char *>(view->get()));
+	}
+
+	Vector<uint64_t> samples[StageMax];
+	for(size_t i = 0; i < StageMax; i ++)
+		samples[i].reserve(repeat);
+	uint64_t mappedSize = 0;
+	uint64_t payloadSize = payload.mainData.size() + payload.impData.size();
+	size_t peakHeapSize = 0;
+	for(size_t i = 0; i < repeat; i ++)
+	{
+		resetPeakHeapSize();
+		uint64_t times[StageMax + 1];
+		{
+			LoaderRun run(payload, systemLibraries, threads, stream);
+			times[0] = __rdtsc();
+			run.decrypt();
+			times[1] = __rdtsc();
+			run.unserialize();
+			times[2] = __rdtsc();
+			run.mapAll();
+			times[3] = __rdtsc();
+			run.relocateAll();
+			times[4] = __rdtsc();
+			run.bindAll();
+			times[5] = __rdtsc();
+			run.protectAll();
+			times[6] = __rdtsc();
+			mappedSize = run.getMappedSize();
+		}
+		for(size_t j = 0; j < StageTotal; j ++)
+			samples[j].push_back(times[j + 1] - times[j]);
+		samples[StageTotal].push_back(times[StageTotal] - times[0]);
+		if(getPeakHeapSize() > peakHeapSize)
+			peakHeapSize = getPeakHeapSize();
+	}
+
+	runner.addResult(stageNames[StageDecrypt], samples[StageDecrypt], payloadSize);
+	runner.addResult(stageNames[StageUnserialize], samples[StageUnserialize], payloadSize);
+	runner.addResult(stageNames[StageMap], samples[StageMap], mappedSize);
+	runner.addResult(stageNames[StageRelocate], samples[StageRelocate], 0);
+	runner.addResult(stageNames[StageBind], samples[StageBind], 0);
+	runner.addResult(stageNames[StageProtect], samples[StageProtect], 0);
+	runner.addResult(stageNames[StageTotal], samples[StageTotal], payloadSize);
+	runner.addValue("loader/payload traffic bytes", getPayloadTraffic(payload.mainData.size(), payload.mainCipher, stream) + getPayloadTraffic(payload.impData.size(), payload.impCipher, stream));
+	runner.addValue("loader/peak heap bytes", peakHeapSize);
+	runner.addValue("loader/peak rss bytes", getPeakResidentSize());
+
+	String result = runner.getResult();
+	if(outputPath.length())
+	{
+		SharedPtr<File> output = File::open(outputPath, true);
+		output->write(result.c_str(), result.length());
+	}
+	else
+		::write(1, result.c_str(), result.length());
+	return 0;
+}
@@ -0,0 +1,304 @@
+#include "PackReport.h"
+
+#include "../Runtime/Allocator.h"
+#include "../Win32/Win32NativeHelper.h"
+#include "../Util/Util.h"
+#include "../LZMA/LzmaEnc.h"
+
+#include <intrin.h>
+
+//divides 16 bits at a time like IntToString, so x86 doesn't need 64-bit division helpers. divisor must fit in 16 bits.
+static uint64_t divideSmall(uint64_t value, uint32_t divisor)
+{
+	uint64_t result = 0;
+	uint32_t remainder = 0;
+	for(int shift = 48; shift >= 0; shift -= 16)
+	{
+		uint32_t current = (remainder << 16) | (static_cast<uint32_t>(value >> shift) & 0xffff);
+		result = (result << 16) | (current / divisor);
+		remainder = current % divisor;
+	}
+	return result;
+}
+
+static void appendJSONString(String &result, const String &value)
+{
+	result.append("\"");
+	for(size_t i = 0; i < value.length(); i ++)
+	{
+		char c = value.at(i);
+		if(c == '"' || c == '\\')
+			result.append("\\");
+		if(static_cast<uint8_t>(c) < 0x20)
+			continue;
+		result.append(&c, 1);
+	}
+	result.append("\"");
+}
+
+static void appendJSONNumber(String &result, const char *name, uint64_t value, bool last = false)
+{
+	result.append("\"");
+	result.append(name);
+	result.append("\": ");
+	result.append(IntToString(value));
+	if(!last)
+		result.append(", ");
+}
+
+PackReport::PackReport() : startTime_(Win32NativeHelper::get()->getInterruptTime()), startCycles_(__rdtsc())
+{
+	resetPeakHeapSize();
+}
+
+void PackReport::addPhase(const char *name, uint64_t wallTime, uint64_t cycles, uint64_t bytesIn, uint64_t bytesOut, size_t peakHeapSize)
+{
+	Phase *phase = nullptr;
+	for(auto &i : phases_)
+		if(i.name == name)
+			phase = &i;
+	if(!phase)
+	{
+		Phase item;
+		item.name = name;
+		item.count = 0;
+		item.wallTime = 0;
+		item.cycles = 0;
+		item.bytesIn = 0;
+		item.bytesOut = 0;
+		item.peakHeapSize = 0;
+		phase = phases_.push_back(std::move(item));
+	}
+
+	phase->count ++;
+	phase->wallTime += wallTime;
+	phase->cycles += cycles;
+	phase->bytesIn += bytesIn;
+	phase->bytesOut += bytesOut;
+	if(peakHeapSize > phase->peakHeapSize)
+		phase->peakHeapSize = peakHeapSize;
+}
+
+String PackReport::toJSON(const String &fileName) const
+{
+	size_t peakHeapSize = 0;
+	for(auto &i : phases_)
+		if(i.peakHeapSize > peakHeapSize)
+			peakHeapSize = i.peakHeapSize;
+
+	String result("{\n\t\"file\": ");
+	appendJSONString(result, fileName);
+	result.append(",\n\t");
+	appendJSONNumber(result, "wallTimeUs", divideSmall(Win32NativeHelper::get()->getInterruptTime() - startTime_, 10));
+	appendJSONNumber(result, "cpuCycles", __rdtsc() - startCycles_);
+	appendJSONNumber(result, "peakHeapBytes", peakHeapSize, true);
+	result.append(",\n\t\"phases\": [");
+	for(size_t i = 0; i < phases_.size(); i ++)
+	{
+		const Phase &phase = phases_[i];
+		result.append(i ? ",\n\t\t{" : "\n\t\t{");
+		result.append("\"name\": ");
+		appendJSONString(result, phase.name);
+		result.append(", ");
+		appendJSONNumber(result, "count", phase.count);
+		appendJSONNumber(result, "wallTimeUs", divideSmall(phase.wallTime, 10));
+		appendJSONNumber(result, "cpuCycles", phase.cycles);
+		appendJSONNumber(result, "bytesIn", phase.bytesIn);
+		appendJSONNumber(result, "bytesOut", phase.bytesOut);
+		appendJSONNumber(result, "peakHeapBytes", phase.peakHeapSize, true);
+		result.append("}");
+	}
+	result.append("\n\t]\n}\n");
+	return result;
+}
+
+ReportPhase::ReportPhase(PackReport &report, const char *name, uint64_t bytesIn) : report_(report), name_(name), bytesIn_(bytesIn), bytesOut_(0)
+#ifdef TRACE_EVENTS
+	, trace_(name)
+#endif
+{
+	resetPeakHeapSize();
+	startTime_ = Win32NativeHelper::get()->getInterruptTime();
+	startCycles_ = __rdtsc();
+}
+
+ReportPhase::~ReportPhase()
+{
+	uint64_t cycles = __rdtsc() - startCycles_;
+	uint64_t wallTime = Win32NativeHelper::get()->getInterruptTime() - startTime_;
+	report_.addPhase(name_, wallTime, cycles, bytesIn_, bytesOut_, getPeakHeapSize());
+}
+
+void ReportPhase::setBytesIn(uint64_t size)
+{
+	bytesIn_ = size;
+}
+
+void ReportPhase::setBytesOut(uint64_t size)
+{
+	bytesOut_ = size;
+}
+
+SizeReport::SizeReport() : stubSize_(0), mainDataSize_(0), impDataSize_(0), outputSize_(0)
+{
+}
+
+void SizeReport::addImage(const Image &image, const UniqueVector<uint8_t> &serialized, const Vector<SerializedPart> &parts, uint64_t compressedSize)
+{
+	//compress adds sizes and props before lzma stream.
+	const size_t compressHeaderSize = sizeof(uint32_t) * 2 + LZMA_PROPS_SIZE;
+	Stream stream;
+	stream.image = image.fileName;
+	stream.size = serialized.size();
+	stream.partsCompressedSize = 0;
+	stream.compressedSize = compressedSize;
+	for(auto &i : parts)
+	{
+		Part part;
+		part.image = image.fileName;
+		part.name = i.name;
+		part.size = i.size;
+		part.compressedSize = 0;
+		if(i.size)
+		{
+			UniqueVector<uint8_t> data;
+			data.append(serialized.get() + i.offset, i.size);
+			part.compressedSize = Image::compress(data).size() - compressHeaderSize;
+		}
+		stream.partsCompressedSize += part.compressedSize;
+		parts_.push_back(std::move(part));
+	}
+	streams_.push_back(std::move(stream));
+}
+
+void SizeReport::setOutput(uint64_t stubSize, uint64_t mainDataSize, uint64_t impDataSize, uint64_t outputSize)
+{
+	stubSize_ = stubSize;
+	mainDataSize_ = mainDataSize;
+	impDataSize_ = impDataSize;
+	outputSize_ = outputSize;
+
+	//everything but the two data sections: stub code, headers and alignment.
+	Part part;
+	part.name = "stub and headers";
+	part.size = stubSize;
+	part.compressedSize = outputSize - mainDataSize - impDataSize;
+	parts_.push_back(std::move(part));
+}
+
+Vector<const SizeReport::Part *> SizeReport::getSortedParts() const
+{
+	Vector<const Part *> result;
+	for(auto &i : parts_)
+		result.push_back(&i);
+	//part counts are small, insertion sort is enough.
+	for(size_t i = 1; i < result.size(); i ++)
+	{
+		const Part *item = result[i];
+		size_t j = i;
+		for(; j > 0 && result[j - 1]->compressedSize < item->compressedSize; j --)
+			result[j] = result[j - 1];
+		result[j] = item;
+	}
+	return result;
+}
+
+//share of output in percent with one decimal place.
+static String getShare(uint64_t size, uint64_t total)
+{
+	if(!total)
+		return String("-");
+	uint64_t permille = divide64(size * 1000, total);
+	uint64_t integer = divideSmall(permille, 10);
+	String result = IntToString(integer);
+	result.append(".");
+	result.append(IntToString(permille - integer * 10));
+	result.append("%");
+	return result;
+}
+
+String SizeReport::toTable() const
+{
+	String result("image\tpart\tbytes\tcompressed\tshare\n");
+	Vector<const Part *> parts = getSortedParts();
+	for(auto &i : parts)
+	{
+		result.append(i->image.length() ? i->image : String("-"));
+		result.append("\t");
+		result.append(i->name);
+		result.append("\t");
+		result.append(IntToString(i->size));
+		result.append("\t");
+		result.append(IntToString(i->compressedSize));
+		result.append("\t");
+		result.append(getShare(i->compressedSize, outputSize_));
+		result.append("\n");
+	}
+
+	result.append("\nimage\tbytes\tparts compressed\tstream compressed\tshare\n");
+	for(auto &i : streams_)
+	{
+		result.append(i.image);
+		result.append("\t");
+		result.append(IntToString(i.size));
+		result.append("\t");
+		result.append(IntToString(i.partsCompressedSize));
+		result.append("\t");
+		result.append(IntToString(i.compressedSize));
+		result.append("\t");
+		result.append(getShare(i.compressedSize, outputSize_));
+		result.append("\n");
+	}
+
+	result.append("\nmainData\t");
+	result.append(IntToString(mainDataSize_));
+	result.append("\nimpData\t");
+	result.append(IntToString(impDataSize_));
+	result.append("\nstub\t");
+	result.append(IntToString(stubSize_));
+	result.append("\noutput\t");
+	result.append(IntToString(outputSize_));
+	result.append("\n");
+	return result;
+}
+
+String SizeReport::toJSON() const
+{
+	String result("{\n\t");
+	appendJSONNumber(result, "outputBytes", outputSize_);
+	appendJSONNumber(result, "stubBytes", stubSize_);
+	appendJSONNumber(result, "mainDataBytes", mainDataSize_);
+	appendJSONNumber(result, "impDataBytes", impDataSize_, true);
+
+	result.append(",\n\t\"images\": [");
+	for(size_t i = 0; i < streams_.size(); i ++)
+	{
+		const Stream &stream = streams_[i];
+		result.append(i ? ",\n\t\t{" : "\n\t\t{");
+		result.append("\"name\": ");
+		appendJSONString(result, stream.image);
+		result.append(", ");
+		appendJSONNumber(result, "bytes", stream.size);
+		appendJSONNumber(result, "partsCompressedBytes", stream.partsCompressedSize);
+		appendJSONNumber(result, "compressedBytes", stream.compressedSize, true);
+		result.append("}");
+	}
+
+	result.append("\n\t],\n\t\"parts\": [");
+	Vector<const Part *> parts = getSortedParts();
+	for(size_t i = 0; i < parts.size(); i ++)
+	{
+		const Part *part = parts[i];
+		result.append(i ? ",\n\t\t{" : "\n\t\t{");
+		result.append("\"image\": ");
+		appendJSONString(result, part->image);
+		result.append(", \"name\": ");
+		appendJSONString(result, part->name);
+		result.append(", ");
+		appendJSONNumber(result, "bytes", part->size);
+		appendJSONNumber(result, "compressedBytes", part->compressedSize, true);
+		result.append("}");
+	}
+	result.append("\n\t]\n}\n");
+	return result;
+}
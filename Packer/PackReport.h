@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../Util/Vector.h"
+#include "../Util/UniqueVector.h"
+#include "../Util/String.h"
+#include "../Runtime/Trace.h"
+#include "../Runtime/Image.h"
+
+//time, data size and heap use of each packing phase. phases recorded more than once under same name are summed.
+//cpu time is measured in tsc cycles, as process times need a system call we don't have.
+class PackReport
+{
+private:
+	struct Phase
+	{
+		String name;
+		uint32_t count;
+		uint64_t wallTime; //100ns units
+		uint64_t cycles;
+		uint64_t bytesIn;
+		uint64_t bytesOut;
+		size_t peakHeapSize;
+	};
+	Vector<Phase> phases_;
+	uint64_t startTime_;
+	uint64_t startCycles_;
+public:
+	PackReport();
+
+	void addPhase(const char *name, uint64_t wallTime, uint64_t cycles, uint64_t bytesIn, uint64_t bytesOut, size_t peakHeapSize);
+	String toJSON(const String &fileName) const;
+};
+
+//records time and heap peak from construction to destruction as one phase. phases must not nest.
+//phases are trace events too, if tracing is compiled in.
+class ReportPhase
+{
+private:
+	PackReport &report_;
+	const char *name_;
+	uint64_t startTime_;
+	uint64_t startCycles_;
+	uint64_t bytesIn_;
+	uint64_t bytesOut_;
+#ifdef TRACE_EVENTS
+	TraceScope trace_;
+#endif
+
+	ReportPhase(const ReportPhase &);
+	const ReportPhase &operator =(const ReportPhase &);
+public:
+	ReportPhase(PackReport &report, const char *name, uint64_t bytesIn = 0);
+	~ReportPhase();
+
+	void setBytesIn(uint64_t size);
+	void setBytesOut(uint64_t size);
+};
+
+//bytes each part of each bundled image contributes to packed output, to find what to shrink first.
+//parts are compressed one by one to attribute size, so their sum is a bit larger than the real stream,
+//where all parts of an image share one dictionary. branch filter keeps size, so raw size is also filtered size.
+class SizeReport
+{
+private:
+	struct Part
+	{
+		String image;
+		String name;
+		uint64_t size;
+		uint64_t compressedSize;
+	};
+	struct Stream
+	{
+		String image;
+		uint64_t size;
+		uint64_t partsCompressedSize;
+		uint64_t compressedSize; //as stored in mainData or impData
+	};
+	Vector<Part> parts_;
+	Vector<Stream> streams_;
+	uint64_t stubSize_;
+	uint64_t mainDataSize_;
+	uint64_t impDataSize_;
+	uint64_t outputSize_;
+
+	Vector<const Part *> getSortedParts() const;
+public:
+	SizeReport();
+
+	void addImage(const Image &image, const UniqueVector<uint8_t> &serialized, const Vector<SerializedPart> &parts, uint64_t compressedSize);
+	void setOutput(uint64_t stubSize, uint64_t mainDataSize, uint64_t impDataSize, uint64_t outputSize);
+	String toTable() const; //tab separated, parts sorted by compressed size
+	String toJSON() const;
+};
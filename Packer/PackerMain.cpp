@@ -7,38 +7,95 @@
 #include "../Util/Vector.h"
 #include "../Runtime/Signature.h"
 #include "../Win32/Win32NativeHelper.h"
+#include "../Runtime/File.h"
+#include "../Runtime/Trace.h"
 
-PackerMain::PackerMain(const Option &option) : option_(option)
+#ifndef WIN32_STUB_DATA_FORMAT
+#define WIN32_STUB_DATA_FORMAT WIN32_STUB_FORMAT_BASE //StubData.h generated before Stubgen recorded the format
+#endif
+
+PackerMain::PackerMain(const Option &option) : option_(option), sizeReportEnabled_(option.getStringOption("sizereport").length() != 0)
 {
 }
 
 int PackerMain::process()
 {
-	processFile(option_.getInputFile(), option_.getOutputFile());
+#ifdef TRACE_EVENTS
+	String tracePath = option_.getStringOption("trace");
+	if(!tracePath.length())
+		tracePath = Win32NativeHelper::get()->getEnvironment("PACKER_TRACE");
+	if(tracePath.length())
+		startTrace(tracePath);
+#endif
+	{
+		TRACE_SCOPE("PackerMain::process");
+		processFile(option_.getInputFile(), option_.getOutputFile());
+		writeReport();
+		writeSizeReport();
+	}
+#ifdef TRACE_EVENTS
+	flushTrace();
+#endif
 
 	return 0;
 }
 
+void PackerMain::writeReport()
+{
+	String reportPath = option_.getStringOption("report");
+	if(!reportPath.length())
+		return;
+	SharedPtr<File> inputFile = option_.getInputFile();
+	String report = report_.toJSON(inputFile.get() ? inputFile->getFileName() : String());
+	File::open(reportPath, true)->write(report.c_str(), report.length());
+}
+
+//table to given path, json next to it.
+void PackerMain::writeSizeReport()
+{
+	if(!sizeReportEnabled_)
+		return;
+	String path = option_.getStringOption("sizereport");
+	String table = sizeReport_.toTable();
+	File::open(path, true)->write(table.c_str(), table.length());
+	String json = sizeReport_.toJSON();
+	File::open(path + ".json", true)->write(json.c_str(), json.length());
+}
+
+//newest image format embedded stub parses.
+static ImageFormat getStubImageFormat()
+{
+	if(WIN32_STUB_DATA_FORMAT >= WIN32_STUB_FORMAT_FORWARDER)
+		return ImageFormatForwarder;
+	if(WIN32_STUB_DATA_FORMAT >= WIN32_STUB_FORMAT_STAMP)
+		return ImageFormatStamp;
+	if(WIN32_STUB_DATA_FORMAT >= WIN32_STUB_FORMAT_BIND)
+		return ImageFormatBind;
+	return ImageFormatBase;
+}
+
+//header and raw section data, what serialize reads from.
+static uint64_t getImageDataSize(const Image &image)
+{
+	uint64_t size = image.header->size();
+	for(auto &i : image.sections)
+		size += i.data->size();
+	return size;
+}
+
 List<Image> PackerMain::loadImport(SharedPtr<FormatBase> input)
 {
 	List<Image> result;
 	for(auto &i : input->getImports())
 	{
-		bool alreadyLoaded = false;
 		String fileName = i.libraryName;
-		for(auto &j : loadedFiles_)
-			if(j == fileName)
-			{
-				alreadyLoaded = true;
-				break;
-			}
-		if(alreadyLoaded)
+		if(loadedFiles_.contains(fileName))
 			continue;
 
 		if(input->isSystemLibrary(fileName))
 			continue;
 		SharedPtr<FormatBase> import = FormatBase::loadImport(fileName, input->getInfo().architecture);
-		loadedFiles_.push_back(import->getFileName());
+		loadedFiles_.insert(import->getFileName());
 		result.push_back(import->toImage());
 
 		List<Image> dependencies = loadImport(import);
@@ -48,6 +105,102 @@ List<Image> PackerMain::loadImport(SharedPtr<FormatBase> input)
 	return result;
 }
 
+int32_t findBundledImage(const UniqueVector<const Image *> &bundled, const String &fileName)
+{
+	for(size_t i = 0; i < bundled.size(); i ++)
+		if(bundled[i]->fileName.icompare(fileName) == 0)
+			return static_cast<int32_t>(i);
+	return -1;
+}
+
+//follows export forwarders while they stay inside bundled images.
+bool resolveBundledExport(const UniqueVector<const Image *> &bundled, int32_t index, uint32_t nameHash, int ordinal, int32_t *resultImage, uint64_t *resultAddress)
+{
+	for(int depth = 0; depth < 16; depth ++)
+	{
+		const ExportFunction *item = nullptr;
+		for(auto &i : bundled[index]->exports)
+		{
+			if((nameHash != 0 && i.nameHash == nameHash) || (nameHash == 0 && ordinal == i.ordinal))
+			{
+				item = &i;
+				break;
+			}
+		}
+		if(item == nullptr)
+			return false;
+		if(!item->forward.length())
+		{
+			*resultImage = index;
+			*resultAddress = item->address;
+			return true;
+		}
+
+		index = findBundledImage(bundled, item->forwardLibrary);
+		if(index == -1)
+			return false; //forwarded to system library, resolved on load.
+		nameHash = item->forwardNameHash;
+		ordinal = item->forwardOrdinal;
+	}
+	return false;
+}
+
+void PackerMain::buildBindingPlan(Image &image, const UniqueVector<const Image *> &bundled)
+{
+	for(auto &i : image.imports)
+	{
+		i.bindImage = findBundledImage(bundled, i.libraryName);
+		if(i.bindImage == -1)
+			continue;
+		for(auto &j : i.functions)
+		{
+			if(!resolveBundledExport(bundled, i.bindImage, j.nameHash, j.ordinal, &j.bindImage, &j.bindAddress))
+			{
+				j.bindImage = ImportBindByName;
+				j.bindAddress = 0;
+			}
+		}
+	}
+}
+
+void PackerMain::prebindSystemImports(Image &image)
+{
+	for(auto &i : image.imports)
+	{
+		if(i.bindImage != ImportBindByName)
+			continue;
+		StringView prefix = i.libraryName.view(0, 4);
+		if(prefix.icompare("api-") == 0 || prefix.icompare("ext-") == 0)
+			continue; //host is chosen by api set schema on load.
+
+		auto it = systemLibraries_.find(i.libraryName);
+		if(it == systemLibraries_.end())
+			it = systemLibraries_.insert(i.libraryName, FormatBase::loadImport(i.libraryName, image.info.architecture));
+		SharedPtr<FormatBase> &library = it->value;
+		if(!library.get())
+			continue;
+
+		i.timeStamp = library->getInfo().timeStamp;
+		i.checkSum = library->getInfo().checkSum;
+		const UniqueVector<ExportFunction> &exports = library->getExports();
+		for(auto &j : i.functions)
+		{
+			for(auto &k : exports)
+			{
+				if((j.name.length() && k.nameHash == j.nameHash && k.name == j.name) || (!j.name.length() && j.ordinal == k.ordinal))
+				{
+					if(!k.forward.length()) //forwarders depend on another library's stamp.
+					{
+						j.bindImage = ImportBindSystem;
+						j.bindAddress = k.address;
+					}
+					break;
+				}
+			}
+		}
+	}
+}
+
 void PackerMain::processFile(SharedPtr<File> inputf, SharedPtr<File> output)
 {
 	SharedPtr<FormatBase> input;
@@ -59,30 +212,86 @@ void PackerMain::processFile(SharedPtr<File> inputf, SharedPtr<File> output)
 		else
 			return;
 	}
-	input->load(inputf, false);
+	{
+		ReportPhase phase(report_, "load");
+		input->load(inputf, false);
+		phase.setBytesIn(input->estimateSize());
+	}
 	input->setFileName(inputf->getFileName());
 	input->setFilePath(inputf->getFilePath());
-	loadedFiles_.push_back(input->getFileName());
-	List<Image> imports = loadImport(input);
-	
-	outputPE(input->toImage(), imports, output);
+	loadedFiles_.insert(input->getFileName());
+
+	List<Image> imports;
+	{
+		ReportPhase phase(report_, "loadImport");
+		imports = loadImport(input);
+		uint64_t size = 0;
+		for(auto &i : imports)
+			size += getImageDataSize(i);
+		phase.setBytesIn(size);
+	}
+
+	Image image;
+	{
+		ReportPhase phase(report_, "toImage");
+		image = input->toImage();
+		phase.setBytesIn(getImageDataSize(image));
+	}
+
+	//bindings are written only if embedded stub reads them, so older stub resolves everything by name.
+	if(getStubImageFormat() >= ImageFormatBind)
+	{
+		ReportPhase phase(report_, "bind");
+		//bundled images are unserialized in this order by the loader, so list position is the bind index.
+		UniqueVector<const Image *> bundled;
+		for(auto &i : imports)
+			bundled.push_back(&i);
+		buildBindingPlan(image, bundled);
+		for(auto &i : imports)
+			buildBindingPlan(i, bundled);
+	}
+
+	//stamps are what makes prebinding safe, so it's skipped if embedded stub can't read them.
+	if(option_.getBooleanOption("prebind") && getStubImageFormat() >= ImageFormatStamp)
+	{
+		ReportPhase phase(report_, "prebind");
+		prebindSystemImports(image);
+		for(auto &i : imports)
+			prebindSystemImports(i);
+	}
+
+	outputPE(image, imports, output);
 }
 
 void PackerMain::outputPE(Image &image, const List<Image> imports, SharedPtr<File> output)
 {
 	PEFormat resultFormat;
 	Vector<uint8_t> stub(win32StubSize);
-	simpleRLEDecompress(win32StubData, stub.get());
-	resultFormat.load(stub.asDataSource(), false);
+	{
+		ReportPhase phase(report_, "stub", sizeof(win32StubData));
+		simpleRLEDecompress(win32StubData, stub.get());
+		resultFormat.load(stub.asDataSource(), false);
+		phase.setBytesOut(stub.size());
+	}
 	
-	List<Section> resultSections(resultFormat.getSections());
+	Vector<Section> resultSections(resultFormat.getSections());
 	uint64_t lastAddress;
 	for(auto &i : resultSections)
 		lastAddress = i.baseAddress + i.size;
 
-	Vector<uint8_t> mainData(image.serialize());
+	//chain cipher is kept for comparison. keystream is default if embedded stub reads payload header, as it can decrypt
+	//keystream in any order. older stub decrypts whole section with chain cipher, whatever option says.
+	uint32_t cipher = WIN32_STUB_CIPHER_CHAIN;
+	if(WIN32_STUB_DATA_FORMAT >= WIN32_STUB_FORMAT_PAYLOAD_HEADER && option_.getStringOption("cipher") != "chain")
+		cipher = WIN32_STUB_CIPHER_KEYSTREAM;
+
+	Vector<uint8_t> mainData = serializeImage(image);
 	uint32_t seed = Win32NativeHelper::get()->getRandomValue();
-	simpleCrypt(seed, &mainData[0], mainData.size());
+	{
+		ReportPhase phase(report_, "crypt", mainData.size());
+		mainData = buildPayload(cipher, seed, mainData);
+		phase.setBytesOut(mainData.size());
+	}
 
 	Section mainSection;
 	mainSection.baseAddress = multipleOf(static_cast<size_t>(lastAddress), 0x1000);
@@ -98,9 +307,13 @@ void PackerMain::outputPE(Image &image, const List<Image> imports, SharedPtr<Fil
 	uint32_t impCount = imports.size();
 	impData.append(reinterpret_cast<uint8_t *>(&impCount), sizeof(impCount));
 	for(auto &i : imports)
-		impData.append(i.serialize());
+		impData.append(serializeImage(i));
 	seed = Win32NativeHelper::get()->getRandomValue();
-	simpleCrypt(seed, &impData[0], impData.size());
+	{
+		ReportPhase phase(report_, "crypt", impData.size());
+		impData = buildPayload(cipher, seed, impData);
+		phase.setBytesOut(impData.size());
+	}
 
 	Section importSection;
 	importSection.baseAddress = multipleOf(static_cast<size_t>(lastAddress), 0x1000);
@@ -112,6 +325,55 @@ void PackerMain::outputPE(Image &image, const List<Image> imports, SharedPtr<Fil
 
 	resultFormat.setSections(resultSections);
 
-	output->resize(resultFormat.estimateSize());
+	ReportPhase phase(report_, "save");
+	size_t outputSize = resultFormat.estimateSize();
+	output->resize(outputSize);
 	resultFormat.save(output);
+	phase.setBytesOut(outputSize);
+	if(sizeReportEnabled_)
+		sizeReport_.setOutput(stub.size(), mainData.size(), impData.size(), outputSize);
+}
+
+//header with cipher and size, then data encrypted with seed. header is left out if embedded stub predates it.
+Vector<uint8_t> PackerMain::buildPayload(uint32_t cipher, uint32_t seed, const Vector<uint8_t> &data)
+{
+	Vector<uint8_t> result;
+	size_t headerSize = 0;
+	if(WIN32_STUB_DATA_FORMAT >= WIN32_STUB_FORMAT_PAYLOAD_HEADER)
+	{
+		Win32StubPayloadHeader header;
+		header.cipher = cipher;
+		header.size = static_cast<uint32_t>(data.size());
+		headerSize = sizeof(header);
+		result.reserve(headerSize + data.size());
+		result.append(reinterpret_cast<const uint8_t *>(&header), headerSize);
+	}
+	result.append(data);
+	cryptPayload(cipher, seed, &result[headerSize], data.size());
+	return result;
+}
+
+//serialize with filtering and compression recorded as separate phases.
+Vector<uint8_t> PackerMain::serializeImage(const Image &image)
+{
+	UniqueVector<uint8_t> serialized;
+	Vector<SerializedPart> parts;
+	{
+		ReportPhase phase(report_, "serialize", getImageDataSize(image));
+		serialized = image.serializeUncompressed(sizeReportEnabled_ ? &parts : nullptr, getStubImageFormat());
+		phase.setBytesOut(serialized.size());
+	}
+
+	Vector<uint8_t> result;
+	{
+		ReportPhase phase(report_, "compress", serialized.size());
+		result = Image::compress(serialized);
+		phase.setBytesOut(result.size());
+	}
+	if(sizeReportEnabled_)
+	{
+		ReportPhase phase(report_, "sizeReport", serialized.size());
+		sizeReport_.addImage(image, serialized, parts, result.size());
+	}
+	return result;
 }
\ No newline at end of file
@@ -1,7 +1,11 @@
 #pragma once
 
 #include "../Runtime/Option.h"
+#include "PackReport.h"
 #include "../Util/List.h"
+#include "../Util/HashMap.h"
+#include "../Util/Vector.h"
+#include "../Util/UniqueVector.h"
 #include "../Util/SharedPtr.h"
 
 class File;
@@ -12,11 +16,21 @@ class PackerMain
 {
 private:
 	const Option &option_;
-	List<String> loadedFiles_;
+	PackReport report_;
+	SizeReport sizeReport_;
+	bool sizeReportEnabled_;
+	HashSet<String, CaseInsensitiveStringHasher<String>> loadedFiles_;
+	HashMap<String, SharedPtr<FormatBase>, CaseInsensitiveStringHasher<String>> systemLibraries_;
 
 	void outputPE(Image &image, const List<Image> imports, SharedPtr<File> output);
 	void processFile(SharedPtr<File> inputf, SharedPtr<File> output);
+	void writeReport();
+	void writeSizeReport();
+	Vector<uint8_t> serializeImage(const Image &image);
+	Vector<uint8_t> buildPayload(uint32_t cipher, uint32_t seed, const Vector<uint8_t> &data);
 	List<Image> loadImport(SharedPtr<FormatBase> input);
+	void buildBindingPlan(Image &image, const UniqueVector<const Image *> &bundled);
+	void prebindSystemImports(Image &image);
 public:
 	PackerMain(const Option &option);
 	int process();
@@ -1,6 +1,7 @@
 #include "PackerMain.h"
 #include "../Win32/Win32NativeHelper.h"
 #include "../Util/Util.h"
+#include "../Runtime/AllocatorStatistics.h"
 
 void WindowsEntry()
 {
@@ -9,4 +10,8 @@ void WindowsEntry()
 	List<String> arguments = Win32NativeHelper::get()->getArgumentList();
 
 	PackerMain(Option(arguments)).process();
+
+#ifdef ALLOCATOR_STATISTICS
+	writeAllocatorStatistics("packer_allocator.txt");
+#endif
 }
\ No newline at end of file
@@ -2,127 +2,598 @@
 
 #include "../Win32/Win32SysCall.h"
 #include "../Util/Util.h"
+#include "../Util/Intrinsic.h"
 
 #include <cstdint>
 
-#pragma pack(push, 1)
-struct MemoryInfo
+//every block starts with a header. tag is right before the returned pointer, so heapFree can tell
+//size class blocks, big heap blocks and arena blocks apart.
+struct BlockHeader
 {
-	unsigned int inUse : 1;
-#ifdef _WIN64
-	unsigned int bucketPtr : 63;
-#else
-	unsigned int bucketPtr : 31;
+#if UINTPTR_MAX > 0xffffffff
+	uint64_t reserved; //keeps payload 16 byte aligned
 #endif
+	uint32_t sizeClass;
+	uint32_t tag;
+};
+static_assert(sizeof(BlockHeader) == sizeof(void *) * 2, "payload must be aligned to two pointers");
+
+struct FreeBlock
+{
+	FreeBlock *next;
 };
-struct Bucket
+
+//central pool of one size class. each class has its own lock, so threads refilling different classes don't contend.
+struct SizeClass
 {
-	Bucket *nextBucket;
-	size_t usedCnt;
-	uint8_t *lastPtr;
-	uint8_t bucketData[1];
+	volatile long lock;
+	FreeBlock *freeList;
+	uint8_t *spanCurrent; //uncarved rest of last span
+	uint8_t *spanEnd;
 };
-#pragma pack(pop)
 
+#define BLOCK_TAG 0xa110c8ed
 #define BIGHEAP_TAG 0xdeadbeef
-#define BUCKET_COUNT 13
-const uint16_t bucketSizes[BUCKET_COUNT] = {4, 16, 32, 64, 128, 512, 1024, 2048, 4096, 8192, 16384, 32768, 0};
-Bucket *bucket[BUCKET_COUNT];
-const size_t bucketCapacity[BUCKET_COUNT] = {0x10000, 0x10000, 0x10000, 0x10000, 0x10000, 0x10000, 0x10000, 0x100000, 0x100000, 0x100000, 0x100000, 0x100000, 0};
-Bucket *lastBucket[BUCKET_COUNT];
+#define ARENA_TAG 0xfeedface
+
+const size_t blockAlignment = sizeof(BlockHeader);
+
+//8 byte steps up to 64, then 4 steps per power of two. waste is at most 25%, mostly less.
+#define SIZE_CLASS_COUNT 44
+#define THREAD_CACHE_COUNT 64
+const uint16_t sizeClassSizes[SIZE_CLASS_COUNT] = {
+	8, 16, 24, 32, 40, 48, 56, 64,
+	80, 96, 112, 128, 160, 192, 224, 256,
+	320, 384, 448, 512, 640, 768, 896, 1024,
+	1280, 1536, 1792, 2048, 2560, 3072, 3584, 4096,
+	5120, 6144, 7168, 8192, 10240, 12288, 14336, 16384,
+	20480, 24576, 28672, 32768};
+#ifdef ALLOCATOR_STATISTICS
+static_assert(SIZE_CLASS_COUNT == ALLOCATOR_SIZE_CLASS_COUNT, "statistics must cover every size class");
+#endif
+const size_t smallLookupLimit = 1024;
+const size_t largeLookupLimit = 32768;
+const size_t spanSize = 0x10000;
+const size_t minimumBlocksPerSpan = 16;
+
+//requested size to class index, in 8 byte steps up to smallLookupLimit and 128 byte steps up to largeLookupLimit.
+uint8_t smallClassLookup[smallLookupLimit / 8 + 1];
+uint8_t largeClassLookup[largeLookupLimit / 128 + 1];
+uint32_t batchCounts[SIZE_CLASS_COUNT]; //blocks moved between thread cache and central pool at once
+volatile bool sizeClassInitialized;
+SizeClass sizeClasses[SIZE_CLASS_COUNT];
+
+//per thread free lists, touched only by owning thread. found by thread id, as there's no crt for thread local storage.
+//slots are never released; thread ids of exited threads are reused by new threads, which inherit their cached blocks.
+//if all slots are taken, threads go to central pool directly.
+struct ThreadCache
+{
+	volatile long threadId; //0 if slot is free
+	MemoryArena *currentArena;
+	FreeBlock *freeList[SIZE_CLASS_COUNT];
+	uint32_t freeCount[SIZE_CLASS_COUNT];
+};
+ThreadCache threadCaches[THREAD_CACHE_COUNT];
+
+//big block size is kept in sizeClass as page count, which limits it to 16TB on x64. larger requests fail, which on x86
+//also keeps size plus header from wrapping.
+const size_t bigBlockMaxSize = (static_cast<size_t>(0xffffffff) << 12) - sizeof(BlockHeader);
+
+inline size_t getBigBlockSize(const BlockHeader *header)
+{
+	return static_cast<size_t>(header->sizeClass) * 4096;
+}
+
+const size_t arenaChunkSize = 0x10000;
+const size_t arenaMaxAllocation = 0x4000; //larger blocks go to size classes, so big buffers are still freed individually.
+
+inline long getCurrentThreadId()
+{
+#ifndef _WIN32
+	//no teb, but each thread has its own copy of a thread local. long is pointer sized there.
+	static __thread char threadMarker;
+	return static_cast<long>(reinterpret_cast<size_t>(&threadMarker));
+#elif defined(_WIN64)
+	return static_cast<long>(__readgsqword(0x48)); //TEB.ClientId.UniqueThread
+#else
+	return static_cast<long>(__readfsdword(0x24));
+#endif
+}
+
+inline void lockSizeClass(SizeClass &item)
+{
+	while(_InterlockedExchange(&item.lock, 1))
+		while(item.lock)
+			_mm_pause();
+}
+
+inline void unlockSizeClass(SizeClass &item)
+{
+	_InterlockedExchange(&item.lock, 0);
+}
+
+ThreadCache *getThreadCache()
+{
+	long threadId = getCurrentThreadId();
+	size_t start = (threadId >> 2) & (THREAD_CACHE_COUNT - 1); //thread ids are multiples of 4
+	for(size_t i = 0; i < THREAD_CACHE_COUNT; i ++)
+	{
+		ThreadCache *cache = &threadCaches[(start + i) & (THREAD_CACHE_COUNT - 1)];
+		if(cache->threadId == threadId)
+			return cache;
+		if(cache->threadId == 0 && _InterlockedCompareExchange(&cache->threadId, threadId, 0) == 0)
+			return cache;
+	}
+	return nullptr;
+}
+
+volatile size_t heapSize;
+volatile size_t peakHeapSize;
+
+inline size_t interlockedAdd(volatile size_t *target, size_t value)
+{
+#ifdef _WIN64
+	return static_cast<size_t>(_InterlockedExchangeAdd64(reinterpret_cast<volatile __int64 *>(target), static_cast<__int64>(value))) + value;
+#else
+	return static_cast<size_t>(_InterlockedExchangeAdd(reinterpret_cast<volatile long *>(target), static_cast<long>(value))) + value;
+#endif
+}
+
+inline size_t interlockedCompareExchange(volatile size_t *target, size_t exchange, size_t comparand)
+{
+#ifdef _WIN64
+	return static_cast<size_t>(_InterlockedCompareExchange64(reinterpret_cast<volatile __int64 *>(target), static_cast<__int64>(exchange), static_cast<__int64>(comparand)));
+#else
+	return static_cast<size_t>(_InterlockedCompareExchange(reinterpret_cast<volatile long *>(target), static_cast<long>(exchange), static_cast<long>(comparand)));
+#endif
+}
 
+//raises peak to current, unless another thread raised it further meanwhile.
+inline void updatePeak(volatile size_t *peak, size_t current)
+{
+	size_t previous = *peak;
+	while(current > previous)
+	{
+		size_t result = interlockedCompareExchange(peak, current, previous);
+		if(result == previous)
+			break;
+		previous = result;
+	}
+}
+
+//size is rounded to pages, and must be passed again to freeVirtual.
 uint8_t *allocateVirtual(size_t size)
 {
-	return reinterpret_cast<uint8_t *>(Win32SystemCaller::get()->allocateVirtual(0, multipleOf(size, 4096), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+	size = multipleOf(size, 4096);
+	uint8_t *result = reinterpret_cast<uint8_t *>(Win32SystemCaller::get()->allocateVirtual(0, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+	if(!result)
+		return nullptr;
+
+	updatePeak(&peakHeapSize, interlockedAdd(&heapSize, size));
+	return result;
 }
 
-bool freeVirtual(void *ptr)
+bool freeVirtual(void *ptr, size_t size)
 {
+	interlockedAdd(&heapSize, 0 - multipleOf(size, 4096));
 	return Win32SystemCaller::get()->freeVirtual(ptr);
 }
 
-uint8_t *searchEmpty(Bucket *bucket, uint8_t *ptr, size_t bucketSize, size_t capacity)
+size_t getHeapSize()
+{
+	return heapSize;
+}
+
+size_t getPeakHeapSize()
+{
+	return peakHeapSize;
+}
+
+void resetPeakHeapSize()
+{
+	peakHeapSize = heapSize;
+}
+
+#ifdef ALLOCATOR_STATISTICS
+AllocatorStatistics allocatorStatistics;
+volatile size_t sampleCounter;
+
+inline void recordLiveBytes(size_t size)
+{
+	updatePeak(&allocatorStatistics.peakLiveBytes, interlockedAdd(&allocatorStatistics.liveBytes, size));
+}
+
+inline void recordSizeClassAllocation(size_t sizeClass, size_t size)
+{
+	AllocatorStatistics::SizeClass &item = allocatorStatistics.sizeClasses[sizeClass];
+	interlockedAdd(&item.allocationCount, 1);
+	interlockedAdd(&item.requestedBytes, size);
+	updatePeak(&item.peakLiveBlocks, interlockedAdd(&item.liveBlocks, 1));
+	recordLiveBytes(sizeClassSizes[sizeClass]);
+}
+
+inline void recordSizeClassFree(size_t sizeClass)
 {
-	while(true)
+	AllocatorStatistics::SizeClass &item = allocatorStatistics.sizeClasses[sizeClass];
+	interlockedAdd(&item.freeCount, 1);
+	interlockedAdd(&item.liveBlocks, static_cast<size_t>(-1));
+	interlockedAdd(&allocatorStatistics.liveBytes, 0 - static_cast<size_t>(sizeClassSizes[sizeClass]));
+}
+
+inline void recordBigAllocation(size_t mappedSize)
+{
+	interlockedAdd(&allocatorStatistics.bigAllocationCount, 1);
+	updatePeak(&allocatorStatistics.bigPeakLiveBytes, interlockedAdd(&allocatorStatistics.bigLiveBytes, mappedSize));
+	recordLiveBytes(mappedSize);
+}
+
+inline void recordBigFree(size_t mappedSize)
+{
+	interlockedAdd(&allocatorStatistics.bigFreeCount, 1);
+	interlockedAdd(&allocatorStatistics.bigLiveBytes, 0 - mappedSize);
+	interlockedAdd(&allocatorStatistics.liveBytes, 0 - mappedSize);
+}
+
+#ifdef ALLOCATOR_SAMPLE_CALLERS
+//open addressing on caller address. slots are claimed once and never released.
+void recordCaller(void *caller, size_t size)
+{
+	if(interlockedAdd(&sampleCounter, 1) & (ALLOCATOR_SAMPLE_INTERVAL - 1))
+		return;
+	size_t address = reinterpret_cast<size_t>(caller);
+	size_t start = (address ^ (address >> 12)) & (ALLOCATOR_CALLER_COUNT - 1);
+	for(size_t i = 0; i < ALLOCATOR_CALLER_COUNT; i ++)
 	{
-		if(ptr + sizeof(MemoryInfo) + bucketSize > reinterpret_cast<uint8_t *>(bucket) + capacity)
-			break;
-		MemoryInfo *info = reinterpret_cast<MemoryInfo *>(ptr);
-		if(!info->inUse)
+		AllocatorStatistics::Caller &item = allocatorStatistics.callers[(start + i) & (ALLOCATOR_CALLER_COUNT - 1)];
+		size_t current = item.address;
+		if(current == 0)
 		{
-			info->inUse = 1;
-			info->bucketPtr = reinterpret_cast<unsigned int>(bucket);
-			bucket->usedCnt ++;
-			bucket->lastPtr = ptr + sizeof(MemoryInfo) + bucketSize;
-			return ptr + sizeof(MemoryInfo);
+			current = interlockedCompareExchange(&item.address, address, 0);
+			if(current == 0)
+				current = address;
+		}
+		if(current == address)
+		{
+			interlockedAdd(&item.count, 1);
+			interlockedAdd(&item.bytes, size);
+			return;
 		}
-		ptr += sizeof(MemoryInfo) + bucketSize;
 	}
-	return nullptr;
+	interlockedAdd(&allocatorStatistics.droppedCallerCount, 1);
 }
+#endif
+#endif
 
-uint8_t *allocate(Bucket *bucket, size_t bucketSize, size_t capacity)
+void initializeSizeClasses()
 {
-	if(bucket->usedCnt > capacity / (bucketSize + sizeof(MemoryInfo)) - 1)
-		return nullptr;
-	uint8_t *result = searchEmpty(bucket, bucket->lastPtr, bucketSize, capacity);
-	if(result)
-		return result;
+	size_t sizeClass = 0;
+	for(size_t i = 0; i <= smallLookupLimit / 8; i ++)
+	{
+		while(sizeClassSizes[sizeClass] < i * 8)
+			sizeClass ++;
+		smallClassLookup[i] = static_cast<uint8_t>(sizeClass);
+	}
+	for(size_t i = 0; i <= largeLookupLimit / 128; i ++)
+	{
+		while(sizeClassSizes[sizeClass] < i * 128)
+			sizeClass ++;
+		largeClassLookup[i] = static_cast<uint8_t>(sizeClass);
+	}
+	for(size_t i = 0; i < SIZE_CLASS_COUNT; i ++)
+	{
+		batchCounts[i] = 16384 / sizeClassSizes[i];
+		if(batchCounts[i] < 2)
+			batchCounts[i] = 2;
+		if(batchCounts[i] > 32)
+			batchCounts[i] = 32;
+#ifdef ALLOCATOR_STATISTICS
+		allocatorStatistics.sizeClasses[i].size = sizeClassSizes[i];
+#endif
+	}
+	//racing threads write same values, so initialization needs no lock.
+	sizeClassInitialized = true;
+}
 
-	uint8_t *ptr = bucket->bucketData + bucket->usedCnt * (bucketSize + sizeof(MemoryInfo));
-	result = searchEmpty(bucket, ptr, bucketSize, capacity);
-	if(result)
-		return result;
+inline size_t getSizeClass(size_t size)
+{
+	if(size <= smallLookupLimit)
+		return smallClassLookup[(size + 7) >> 3];
+	return largeClassLookup[(size + 127) >> 7];
+}
 
-	return searchEmpty(bucket, bucket->bucketData, bucketSize, capacity);
+inline size_t getBlockStride(size_t sizeClass)
+{
+	return multipleOf(sizeof(BlockHeader) + sizeClassSizes[sizeClass], blockAlignment);
 }
 
-void *heapAlloc(size_t size)
+//called with class lock held.
+uint8_t *carveBlock(size_t sizeClass)
 {
-	size_t bucketNo;
-	for(bucketNo = 0; bucketNo < BUCKET_COUNT; bucketNo ++)
-		if(bucketSizes[bucketNo] >= size || bucketSizes[bucketNo] == 0)
-			break;
+	SizeClass &item = sizeClasses[sizeClass];
+	size_t stride = getBlockStride(sizeClass);
+	if(item.spanCurrent + stride > item.spanEnd)
+	{
+		size_t size = spanSize;
+		if(size < stride * minimumBlocksPerSpan)
+			size = multipleOf(stride * minimumBlocksPerSpan, spanSize);
+		uint8_t *span = allocateVirtual(size);
+		if(!span)
+			return nullptr;
+#ifdef ALLOCATOR_STATISTICS
+		allocatorStatistics.sizeClasses[sizeClass].spanBytes += size; //class lock is held
+#endif
+		item.spanCurrent = span;
+		item.spanEnd = span + size;
+	}
+	BlockHeader *header = reinterpret_cast<BlockHeader *>(item.spanCurrent);
+	header->sizeClass = static_cast<uint32_t>(sizeClass);
+	header->tag = 0;
+	item.spanCurrent += stride;
+	return reinterpret_cast<uint8_t *>(header + 1);
+}
+
+//takes up to count blocks from central pool as a linked list.
+FreeBlock *takeFromCentral(size_t sizeClass, uint32_t count, uint32_t *taken)
+{
+	SizeClass &item = sizeClasses[sizeClass];
+	FreeBlock *result = nullptr;
+	*taken = 0;
+
+	lockSizeClass(item);
+	while(*taken < count)
+	{
+		FreeBlock *block = item.freeList;
+		if(block)
+			item.freeList = block->next;
+		else
+		{
+			block = reinterpret_cast<FreeBlock *>(carveBlock(sizeClass));
+			if(!block)
+				break;
+		}
+		block->next = result;
+		result = block;
+		(*taken) ++;
+	}
+	unlockSizeClass(item);
+	return result;
+}
+
+//returns linked list from first to last to central pool.
+void returnToCentral(size_t sizeClass, FreeBlock *first, FreeBlock *last)
+{
+	SizeClass &item = sizeClasses[sizeClass];
+	lockSizeClass(item);
+	last->next = item.freeList;
+	item.freeList = first;
+	unlockSizeClass(item);
+}
 
-	if(bucketSizes[bucketNo] == 0)
+//caller is only used for sampling, and is dropped when statistics are off.
+inline void *allocateBlock(size_t size, void *caller)
+{
+#ifdef ALLOCATOR_SAMPLE_CALLERS
+	recordCaller(caller, size);
+#endif
+	ThreadCache *cache = getThreadCache();
+	if(cache && cache->currentArena && size <= arenaMaxAllocation)
 	{
-		uint8_t *alloc = allocateVirtual(multipleOf(size + 4, 4096));
-		*reinterpret_cast<uint32_t *>(alloc) = BIGHEAP_TAG;
-		return alloc + 4;
+#ifdef ALLOCATOR_STATISTICS
+		interlockedAdd(&allocatorStatistics.arenaAllocationCount, 1);
+		interlockedAdd(&allocatorStatistics.arenaBytes, size);
+#endif
+		return cache->currentArena->allocate(size);
 	}
-	if(lastBucket[bucketNo])
+
+	if(size > largeLookupLimit)
 	{
-		uint8_t *result = allocate(lastBucket[bucketNo], bucketSizes[bucketNo], bucketCapacity[bucketNo]);
-		if(result)
-			return result;
+		if(size > bigBlockMaxSize)
+			return nullptr;
+		BlockHeader *header = reinterpret_cast<BlockHeader *>(allocateVirtual(size + sizeof(BlockHeader)));
+		if(!header)
+			return nullptr;
+		header->sizeClass = static_cast<uint32_t>(multipleOf(size + sizeof(BlockHeader), 4096) / 4096); //big blocks keep their mapped page count instead of class
+		header->tag = BIGHEAP_TAG;
+#ifdef ALLOCATOR_STATISTICS
+		recordBigAllocation(getBigBlockSize(header));
+#endif
+		return header + 1;
 	}
-	Bucket **currentBucket = &bucket[bucketNo];
-	while(true)
+
+	if(!sizeClassInitialized)
+		initializeSizeClasses();
+	size_t sizeClass = getSizeClass(size);
+
+	FreeBlock *block;
+	if(cache)
 	{
-		if(!*currentBucket)
+		if(!cache->freeList[sizeClass])
+			cache->freeList[sizeClass] = takeFromCentral(sizeClass, batchCounts[sizeClass], &cache->freeCount[sizeClass]);
+		block = cache->freeList[sizeClass];
+		if(block)
 		{
-			size_t newSize = multipleOf(bucketCapacity[bucketNo], 4096);
-			*currentBucket = reinterpret_cast<Bucket *>(allocateVirtual(newSize));
-			(*currentBucket)->lastPtr = (*currentBucket)->bucketData;
-			lastBucket[bucketNo] = (*currentBucket);
+			cache->freeList[sizeClass] = block->next;
+			cache->freeCount[sizeClass] --;
 		}
-
-		uint8_t *result = allocate(*currentBucket, bucketSizes[bucketNo], bucketCapacity[bucketNo]);
-		if(result)
-			return result;
-		currentBucket = &((*currentBucket)->nextBucket);
 	}
+	else
+	{
+		uint32_t taken;
+		block = takeFromCentral(sizeClass, 1, &taken);
+	}
+	if(!block)
+		return nullptr;
+
+	//free list links live in payload, header is kept as is.
+	BlockHeader *header = reinterpret_cast<BlockHeader *>(block) - 1;
+	header->tag = BLOCK_TAG;
+#ifdef ALLOCATOR_STATISTICS
+	recordSizeClassAllocation(sizeClass, size);
+#endif
+	return block;
+}
+
+void *heapAlloc(size_t size)
+{
+#ifdef ALLOCATOR_STATISTICS
+	return allocateBlock(size, _ReturnAddress());
+#else
+	return allocateBlock(size, nullptr);
+#endif
+}
+
+#ifdef ALLOCATOR_STATISTICS
+void *heapAllocFromCaller(size_t size, void *caller)
+{
+	return allocateBlock(size, caller);
+}
+
+const AllocatorStatistics &getAllocatorStatistics()
+{
+	if(!sizeClassInitialized)
+		initializeSizeClasses();
+	return allocatorStatistics;
 }
+#endif
 
 void heapFree(void *ptr)
 {
 	if(!ptr)
 		return;
-	if(*reinterpret_cast<uint32_t *>(reinterpret_cast<uint8_t *>(ptr) - 4) == BIGHEAP_TAG && ((reinterpret_cast<size_t>(ptr) - 4) & 0xFFFF) == 0 && freeVirtual(ptr))
+	BlockHeader *header = reinterpret_cast<BlockHeader *>(ptr) - 1;
+	if(header->tag == ARENA_TAG)
+	{
+		MemoryArena::freeBlock(ptr);
+		return;
+	}
+	if(header->tag == BIGHEAP_TAG)
+	{
+#ifdef ALLOCATOR_STATISTICS
+		recordBigFree(getBigBlockSize(header));
+#endif
+		freeVirtual(header, getBigBlockSize(header));
+		return;
+	}
+	if(header->tag != BLOCK_TAG || header->sizeClass >= SIZE_CLASS_COUNT)
+		return; //double free or not ours
+
+	header->tag = 0;
+	size_t sizeClass = header->sizeClass;
+#ifdef ALLOCATOR_STATISTICS
+	recordSizeClassFree(sizeClass);
+#endif
+	FreeBlock *block = reinterpret_cast<FreeBlock *>(ptr);
+	ThreadCache *cache = getThreadCache();
+	if(!cache)
+	{
+		returnToCentral(sizeClass, block, block);
 		return;
+	}
+
+	block->next = cache->freeList[sizeClass];
+	cache->freeList[sizeClass] = block;
+	cache->freeCount[sizeClass] ++;
+
+	//keep one batch cached, give the rest back so other threads can use it.
+	if(cache->freeCount[sizeClass] >= batchCounts[sizeClass] * 2)
+	{
+		FreeBlock *last = block;
+		for(uint32_t i = 1; i < batchCounts[sizeClass]; i ++)
+			last = last->next;
+		cache->freeList[sizeClass] = last->next;
+		cache->freeCount[sizeClass] -= batchCounts[sizeClass];
+		returnToCentral(sizeClass, block, last);
+	}
+}
+
+MemoryArena::MemoryArena() : chunks_(nullptr), current_(nullptr), end_(nullptr), allocationCount_(0), allocatedSize_(0)
+{
+}
+
+MemoryArena::~MemoryArena()
+{
+	//chunk whose blocks are all freed goes now, others go with their last block.
+	Chunk *chunk = chunks_;
+	while(chunk)
+	{
+		Chunk *next = chunk->next;
+		if(interlockedAdd(&chunk->references, chunk->allocationCount) == 0)
+			freeVirtual(chunk, chunk->size);
+		chunk = next;
+	}
+}
 
-	MemoryInfo *infoPtr = reinterpret_cast<MemoryInfo *>(reinterpret_cast<uint8_t *>(ptr) - sizeof(MemoryInfo));
-	infoPtr->inUse = 0;
-	reinterpret_cast<Bucket *>(infoPtr->bucketPtr)->usedCnt --;
-	reinterpret_cast<Bucket *>(infoPtr->bucketPtr)->lastPtr = reinterpret_cast<uint8_t *>(infoPtr);
-}
\ No newline at end of file
+void MemoryArena::freeBlock(void *ptr)
+{
+	//arena block keeps its offset from chunk start in sizeClass.
+	BlockHeader *header = reinterpret_cast<BlockHeader *>(ptr) - 1;
+	Chunk *chunk = reinterpret_cast<Chunk *>(reinterpret_cast<uint8_t *>(header) - header->sizeClass);
+	header->tag = 0;
+	if(interlockedAdd(&chunk->references, 0 - static_cast<size_t>(1)) == 0)
+		freeVirtual(chunk, chunk->size);
+}
+
+void *MemoryArena::allocate(size_t size)
+{
+	size_t blockSize = sizeof(BlockHeader) + multipleOf(size, blockAlignment);
+	if(current_ + blockSize > end_)
+	{
+		size_t chunkSize = multipleOf(sizeof(Chunk), blockAlignment) + blockSize;
+		if(chunkSize < arenaChunkSize)
+			chunkSize = arenaChunkSize;
+		chunkSize = multipleOf(chunkSize, 4096);
+		Chunk *chunk = reinterpret_cast<Chunk *>(allocateVirtual(chunkSize));
+		if(!chunk)
+			return nullptr;
+		chunk->next = chunks_;
+		chunk->size = chunkSize;
+		chunk->allocationCount = 0;
+		chunk->references = 0;
+		chunks_ = chunk;
+		current_ = reinterpret_cast<uint8_t *>(chunk) + multipleOf(sizeof(Chunk), blockAlignment);
+		end_ = reinterpret_cast<uint8_t *>(chunk) + chunkSize;
+	}
+
+	BlockHeader *header = reinterpret_cast<BlockHeader *>(current_);
+	header->sizeClass = static_cast<uint32_t>(current_ - reinterpret_cast<uint8_t *>(chunks_));
+	header->tag = ARENA_TAG;
+	current_ += blockSize;
+	chunks_->allocationCount ++;
+	allocationCount_ ++;
+	allocatedSize_ += size;
+	return header + 1;
+}
+
+size_t MemoryArena::getAllocationCount() const
+{
+	return allocationCount_;
+}
+
+size_t MemoryArena::getAllocatedSize() const
+{
+	return allocatedSize_;
+}
+
+size_t MemoryArena::getChunkCount() const
+{
+	size_t result = 0;
+	for(Chunk *chunk = chunks_; chunk; chunk = chunk->next)
+		result ++;
+	return result;
+}
+
+ArenaScope::ArenaScope(MemoryArena *arena) : previous_(nullptr)
+{
+	ThreadCache *cache = getThreadCache();
+	if(!cache)
+		return; //without cache slot, allocations simply go to heap.
+	previous_ = cache->currentArena;
+	cache->currentArena = arena;
+}
+
+ArenaScope::~ArenaScope()
+{
+	ThreadCache *cache = getThreadCache();
+	if(cache)
+		cache->currentArena = previous_;
+}
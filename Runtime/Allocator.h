@@ -1,4 +1,109 @@
 #pragma once
 
+#include <cstdint>
+#include <cstddef>
+
+//thread safe. each thread allocates from its own cache and refills it from a per size class locked pool.
 void *heapAlloc(size_t size);
-void heapFree(void *ptr);
\ No newline at end of file
+void heapFree(void *ptr);
+
+//bytes taken from system for heap spans, big blocks and arena chunks. cached free blocks count as used.
+size_t getHeapSize();
+size_t getPeakHeapSize();
+void resetPeakHeapSize(); //peak restarts from current size, for measuring one phase
+
+//define ALLOCATOR_STATISTICS to count allocations of each size class, big blocks and arena blocks.
+//define ALLOCATOR_SAMPLE_CALLERS as well to record return address of every ALLOCATOR_SAMPLE_INTERVAL-th allocation.
+//without them no counting code is compiled.
+#if defined(ALLOCATOR_SAMPLE_CALLERS) && !defined(ALLOCATOR_STATISTICS)
+#error ALLOCATOR_SAMPLE_CALLERS needs ALLOCATOR_STATISTICS
+#endif
+#ifdef ALLOCATOR_STATISTICS
+#define ALLOCATOR_SIZE_CLASS_COUNT 44
+#define ALLOCATOR_CALLER_COUNT 256
+#ifndef ALLOCATOR_SAMPLE_INTERVAL
+#define ALLOCATOR_SAMPLE_INTERVAL 64 //power of 2
+#endif
+
+//updated with interlocked operations while the process runs, so a dump taken from other threads is only roughly consistent.
+//cumulative counters are size_t and wrap on x86 after 4G.
+struct AllocatorStatistics
+{
+	struct SizeClass
+	{
+		size_t size;
+		size_t allocationCount;
+		size_t freeCount;
+		size_t requestedBytes; //compare with allocationCount * size for rounding waste
+		size_t liveBlocks;
+		size_t peakLiveBlocks;
+		size_t spanBytes; //taken from system for this class. spanBytes against liveBlocks * size shows blocks idling in free lists.
+	};
+	struct Caller
+	{
+		size_t address;
+		size_t count;
+		size_t bytes;
+	};
+	SizeClass sizeClasses[ALLOCATOR_SIZE_CLASS_COUNT];
+	size_t bigAllocationCount; //blocks over largest class, mapped on their own with BIGHEAP_TAG
+	size_t bigFreeCount;
+	size_t bigLiveBytes;
+	size_t bigPeakLiveBytes;
+	size_t arenaAllocationCount;
+	size_t arenaBytes;
+	size_t liveBytes; //size class and big blocks in use, at their rounded size
+	size_t peakLiveBytes;
+	Caller callers[ALLOCATOR_CALLER_COUNT]; //sampled, callers beyond table size are dropped
+	size_t droppedCallerCount;
+};
+
+const AllocatorStatistics &getAllocatorStatistics();
+//heapAlloc recording caller as allocation site, for wrappers like operator new.
+void *heapAllocFromCaller(size_t size, void *caller);
+#endif
+
+//bump allocator for metadata that dies together, like lists and names parsed from one image.
+//while an arena is current, small heapAlloc requests come from it and heapFree on them only counts them off their chunk.
+//a chunk is released once the arena is destroyed and all its blocks are freed, so shared blocks like copy on write
+//vector data copied out of an image stay valid after the arena is gone.
+//arena itself isn't thread safe; it's current only on the thread that opened ArenaScope.
+class MemoryArena
+{
+private:
+	struct Chunk
+	{
+		Chunk *next;
+		size_t size;
+		size_t allocationCount; //touched only by arena's thread
+		volatile size_t references; //frees count down from 0, arena adds allocationCount on destruction
+	};
+	Chunk *chunks_;
+	uint8_t *current_;
+	uint8_t *end_;
+	size_t allocationCount_;
+	size_t allocatedSize_;
+
+	MemoryArena(const MemoryArena &);
+	const MemoryArena &operator =(const MemoryArena &);
+public:
+	MemoryArena();
+	~MemoryArena();
+
+	void *allocate(size_t size);
+	size_t getAllocationCount() const;
+	size_t getAllocatedSize() const; //bytes handed out, excluding headers and chunk slack
+	size_t getChunkCount() const;
+
+	static void freeBlock(void *ptr); //heapFree on an arena block
+};
+
+//makes arena current for heapAlloc on calling thread until the scope ends. scopes nest.
+class ArenaScope
+{
+private:
+	MemoryArena *previous_;
+public:
+	ArenaScope(MemoryArena *arena);
+	~ArenaScope();
+};
@@ -0,0 +1,90 @@
+#include "AllocatorStatistics.h"
+
+#ifdef ALLOCATOR_STATISTICS
+#include "File.h"
+#include "../Util/Vector.h"
+
+static String toHex(size_t value)
+{
+	const char digits[] = "0123456789abcdef";
+	char buffer[sizeof(size_t) * 2];
+	for(size_t i = 0; i < sizeof(buffer); i ++)
+		buffer[i] = digits[(value >> ((sizeof(buffer) - i - 1) * 4)) & 0xf];
+	return String(buffer, buffer + sizeof(buffer));
+}
+
+static void appendRow(String &result, const char *name, const size_t *values, size_t count)
+{
+	result.append(name);
+	for(size_t i = 0; i < count; i ++)
+	{
+		result.append("\t");
+		result.append(IntToString(values[i]));
+	}
+	result.append("\n");
+}
+
+String formatAllocatorStatistics()
+{
+	const AllocatorStatistics &statistics = getAllocatorStatistics();
+	String result;
+
+	result.append("heap\tsize\tpeak\n");
+	size_t heap[] = {getHeapSize(), getPeakHeapSize()};
+	appendRow(result, "system", heap, 2);
+	size_t live[] = {statistics.liveBytes, statistics.peakLiveBytes};
+	appendRow(result, "live", live, 2);
+
+	result.append("\nbig\tallocations\tfrees\tlive bytes\tpeak live bytes\n");
+	size_t big[] = {statistics.bigAllocationCount, statistics.bigFreeCount, statistics.bigLiveBytes, statistics.bigPeakLiveBytes};
+	appendRow(result, "big", big, 4);
+
+	result.append("\narena\tallocations\tbytes\n");
+	size_t arena[] = {statistics.arenaAllocationCount, statistics.arenaBytes};
+	appendRow(result, "arena", arena, 2);
+
+	result.append("\nclass\tsize\tallocations\tfrees\trequested bytes\tlive blocks\tpeak live blocks\tspan bytes\n");
+	for(size_t i = 0; i < ALLOCATOR_SIZE_CLASS_COUNT; i ++)
+	{
+		const AllocatorStatistics::SizeClass &item = statistics.sizeClasses[i];
+		if(!item.allocationCount && !item.spanBytes)
+			continue;
+		size_t values[] = {item.size, item.allocationCount, item.freeCount, item.requestedBytes, item.liveBlocks, item.peakLiveBlocks, item.spanBytes};
+		appendRow(result, IntToString(i).c_str(), values, 7);
+	}
+
+	//table is small, selection sort by count.
+	Vector<size_t> callers;
+	for(size_t i = 0; i < ALLOCATOR_CALLER_COUNT; i ++)
+		if(statistics.callers[i].address)
+			callers.push_back(i);
+	for(size_t i = 0; i < callers.size(); i ++)
+		for(size_t j = i + 1; j < callers.size(); j ++)
+			if(statistics.callers[callers[j]].count > statistics.callers[callers[i]].count)
+			{
+				size_t temp = callers[i];
+				callers[i] = callers[j];
+				callers[j] = temp;
+			}
+
+	if(callers.size() || statistics.droppedCallerCount)
+	{
+		result.append("\ncaller\tsamples\tbytes\n");
+		for(auto &i : callers)
+		{
+			size_t values[] = {statistics.callers[i].count, statistics.callers[i].bytes};
+			appendRow(result, toHex(statistics.callers[i].address).c_str(), values, 2);
+		}
+		size_t dropped[] = {statistics.droppedCallerCount, 0};
+		appendRow(result, "dropped", dropped, 1);
+	}
+	return result;
+}
+
+void writeAllocatorStatistics(const String &path)
+{
+	String result = formatAllocatorStatistics();
+	SharedPtr<File> output = File::open(path, true);
+	output->write(result.c_str(), result.length());
+}
+#endif
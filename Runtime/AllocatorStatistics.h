@@ -0,0 +1,10 @@
+#pragma once
+
+#include "Allocator.h"
+#include "../Util/String.h"
+
+#ifdef ALLOCATOR_STATISTICS
+//tab separated tables of getAllocatorStatistics(). callers are sorted by sample count.
+String formatAllocatorStatistics();
+void writeAllocatorStatistics(const String &path);
+#endif
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "Image.h"
+#include "../Util/UniqueVector.h"
 #include "../Util/List.h"
+#include "../Util/Vector.h"
 #include "../Util/String.h"
 #include "../Util/SharedPtr.h"
 #include "../Util/DataSource.h"
@@ -18,14 +20,14 @@ public:
 	virtual const String &getFileName() const = 0;
 	virtual const String &getFilePath() const = 0;
 	virtual Image toImage() = 0;
-	virtual const List<Import> &getImports() = 0;
-	virtual const List<ExportFunction> &getExports() = 0;
+	virtual const Vector<Import> &getImports() = 0;
+	virtual const UniqueVector<ExportFunction> &getExports() = 0;
 	virtual const ImageInfo &getInfo() const = 0;
-	virtual const List<uint64_t> &getRelocations() = 0;
-	virtual const List<Section> &getSections() const = 0;
+	virtual const Vector<uint64_t> &getRelocations() = 0;
+	virtual const Vector<Section> &getSections() const = 0;
 
-	virtual void setSections(const List<Section> &sections) = 0;
-	virtual void setRelocations(const List<uint64_t> &relocations) = 0;
+	virtual void setSections(const Vector<Section> &sections) = 0;
+	virtual void setRelocations(const Vector<uint64_t> &relocations) = 0;
 	virtual void setImageInfo(const ImageInfo &info) = 0;
 
 	virtual void save(SharedPtr<DataSource> target) = 0;
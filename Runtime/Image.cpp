@@ -1,6 +1,7 @@
 #include "Image.h"
 
 #include "Allocator.h"
+#include "Trace.h"
 
 #include "../LZMA/LzmaEnc.h"
 #include "../LZMA/LzmaDec.h"
@@ -19,36 +20,96 @@ static ISzAlloc g_Alloc = {SzAlloc, SzFree};
 //both serialization and unserialization are done on machine with same endian.
 
 template<typename T>
-void appendToVector(Vector<uint8_t> &dst, const T &src)
+void appendToVector(UniqueVector<uint8_t> &dst, const T &src)
 {
 	dst.append(reinterpret_cast<const uint8_t *>(&src), sizeof(T));
 }
 
 template<typename Ty>
-void appendToVector(Vector<uint8_t> &dst, const Vector<Ty> &src)
+void appendToVector(UniqueVector<uint8_t> &dst, const Vector<Ty> &src)
 {
 	appendToVector(dst, static_cast<uint32_t>(src.size()));
-	dst.append(src);
+	dst.append(reinterpret_cast<const uint8_t *>(src.get()), src.size() * sizeof(Ty));
 }
 
-void appendToVector(Vector<uint8_t> &dst, const uint8_t *data, size_t size)
+void appendToVector(UniqueVector<uint8_t> &dst, const uint8_t *data, size_t size)
 {
 	appendToVector(dst, static_cast<uint32_t>(size));
 	dst.append(data, size);
 }
 
 template <>
-void appendToVector(Vector<uint8_t> &dst, const String &src)
+void appendToVector(UniqueVector<uint8_t> &dst, const String &src)
 {
 	appendToVector(dst, static_cast<uint32_t>(src.length()));
 	dst.append(reinterpret_cast<const uint8_t *>(src.c_str()), src.length());
 }
 
-Vector<uint8_t> Image::serialize() const
+Vector<uint8_t> Image::serialize(ImageFormat format) const
 {
-	Vector<uint8_t> result;
+	return compress(serializeUncompressed(nullptr, format));
+}
+
+//converts relative branch targets to absolute offsets, so repeated calls to same function compress better.
+void Image::encodeBranches(uint8_t *code, size_t size)
+{
+	if(size <= 5)
+		return;
+	for(size_t j = 0; j < size - 5; j ++)
+	{
+		if(code[j] == 0xE8 || code[j] == 0xE9) //call rel32, jmp rel32
+		{
+			*reinterpret_cast<int32_t *>(code + j + 1) += (j + 5);
+			j += 4;
+		}
+		else if(code[j] == 0x0f && (code[j + 1] >= 0x80 && code[j + 1] <= 0x8f)) //conditional jmp rel32
+		{
+			*reinterpret_cast<int32_t *>(code + j + 2) += (j + 6);
+			j += 5;
+		}
+	}
+}
+
+void Image::decodeBranches(uint8_t *code, size_t size)
+{
+	if(size <= 5)
+		return;
+	for(size_t j = 0; j < size - 5; j ++)
+	{
+		if(code[j] == 0xE8 || code[j] == 0xE9) //call rel32, jmp rel32
+		{
+			*reinterpret_cast<int32_t *>(code + j + 1) -= (j + 5);
+			j += 4;
+		}
+		else if(code[j] == 0x0f && (code[j + 1] >= 0x80 && code[j + 1] <= 0x8f)) //conditional jmp rel32
+		{
+			*reinterpret_cast<int32_t *>(code + j + 2) -= (j + 6);
+			j += 5;
+		}
+	}
+}
+
+UniqueVector<uint8_t> Image::serializeUncompressed(Vector<SerializedPart> *parts, ImageFormat format) const
+{
+	UniqueVector<uint8_t> result;
 #define A(...) appendToVector(result, __VA_ARGS__);
+	//each part ends where next one begins.
+	auto endPart = [&]() {
+		if(parts && parts->size())
+			(*parts)[parts->size() - 1].size = result.size() - (*parts)[parts->size() - 1].offset;
+	};
+	auto beginPart = [&](const String &name) {
+		if(!parts)
+			return;
+		endPart();
+		SerializedPart part;
+		part.name = name;
+		part.offset = result.size();
+		part.size = 0;
+		parts->push_back(std::move(part));
+	};
 	
+	beginPart("info");
 	//imageinfo
 	A(info.architecture);
 	A(info.baseAddress);
@@ -57,9 +118,15 @@ Vector<uint8_t> Image::serialize() const
 	A(info.platformData);
 	A(info.platformData1);
 	A(info.size);
+	if(format >= ImageFormatStamp)
+	{
+		A(info.timeStamp);
+		A(info.checkSum);
+	}
 
 	A(fileName);
 
+	beginPart("exports");
 	A(static_cast<uint32_t>(exports.size()));
 	for(auto &i : exports)
 	{
@@ -68,8 +135,15 @@ Vector<uint8_t> Image::serialize() const
 		A(i.name);
 		A(i.nameHash);
 		A(i.ordinal);
+		if(format >= ImageFormatForwarder)
+		{
+			A(i.forwardLibrary);
+			A(i.forwardNameHash);
+			A(i.forwardOrdinal);
+		}
 	}
 
+	beginPart("section table");
 	A(static_cast<uint32_t>(sections.size()));
 	for(auto &i : sections)
 	{
@@ -79,10 +153,18 @@ Vector<uint8_t> Image::serialize() const
 		A(i.flag);
 	}
 
+	beginPart("imports");
 	A(static_cast<uint32_t>(imports.size()));
 	for(auto &i : imports)
 	{
 		A(i.libraryName);
+		if(format >= ImageFormatBind)
+			A(i.bindImage);
+		if(format >= ImageFormatStamp)
+		{
+			A(i.timeStamp);
+			A(i.checkSum);
+		}
 		A(static_cast<uint32_t>(i.functions.size()));
 		for(auto &j : i.functions)
 		{
@@ -90,39 +172,37 @@ Vector<uint8_t> Image::serialize() const
 			A(j.name);
 			A(j.nameHash);
 			A(j.ordinal);
+			if(format >= ImageFormatBind)
+			{
+				A(j.bindImage);
+				A(j.bindAddress);
+			}
 		}
 	}
 
-	A(static_cast<uint32_t>(relocations.size()));
-	for(auto &i : relocations)
-		A(i);
+	beginPart("relocations");
+	A(relocations);
 
 	for(auto &i : sections)
 	{
+		beginPart(String("section ") + i.name.c_str()); //name is null padded to 8 bytes
 		A(i.data->get(), i.data->size());
-		if((i.flag & SectionFlagCode) && i.data->size() > 5)
-		{
-			uint8_t *codeStart = result.end() - i.data->size();
-			for(size_t j = 0; j < i.data->size() - 5; j ++)
-			{
-				if(codeStart[j] == 0xE8 || codeStart[j] == 0xE9) //call rel32, jmp rel32
-				{
-					*reinterpret_cast<int32_t *>(codeStart + j + 1) += (j + 5);
-					j += 4;
-				}
-				else if(codeStart[j] == 0x0f && (codeStart[j + 1] >= 0x80 && codeStart[j + 1] <= 0x8f)) //conditional jmp rel32
-				{
-					*reinterpret_cast<int32_t *>(codeStart + j + 2) += (j + 6);
-					j += 5;
-				}
-			}
-		}
+		if(i.flag & SectionFlagCode)
+			encodeBranches(result.end() - i.data->size(), i.data->size());
 	}
 
+	beginPart("header");
 	A(header->get(), header->size());
+	endPart();
 
 #undef A
 
+	return result;
+}
+
+Vector<uint8_t> Image::compress(const UniqueVector<uint8_t> &data)
+{
+	TRACE_SCOPE("Image::compress");
 	CLzmaEncProps props;
 	LzmaEncProps_Init(&props);
 
@@ -130,75 +210,90 @@ Vector<uint8_t> Image::serialize() const
 	LzmaEncProps_Normalize(&props);
 
 	uint32_t sizeSize = sizeof(uint32_t) * 2;
-	uint32_t propsSize = LZMA_PROPS_SIZE;
-	uint32_t outSize = result.size() + result.size() / 40 + (1 << 12); //igor recommends (http://sourceforge.net/p/sevenzip/discussion/45798/thread/dd3b392c/)
-	Vector<uint8_t> compressed(outSize + propsSize + sizeSize);
-	LzmaEncode(&compressed[propsSize + sizeSize], &outSize, &result[0], result.size(), &props, &compressed[sizeSize], &propsSize, 0, nullptr, &g_Alloc, &g_Alloc);
+	SizeT propsSize = LZMA_PROPS_SIZE;
+	SizeT outSize = data.size() + data.size() / 40 + (1 << 12); //igor recommends (http://sourceforge.net/p/sevenzip/discussion/45798/thread/dd3b392c/)
+	UniqueVector<uint8_t> compressed(outSize + propsSize + sizeSize);
+	LzmaEncode(&compressed[propsSize + sizeSize], &outSize, data.get(), data.size(), &props, &compressed[sizeSize], &propsSize, 0, nullptr, &g_Alloc, &g_Alloc);
 
-	*reinterpret_cast<uint32_t *>(&compressed[0]) = result.size();
-	*reinterpret_cast<uint32_t *>(&compressed[sizeof(uint32_t)]) = outSize;
+	*reinterpret_cast<uint32_t *>(&compressed[0]) = data.size();
+	*reinterpret_cast<uint32_t *>(&compressed[sizeof(uint32_t)]) = static_cast<uint32_t>(outSize);
 
 	compressed.resize(outSize + propsSize + sizeSize);
-	return compressed;
+	return Vector<uint8_t>(std::move(compressed));
 }
 
+//offset past size marks a truncated or corrupt buffer. every later read then returns zero values, so parsing stops at the first bad field.
+const size_t readOverrun = static_cast<size_t>(-1);
+
 template<typename T>
-T readFromVector(uint8_t *data, size_t &offset)
+T readFromVector(uint8_t *data, size_t &offset, size_t size)
 {
+	if(offset > size || size - offset < sizeof(T))
+	{
+		offset = readOverrun;
+		return T();
+	}
 	offset += sizeof(T);
 	return *reinterpret_cast<T *>(data + offset - sizeof(T));
 }
 
 template <>
-String readFromVector(uint8_t *data, size_t &offset)
+String readFromVector(uint8_t *data, size_t &offset, size_t size)
 {
-	uint32_t len = readFromVector<uint32_t>(data, offset);
+	uint32_t len = readFromVector<uint32_t>(data, offset, size);
+	if(offset > size || size - offset < len)
+	{
+		offset = readOverrun;
+		return String();
+	}
 	String result(data + offset, data + offset + len);
 	offset += len;
 	return result;
 }
 
-template <>
-Vector<uint8_t> readFromVector(uint8_t *data, size_t &offset)
+SharedPtr<DataView> readViewFromVector(uint8_t *data, size_t &offset, size_t size, SharedPtr<DataSource> original)
 {
-	uint32_t len = readFromVector<uint32_t>(data, offset);
-	Vector<uint8_t> result(data + offset, data + offset + len);
+	uint32_t len = readFromVector<uint32_t>(data, offset, size);
+	if(offset > size || size - offset < len)
+	{
+		offset = readOverrun;
+		return SharedPtr<DataView>(nullptr);
+	}
 	offset += len;
-	return result;
+	return original->getView(offset - len, len);
 }
 
-template<typename T>
-T readFromVector(uint8_t *data, size_t &offset, Vector<uint8_t> original);
-
-template<>
-SharedPtr<DataView> readFromVector(uint8_t *data, size_t &offset, Vector<uint8_t> original)
+//each item takes at least itemSize bytes, so a count that can't fit in rest of buffer is corrupt. checked before reserve(), so a forged count can't allocate much.
+uint32_t readCountFromVector(uint8_t *data, size_t &offset, size_t size, size_t itemSize)
 {
-	uint32_t len = readFromVector<uint32_t>(data, offset);
-	offset += len;
-	return original.getView(offset - len, len);
+	uint32_t count = readFromVector<uint32_t>(data, offset, size);
+	if(offset > size || count > (size - offset) / itemSize)
+	{
+		offset = readOverrun;
+		return 0;
+	}
+	return count;
 }
 
-Image Image::unserialize(SharedPtr<DataView> data_, size_t *processedSize)
-{
-	uint32_t sizeSize = sizeof(uint32_t) * 2;
-	uint32_t propsSize = LZMA_PROPS_SIZE;
+//lzma can't expand input much more than 9000 times(longest match for a fraction of a bit), so larger claimed sizes are corrupt.
+const size_t maxCompressionRatio = 1 << 14;
+//input block of streaming unserialize. fits in l1 cache with decoder probabilities.
+const size_t imageStreamBlockSize = 0x4000;
 
-	ELzmaStatus status;
-	uint8_t *compressedData = data_->get();
-	uint32_t uncompressedSize = *reinterpret_cast<uint32_t *>(compressedData);
-	uint32_t compressedSize = *reinterpret_cast<uint32_t *>(compressedData + sizeof(uint32_t));
-	Vector<uint8_t> uncompressed(uncompressedSize);
-	
-	LzmaDecode(&uncompressed[0], &uncompressedSize, compressedData + sizeSize + propsSize, &compressedSize, compressedData + sizeSize, propsSize, LZMA_FINISH_ANY, &status, &g_Alloc);
-	compressedSize += sizeSize + propsSize;
+//parses serializeUncompressed output. sections and header are views into uncompressed.
+static Image parseUncompressed(Vector<uint8_t> &uncompressed)
+{
 	uint8_t *data = &uncompressed[0];
+	size_t size = uncompressed.size();
+	//views share uncompressed buffer. getView() on the vector would copy it for each view, as the previous view holds a reference.
+	SharedPtr<DataSource> uncompressedSource = uncompressed.asDataSource();
 	size_t offset = 0;
 	Image result;
+	result.arena = MakeShared<MemoryArena>();
+	ArenaScope scope(result.arena.get());
 
-	if(processedSize)
-		*processedSize = compressedSize;
-
-#define R(t, ...) readFromVector<t>(data, offset, __VA_ARGS__)
+#define R(t) readFromVector<t>(data, offset, size)
+#define COUNT(itemSize) readCountFromVector(data, offset, size, itemSize)
 	result.info.architecture = R(ArchitectureType);
 	result.info.baseAddress = R(uint64_t);
 	result.info.entryPoint = R(uint64_t);
@@ -206,10 +301,12 @@ Image Image::unserialize(SharedPtr<DataView> data_, size_t *processedSize)
 	result.info.platformData = R(uint64_t);
 	result.info.platformData1 = R(uint64_t);
 	result.info.size = R(uint64_t);
+	result.info.timeStamp = R(uint32_t);
+	result.info.checkSum = R(uint32_t);
 
 	result.fileName = R(String);
 
-	uint32_t exportLen = R(uint32_t);
+	uint32_t exportLen = COUNT(34); //address, 3 string lengths, 2 hashes, 2 ordinals
 	result.exports.reserve(exportLen);
 	for(size_t i = 0; i < exportLen; ++ i)
 	{
@@ -219,11 +316,15 @@ Image Image::unserialize(SharedPtr<DataView> data_, size_t *processedSize)
 		item.name = R(String);
 		item.nameHash = R(uint32_t);
 		item.ordinal = R(uint16_t);
+		item.forwardLibrary = R(String);
+		item.forwardNameHash = R(uint32_t);
+		item.forwardOrdinal = R(int32_t);
 
 		result.exports.push_back(std::move(item));
 	}
 
-	uint32_t sectionLen = R(uint32_t);
+	uint32_t sectionLen = COUNT(24); //name length, address, size, flag
+	result.sections.reserve(sectionLen);
 	for(size_t i = 0; i < sectionLen; ++ i)
 	{
 		Section item;
@@ -235,12 +336,17 @@ Image Image::unserialize(SharedPtr<DataView> data_, size_t *processedSize)
 		result.sections.push_back(std::move(item));
 	}
 
-	uint32_t importLen = R(uint32_t);
+	uint32_t importLen = COUNT(20); //name length, bind image, stamp, checksum, function count
+	result.imports.reserve(importLen);
 	for(size_t i = 0; i < importLen; ++ i)
 	{
 		Import item;
 		item.libraryName = R(String);
-		uint32_t functionLen = R(uint32_t);
+		item.bindImage = R(int32_t);
+		item.timeStamp = R(uint32_t);
+		item.checkSum = R(uint32_t);
+		uint32_t functionLen = COUNT(30); //iat, name length, hash, ordinal, bind image, bind address
+		item.functions.reserve(functionLen);
 		for(size_t j = 0; j < functionLen; ++ j)
 		{
 			ImportFunction function;
@@ -248,6 +354,8 @@ Image Image::unserialize(SharedPtr<DataView> data_, size_t *processedSize)
 			function.name = R(String);
 			function.nameHash = R(uint32_t);
 			function.ordinal = R(uint16_t);
+			function.bindImage = R(int32_t);
+			function.bindAddress = R(uint64_t);
 
 			item.functions.push_back(std::move(function));
 		}
@@ -255,33 +363,126 @@ Image Image::unserialize(SharedPtr<DataView> data_, size_t *processedSize)
 		result.imports.push_back(std::move(item));
 	}
 
-	uint32_t relocationLen = R(uint32_t);
-	for(size_t i = 0; i < relocationLen; ++ i)
-		result.relocations.push_back(R(uint64_t));
+	uint32_t relocationLen = COUNT(sizeof(uint64_t));
+	result.relocations.resize_uninitialized(relocationLen);
+	copyMemory(result.relocations.get(), data + offset, relocationLen * sizeof(uint64_t));
+	offset += relocationLen * sizeof(uint64_t);
 
 	for(auto &i : result.sections)
 	{
-		i.data = R(SharedPtr<DataView>, uncompressed);
-		if((i.flag & SectionFlagCode) && i.data->size() > 5)
-		{
-			uint8_t *codeStart = i.data->get();
-			for(size_t j = 0; j < i.data->size() - 5; j ++)
-			{
-				if(codeStart[j] == 0xE8 || codeStart[j] == 0xE9) //call rel32, jmp rel32
-				{
-					*reinterpret_cast<int32_t *>(codeStart + j + 1) -= (j + 5);
-					j += 4;
-				}
-				else if(codeStart[j] == 0x0f && (codeStart[j + 1] >= 0x80 && codeStart[j + 1] <= 0x8f)) //conditional jmp rel32
-				{
-					*reinterpret_cast<int32_t *>(codeStart + j + 2) -= (j + 6);
-					j += 5;
-				}
-			}
-		}
+		i.data = readViewFromVector(data, offset, size, uncompressedSource);
+		if(!i.data)
+			break;
+		if(i.flag & SectionFlagCode)
+			Image::decodeBranches(i.data->get(), i.data->size());
 	}
 
-	result.header = R(SharedPtr<DataView>, uncompressed);
+	result.header = readViewFromVector(data, offset, size, uncompressedSource);
+#undef COUNT
 #undef R
+	if(offset > size)
+		return Image();
+	return result;
+}
+
+Image Image::unserialize(SharedPtr<DataView> data_, size_t *processedSize)
+{
+	TRACE_SCOPE("Image::unserialize");
+	uint32_t sizeSize = sizeof(uint32_t) * 2;
+	uint32_t propsSize = LZMA_PROPS_SIZE;
+
+	if(processedSize)
+		*processedSize = 0;
+	//view size is 0 if caller doesn't know it, like the stub. then only the decoded buffer is bounds checked.
+	size_t dataSize = data_->size();
+	if(dataSize && dataSize < sizeSize + propsSize)
+		return Image();
+
+	ELzmaStatus status;
+	uint8_t *compressedData = data_->get();
+	SizeT uncompressedSize = *reinterpret_cast<uint32_t *>(compressedData);
+	SizeT compressedSize = *reinterpret_cast<uint32_t *>(compressedData + sizeof(uint32_t));
+	if(dataSize && compressedSize > dataSize - sizeSize - propsSize)
+		return Image();
+	if(uncompressedSize / maxCompressionRatio > compressedSize)
+		return Image();
+	Vector<uint8_t> uncompressed(uncompressedSize);
+	
+	SRes decodeResult = LzmaDecode(&uncompressed[0], &uncompressedSize, compressedData + sizeSize + propsSize, &compressedSize, compressedData + sizeSize, propsSize, LZMA_FINISH_ANY, &status, &g_Alloc);
+	if(decodeResult != SZ_OK || uncompressedSize != uncompressed.size())
+		return Image();
+
+	Image result = parseUncompressed(uncompressed);
+	if(processedSize && result.header.get())
+		*processedSize = compressedSize + sizeSize + propsSize;
+	return result;
+}
+
+//reads exactly size bytes. ISeqInStream may return less than asked on each call.
+static bool readStream(ISeqInStream *input, uint8_t *buffer, size_t size)
+{
+	while(size)
+	{
+		size_t readSize = size;
+		if(input->Read(input, buffer, &readSize) != SZ_OK || !readSize)
+			return false;
+		buffer += readSize;
+		size -= readSize;
+	}
+	return true;
+}
+
+Image Image::unserialize(ISeqInStream *input, size_t *processedSize)
+{
+	TRACE_SCOPE("Image::unserialize");
+	const size_t sizeSize = sizeof(uint32_t) * 2;
+	const size_t propsSize = LZMA_PROPS_SIZE;
+
+	if(processedSize)
+		*processedSize = 0;
+	uint8_t header[sizeSize + propsSize];
+	if(!readStream(input, header, sizeof(header)))
+		return Image();
+	SizeT uncompressedSize = *reinterpret_cast<uint32_t *>(header);
+	size_t compressedSize = *reinterpret_cast<uint32_t *>(header + sizeof(uint32_t));
+	if(uncompressedSize / maxCompressionRatio > compressedSize)
+		return Image();
+	Vector<uint8_t> uncompressed(uncompressedSize);
+
+	//decoder uses output as dictionary like LzmaDecode, but input comes in blocks small enough to stay in cache.
+	CLzmaDec decoder;
+	LzmaDec_Construct(&decoder);
+	if(LzmaDec_AllocateProbs(&decoder, header + sizeSize, propsSize, &g_Alloc) != SZ_OK)
+		return Image();
+	decoder.dic = &uncompressed[0];
+	decoder.dicBufSize = uncompressedSize;
+	LzmaDec_Init(&decoder);
+
+	Vector<uint8_t> block(imageStreamBlockSize);
+	SRes decodeResult = SZ_OK;
+	ELzmaStatus status;
+	//whole compressed size is read even if output fills early, so next image starts where it should.
+	for(size_t remaining = compressedSize; remaining;)
+	{
+		size_t blockSize = remaining < block.size() ? remaining : block.size();
+		if(!readStream(input, &block[0], blockSize))
+		{
+			decodeResult = SZ_ERROR_INPUT_EOF;
+			break;
+		}
+		remaining -= blockSize;
+		if(decodeResult != SZ_OK || decoder.dicPos == uncompressedSize)
+			continue;
+		SizeT inSize = blockSize;
+		decodeResult = LzmaDec_DecodeToDic(&decoder, uncompressedSize, &block[0], &inSize, LZMA_FINISH_ANY, &status);
+	}
+	bool decoded = decodeResult == SZ_OK && decoder.dicPos == uncompressedSize;
+	LzmaDec_FreeProbs(&decoder, &g_Alloc);
+	if(!decoded)
+		return Image();
+
+	Image result = parseUncompressed(uncompressed);
+	if(processedSize && result.header.get())
+		*processedSize = compressedSize + sizeSize + propsSize;
 	return result;
 }
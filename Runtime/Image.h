@@ -7,6 +7,8 @@
 #include "../Util/List.h"
 #include "../Util/String.h"
 #include "../Util/DataSource.h"
+#include "Allocator.h"
+#include "../LZMA/Types.h"
 
 enum ArchitectureType
 {
@@ -29,6 +31,15 @@ struct ImageInfo
 
 	uint64_t platformData; //PE: security cookie
 	uint64_t platformData1; //PE: tls entry
+
+	uint32_t timeStamp; //PE: TimeDateStamp
+	uint32_t checkSum; //PE: CheckSum
+};
+
+enum ImportBindType
+{
+	ImportBindByName = -1,
+	ImportBindSystem = -2, //bindAddress is rva in system library, valid if its stamp matches.
 };
 
 enum SectionFlag
@@ -75,14 +86,18 @@ struct Section
 
 struct ImportFunction
 {
-	ImportFunction() {}
-	ImportFunction(ImportFunction &&operand) : ordinal(operand.ordinal), name(std::move(operand.name)), iat(operand.iat), nameHash(operand.nameHash) {}
+	ImportFunction() : nameHash(0), bindImage(ImportBindByName), bindAddress(0) {}
+	ImportFunction(const ImportFunction &) = default; //declared move operations would hide implicit copies
+	ImportFunction &operator =(const ImportFunction &) = default;
+	ImportFunction(ImportFunction &&operand) : ordinal(operand.ordinal), name(std::move(operand.name)), iat(operand.iat), nameHash(operand.nameHash), bindImage(operand.bindImage), bindAddress(operand.bindAddress) {}
 	const ImportFunction &operator =(ImportFunction &&operand)
 	{
 		ordinal = operand.ordinal;
 		name = std::move(operand.name);
 		nameHash = operand.nameHash;
 		iat = operand.iat;
+		bindImage = operand.bindImage;
+		bindAddress = operand.bindAddress;
 
 		return *this;
 	}
@@ -90,27 +105,40 @@ struct ImportFunction
 	String name;
 	uint32_t nameHash;
 	uint64_t iat;
+	int32_t bindImage; //index of bundled image resolved at pack time, or ImportBindType.
+	uint64_t bindAddress; //export rva in bindImage
 };
 
 struct Import
 {
-	Import() {}
-	Import(Import &&operand) : libraryName(std::move(operand.libraryName)), functions(std::move(operand.functions)) {}
+	Import() : bindImage(ImportBindByName), timeStamp(0), checkSum(0) {}
+	Import(const Import &) = default; //declared move operations would hide implicit copies
+	Import &operator =(const Import &) = default;
+	Import(Import &&operand) : libraryName(std::move(operand.libraryName)), functions(std::move(operand.functions)), bindImage(operand.bindImage), timeStamp(operand.timeStamp), checkSum(operand.checkSum) {}
 	const Import &operator =(Import &&operand)
 	{
 		libraryName = std::move(operand.libraryName);
 		functions = std::move(operand.functions);
+		bindImage = operand.bindImage;
+		timeStamp = operand.timeStamp;
+		checkSum = operand.checkSum;
 
 		return *this;
 	}
 	String libraryName;
 	Vector<ImportFunction> functions;
+	int32_t bindImage; //index of bundled image providing libraryName, -1 for system libraries.
+	uint32_t timeStamp; //stamps of prebound system library, 0 if not prebound.
+	uint32_t checkSum;
 };
 
 struct ExportFunction
 {
-	ExportFunction() {}
-	ExportFunction(ExportFunction &&operand) : ordinal(operand.ordinal), name(std::move(operand.name)), address(operand.address), forward(std::move(operand.forward)), nameHash(operand.nameHash) {}
+	ExportFunction() : nameHash(0), forwardNameHash(0), forwardOrdinal(-1) {}
+	ExportFunction(const ExportFunction &) = default; //declared move operations would hide implicit copies
+	ExportFunction &operator =(const ExportFunction &) = default;
+	ExportFunction(ExportFunction &&operand) : ordinal(operand.ordinal), name(std::move(operand.name)), address(operand.address), forward(std::move(operand.forward)), nameHash(operand.nameHash),
+		forwardLibrary(std::move(operand.forwardLibrary)), forwardNameHash(operand.forwardNameHash), forwardOrdinal(operand.forwardOrdinal) {}
 	const ExportFunction &operator =(ExportFunction &&operand)
 	{
 		ordinal = operand.ordinal;
@@ -118,6 +146,9 @@ struct ExportFunction
 		nameHash = operand.nameHash;
 		address = operand.address;
 		forward = std::move(operand.forward);
+		forwardLibrary = std::move(operand.forwardLibrary);
+		forwardNameHash = operand.forwardNameHash;
+		forwardOrdinal = operand.forwardOrdinal;
 
 		return *this;
 	}
@@ -126,13 +157,37 @@ struct ExportFunction
 	uint32_t nameHash;
 	uint64_t address;
 	String forward;
+
+	//forward parsed on load. forwardNameHash is 0 if forwarded by ordinal.
+	String forwardLibrary;
+	uint32_t forwardNameHash;
+	int32_t forwardOrdinal;
+};
+
+//layout written by serializeUncompressed. unserialize reads only the latest, so a loader built earlier, like the stub in
+//StubData.h, is given images without fields it doesn't know.
+enum ImageFormat
+{
+	ImageFormatBase = 0,
+	ImageFormatBind = 1, //import bindImage, function bindImage and bindAddress
+	ImageFormatStamp = 2, //image and import timeStamp and checkSum
+	ImageFormatForwarder = 3, //export forwardLibrary, forwardNameHash and forwardOrdinal
+	ImageFormatLatest = ImageFormatForwarder,
+};
+
+//byte range of one part of serializeUncompressed output, like imports or a section's data.
+struct SerializedPart
+{
+	String name;
+	size_t offset;
+	size_t size;
 };
 
 struct Image
 {
 	Image() {}
 	Image(Image &&operand) : 
-		info(operand.info), sections(std::move(operand.sections)), 
+		arena(std::move(operand.arena)), info(operand.info), sections(std::move(operand.sections)), 
 		imports(std::move(operand.imports)), relocations(std::move(operand.relocations)),
 		fileName(std::move(operand.fileName)),
 		exports(std::move(operand.exports)), 
@@ -146,19 +201,39 @@ struct Image
 		fileName = std::move(operand.fileName);
 		exports = std::move(operand.exports);
 		header = std::move(operand.header);
+		arena = std::move(operand.arena); //last, previous members may be in previous arena.
+
+		return *this;
+	}
+	const Image &operator =(const Image &operand)
+	{
+		info = operand.info;
+		sections = operand.sections;
+		imports = operand.imports;
+		relocations = operand.relocations;
+		fileName = operand.fileName;
+		exports = operand.exports;
+		header = operand.header;
+		arena = operand.arena;
 
 		return *this;
 	}
+	SharedPtr<MemoryArena> arena; //metadata parsed together with this image. first, so it's released last.
 	ImageInfo info;
 	String fileName;
 	uint32_t nameExportLen;
 	Vector<ExportFunction> exports;
-	List<Section> sections;
-	List<Import> imports;
-	List<uint64_t> relocations;
+	Vector<Section> sections;
+	Vector<Import> imports;
+	Vector<uint64_t> relocations; //rva of each relocated word
 	SharedPtr<DataView> header;
 
-	Vector<uint8_t> serialize() const;
-	static Image unserialize(SharedPtr<DataView> data, size_t *processedSize);
+	Vector<uint8_t> serialize(ImageFormat format = ImageFormatLatest) const;
+	UniqueVector<uint8_t> serializeUncompressed(Vector<SerializedPart> *parts = nullptr, ImageFormat format = ImageFormatLatest) const; //metadata and filtered section data, before compression
+	static Vector<uint8_t> compress(const UniqueVector<uint8_t> &data);
+	static void encodeBranches(uint8_t *code, size_t size); //x86 branch filter applied to code sections on serialize
+	static void decodeBranches(uint8_t *code, size_t size);
+	static Image unserialize(SharedPtr<DataView> data, size_t *processedSize); //empty image without header and processedSize 0 if data is truncated or corrupt
+	static Image unserialize(ISeqInStream *input, size_t *processedSize); //same, decoding input as it is read in small blocks. reads whole compressed stream of this image.
 };
 
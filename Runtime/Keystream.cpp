@@ -0,0 +1,266 @@
+#include "Keystream.h"
+
+#include "../Util/CPUFeature.h"
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+//payload is obfuscated, not secret. seed travels in section name, so 8 rounds are enough.
+#define KEYSTREAM_ROUNDS 8
+#define KEYSTREAM_BLOCK_SIZE 64
+
+//state words: 4 constants, 8 key words, counter, 3 zero nonce words.
+static void initState(uint32_t seed, uint32_t *state)
+{
+	state[0] = 0x61707865; //"expand 32-byte k"
+	state[1] = 0x3320646e;
+	state[2] = 0x79622d32;
+	state[3] = 0x6b206574;
+
+	//key words are xorshift32 steps from seed. xorshift never leaves zero, so zero start is replaced.
+	uint32_t random = seed ^ 0x9e3779b9;
+	if(!random)
+		random = 0x9e3779b9;
+	for(size_t i = 0; i < 8; i ++)
+	{
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		state[4 + i] = random;
+	}
+	state[12] = state[13] = state[14] = state[15] = 0;
+}
+
+static inline uint32_t rotate(uint32_t value, int bits)
+{
+	return (value << bits) | (value >> (32 - bits));
+}
+
+#define QUARTER_ROUND(a, b, c, d) \
+	a += b; d = rotate(d ^ a, 16); \
+	c += d; b = rotate(b ^ c, 12); \
+	a += b; d = rotate(d ^ a, 8); \
+	c += d; b = rotate(b ^ c, 7);
+
+static void generateBlock(const uint32_t *state, uint32_t counter, uint8_t *output)
+{
+	uint32_t input[16], x[16];
+	for(size_t i = 0; i < 16; i ++)
+		input[i] = state[i];
+	input[12] = counter;
+	for(size_t i = 0; i < 16; i ++)
+		x[i] = input[i];
+	for(size_t i = 0; i < KEYSTREAM_ROUNDS; i += 2)
+	{
+		QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+		QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+		QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+		QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+		QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+		QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+		QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+		QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+	}
+	for(size_t i = 0; i < 16; i ++)
+	{
+		uint32_t word = x[i] + input[i];
+		output[i * 4] = static_cast<uint8_t>(word);
+		output[i * 4 + 1] = static_cast<uint8_t>(word >> 8);
+		output[i * 4 + 2] = static_cast<uint8_t>(word >> 16);
+		output[i * 4 + 3] = static_cast<uint8_t>(word >> 24);
+	}
+}
+
+#undef QUARTER_ROUND
+
+static size_t cryptBlocksScalar(const uint32_t *state, uint32_t counter, uint8_t *data, size_t blocks)
+{
+	uint8_t keystream[KEYSTREAM_BLOCK_SIZE];
+	for(size_t i = 0; i < blocks; i ++)
+	{
+		generateBlock(state, counter + static_cast<uint32_t>(i), keystream);
+		for(size_t j = 0; j < KEYSTREAM_BLOCK_SIZE; j ++)
+			data[i * KEYSTREAM_BLOCK_SIZE + j] ^= keystream[j];
+	}
+	return blocks;
+}
+
+//simd kernels run one block per lane. x[i] holds word i of every block, transposed to block order on store.
+#define QUARTER_ROUND(add, exclusiveOr, rotate, a, b, c, d) \
+	a = add(a, b); d = rotate<16>(exclusiveOr(d, a)); \
+	c = add(c, d); b = rotate<12>(exclusiveOr(b, c)); \
+	a = add(a, b); d = rotate<8>(exclusiveOr(d, a)); \
+	c = add(c, d); b = rotate<7>(exclusiveOr(b, c));
+
+#define DOUBLE_ROUND(add, exclusiveOr, rotate, x) \
+	QUARTER_ROUND(add, exclusiveOr, rotate, x[0], x[4], x[8], x[12]); \
+	QUARTER_ROUND(add, exclusiveOr, rotate, x[1], x[5], x[9], x[13]); \
+	QUARTER_ROUND(add, exclusiveOr, rotate, x[2], x[6], x[10], x[14]); \
+	QUARTER_ROUND(add, exclusiveOr, rotate, x[3], x[7], x[11], x[15]); \
+	QUARTER_ROUND(add, exclusiveOr, rotate, x[0], x[5], x[10], x[15]); \
+	QUARTER_ROUND(add, exclusiveOr, rotate, x[1], x[6], x[11], x[12]); \
+	QUARTER_ROUND(add, exclusiveOr, rotate, x[2], x[7], x[8], x[13]); \
+	QUARTER_ROUND(add, exclusiveOr, rotate, x[3], x[4], x[9], x[14]);
+
+template<int bits>
+TARGET_SSE2 inline __m128i rotateSSE2(__m128i value)
+{
+	return _mm_or_si128(_mm_slli_epi32(value, bits), _mm_srli_epi32(value, 32 - bits));
+}
+
+//4x4 transpose within each 128 bit lane. rows are words, columns are blocks.
+#define TRANSPOSE(unpackLow32, unpackHigh32, unpackLow64, unpackHigh64, r0, r1, r2, r3) \
+	{ \
+		auto t0 = unpackLow32(r0, r1); \
+		auto t1 = unpackLow32(r2, r3); \
+		auto t2 = unpackHigh32(r0, r1); \
+		auto t3 = unpackHigh32(r2, r3); \
+		r0 = unpackLow64(t0, t1); \
+		r1 = unpackHigh64(t0, t1); \
+		r2 = unpackLow64(t2, t3); \
+		r3 = unpackHigh64(t2, t3); \
+	}
+
+TARGET_SSE2 static size_t cryptBlocksSSE2(const uint32_t *state, uint32_t counter, uint8_t *data, size_t blocks)
+{
+	size_t done = 0;
+	for(; done + 4 <= blocks; done += 4, counter += 4)
+	{
+		__m128i input[16], x[16];
+		for(size_t i = 0; i < 16; i ++)
+			input[i] = _mm_set1_epi32(static_cast<int>(state[i]));
+		input[12] = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(counter)), _mm_set_epi32(3, 2, 1, 0));
+		for(size_t i = 0; i < 16; i ++)
+			x[i] = input[i];
+		for(size_t i = 0; i < KEYSTREAM_ROUNDS; i += 2)
+		{
+			DOUBLE_ROUND(_mm_add_epi32, _mm_xor_si128, rotateSSE2, x);
+		}
+		for(size_t i = 0; i < 16; i ++)
+			x[i] = _mm_add_epi32(x[i], input[i]);
+
+		//after transpose, x[g * 4 + b] is words g * 4 to g * 4 + 3 of block b.
+		for(size_t g = 0; g < 4; g ++)
+			TRANSPOSE(_mm_unpacklo_epi32, _mm_unpackhi_epi32, _mm_unpacklo_epi64, _mm_unpackhi_epi64, x[g * 4], x[g * 4 + 1], x[g * 4 + 2], x[g * 4 + 3]);
+		for(size_t b = 0; b < 4; b ++)
+			for(size_t g = 0; g < 4; g ++)
+			{
+				__m128i *target = reinterpret_cast<__m128i *>(data + (done + b) * KEYSTREAM_BLOCK_SIZE + g * 16);
+				_mm_storeu_si128(target, _mm_xor_si128(_mm_loadu_si128(target), x[g * 4 + b]));
+			}
+	}
+	return done;
+}
+
+template<int bits>
+TARGET_AVX2 inline __m256i rotateAVX2(__m256i value)
+{
+	return _mm256_or_si256(_mm256_slli_epi32(value, bits), _mm256_srli_epi32(value, 32 - bits));
+}
+
+//byte aligned rotations are a single shuffle on avx2.
+template<>
+TARGET_AVX2 inline __m256i rotateAVX2<16>(__m256i value)
+{
+	return _mm256_shuffle_epi8(value, _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2, 13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2));
+}
+
+template<>
+TARGET_AVX2 inline __m256i rotateAVX2<8>(__m256i value)
+{
+	return _mm256_shuffle_epi8(value, _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3, 14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3));
+}
+
+TARGET_AVX2 static size_t cryptBlocksAVX2(const uint32_t *state, uint32_t counter, uint8_t *data, size_t blocks)
+{
+	size_t done = 0;
+	for(; done + 8 <= blocks; done += 8, counter += 8)
+	{
+		__m256i input[16], x[16];
+		for(size_t i = 0; i < 16; i ++)
+			input[i] = _mm256_set1_epi32(static_cast<int>(state[i]));
+		input[12] = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(counter)), _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+		for(size_t i = 0; i < 16; i ++)
+			x[i] = input[i];
+		for(size_t i = 0; i < KEYSTREAM_ROUNDS; i += 2)
+		{
+			DOUBLE_ROUND(_mm256_add_epi32, _mm256_xor_si256, rotateAVX2, x);
+		}
+		for(size_t i = 0; i < 16; i ++)
+			x[i] = _mm256_add_epi32(x[i], input[i]);
+
+		//unpack works per lane, so low lane of x[g * 4 + b] ends up in block b and high lane in block b + 4.
+		for(size_t g = 0; g < 4; g ++)
+			TRANSPOSE(_mm256_unpacklo_epi32, _mm256_unpackhi_epi32, _mm256_unpacklo_epi64, _mm256_unpackhi_epi64, x[g * 4], x[g * 4 + 1], x[g * 4 + 2], x[g * 4 + 3]);
+		for(size_t b = 0; b < 4; b ++)
+			for(size_t half = 0; half < 2; half ++)
+			{
+				__m256i low = x[half * 8 + b];
+				__m256i high = x[half * 8 + 4 + b];
+				__m256i *target = reinterpret_cast<__m256i *>(data + (done + b) * KEYSTREAM_BLOCK_SIZE + half * 32);
+				_mm256_storeu_si256(target, _mm256_xor_si256(_mm256_loadu_si256(target), _mm256_permute2x128_si256(low, high, 0x20)));
+				target = reinterpret_cast<__m256i *>(data + (done + b + 4) * KEYSTREAM_BLOCK_SIZE + half * 32);
+				_mm256_storeu_si256(target, _mm256_xor_si256(_mm256_loadu_si256(target), _mm256_permute2x128_si256(low, high, 0x31)));
+			}
+	}
+	_mm256_zeroupper();
+	return done;
+}
+
+#undef TRANSPOSE
+#undef DOUBLE_ROUND
+#undef QUARTER_ROUND
+
+static KeystreamKernel resolveKernel(KeystreamKernel kernel)
+{
+	uint32_t features = getCPUFeatures();
+	if(kernel == KeystreamKernelAuto)
+		kernel = KeystreamKernelAVX2;
+	if(kernel == KeystreamKernelAVX2 && !(features & CPUFeatureAVX2))
+		kernel = KeystreamKernelSSE2;
+	if(kernel == KeystreamKernelSSE2 && !(features & CPUFeatureSSE2))
+		kernel = KeystreamKernelScalar;
+	return kernel;
+}
+
+void keystreamCrypt(uint32_t seed, size_t offset, uint8_t *data, size_t size, KeystreamKernel kernel)
+{
+	if(!size)
+		return;
+	uint32_t state[16];
+	initState(seed, state);
+	uint32_t counter = static_cast<uint32_t>(offset / KEYSTREAM_BLOCK_SIZE);
+	uint8_t keystream[KEYSTREAM_BLOCK_SIZE];
+
+	//leading part of a block when range doesn't start on block boundary
+	size_t skip = offset % KEYSTREAM_BLOCK_SIZE;
+	if(skip)
+	{
+		generateBlock(state, counter, keystream);
+		size_t count = KEYSTREAM_BLOCK_SIZE - skip;
+		if(count > size)
+			count = size;
+		for(size_t i = 0; i < count; i ++)
+			data[i] ^= keystream[skip + i];
+		data += count;
+		size -= count;
+		counter ++;
+	}
+
+	size_t blocks = size / KEYSTREAM_BLOCK_SIZE;
+	size_t done = 0;
+	kernel = resolveKernel(kernel);
+	if(kernel == KeystreamKernelAVX2)
+		done = cryptBlocksAVX2(state, counter, data, blocks);
+	if(kernel == KeystreamKernelAVX2 || kernel == KeystreamKernelSSE2)
+		done += cryptBlocksSSE2(state, counter + static_cast<uint32_t>(done), data + done * KEYSTREAM_BLOCK_SIZE, blocks - done);
+	done += cryptBlocksScalar(state, counter + static_cast<uint32_t>(done), data + done * KEYSTREAM_BLOCK_SIZE, blocks - done);
+
+	size_t remaining = size - blocks * KEYSTREAM_BLOCK_SIZE;
+	if(remaining)
+	{
+		generateBlock(state, counter + static_cast<uint32_t>(blocks), keystream);
+		for(size_t i = 0; i < remaining; i ++)
+			data[blocks * KEYSTREAM_BLOCK_SIZE + i] ^= keystream[i];
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+enum KeystreamKernel
+{
+	KeystreamKernelAuto, //best one cpu supports
+	KeystreamKernelScalar,
+	KeystreamKernelSSE2,
+	KeystreamKernelAVX2,
+};
+
+//counter based keystream cipher, chacha with 8 rounds keyed by a 32 bit seed.
+//byte at offset n is xored with keystream byte n, so crypt and decrypt are the same call
+//and any range can be processed independently, by simd kernels or from several threads.
+//block counter is 32 bits, which covers 256GB. kernel cpu lacks falls back to next best one.
+void keystreamCrypt(uint32_t seed, size_t offset, uint8_t *data, size_t size, KeystreamKernel kernel = KeystreamKernelAuto);
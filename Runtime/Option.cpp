@@ -9,6 +9,8 @@ Option::Option(const List<String> &args)
 
 bool Option::isBooleanOption(const String &optionName)
 {
+	if(optionName == "prebind")
+		return true;
 	return false;
 }
 
@@ -16,6 +18,8 @@ void Option::handleStringOption(const String &name, const String &value)
 {
 	if(name == "o")
 		outputFile_ = File::open(value, true);
+	else
+		stringOptions_[name] = value;
 }
 
 void Option::parseOptions(List<String> rawOptions)
@@ -50,3 +54,19 @@ SharedPtr<File> Option::getOutputFile() const
 {
 	return outputFile_;
 }
+
+bool Option::getBooleanOption(const String &name) const
+{
+	auto it = booleanOptions_.find(name);
+	if(it != booleanOptions_.end())
+		return it->value;
+	return false;
+}
+
+String Option::getStringOption(const String &name) const
+{
+	auto it = stringOptions_.find(name);
+	if(it != stringOptions_.end())
+		return it->value;
+	return String();
+}
@@ -22,4 +22,6 @@ public:
 
 	SharedPtr<File> getInputFile() const;
 	SharedPtr<File> getOutputFile() const;
+	bool getBooleanOption(const String &name) const;
+	String getStringOption(const String &name) const; //empty if not given
 };
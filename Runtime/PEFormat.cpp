@@ -4,6 +4,8 @@
 #include "PEHeader.h"
 #include "../Util/Util.h"
 #include "../Util/Map.h"
+#include "../Util/HashMap.h"
+#include "../Util/Checksum.h"
 
 #ifdef _WIN32
 #include "../Win32/Win32NativeHelper.h" //for path search.
@@ -15,7 +17,7 @@ inline T *getStructureAtOffset(uint8_t *data, size_t offset)
 	return reinterpret_cast<T *>(data + offset);
 }
 
-PEFormat::PEFormat() : processedExport_(false), processedImport_(false), processedRelocation_(false)
+PEFormat::PEFormat() : arena_(MakeShared<MemoryArena>()), dataDirectoryBase_(0), dataDirectoryCount_(0), readBudget_(0), fromMemory_(false), processedExport_(false), processedImport_(false), processedRelocation_(false)
 {
 	
 }
@@ -27,6 +29,7 @@ PEFormat::~PEFormat()
 
 bool PEFormat::load(SharedPtr<DataSource> source, bool fromMemory)
 {
+	ArenaScope scope(arena_.get());
 	size_t headerSize = loadHeader(source, fromMemory);
 	if(headerSize == 0)
 		return false;
@@ -44,12 +47,24 @@ size_t PEFormat::loadHeader(SharedPtr<DataSource> source, bool fromMemory)
 	IMAGE_DATA_DIRECTORY *dataDirectory = nullptr;
 	size_t offset;
 	size_t headerSize;
+	size_t directoryOffset; //of data directory in optional header
+	uint32_t numberOfDirectories;
 	SharedPtr<DataView> view = source->getView(0, 0);
 	uint8_t *data = view->get();
-
+	//0 if source doesn't know its size, like files and images in memory. header is trusted then.
+	size_t sourceSize = view->size();
+	auto isInSource = [&](size_t start, size_t size) {
+		return !sourceSize || (start <= sourceSize && sourceSize - start >= size);
+	};
+	fromMemory_ = fromMemory;
+
+	if(!isInSource(0, sizeof(IMAGE_DOS_HEADER)))
+		return 0;
 	dosHeader = getStructureAtOffset<IMAGE_DOS_HEADER>(data, 0);
 	if(!dosHeader->e_lfanew)
 		return 0; //not PE
+	if(!isInSource(dosHeader->e_lfanew, sizeof(uint32_t) + sizeof(IMAGE_FILE_HEADER) + sizeof(IMAGE_OPTIONAL_HEADER_BASE)))
+		return 0;
 
 	ntSignature = getStructureAtOffset<uint32_t>(data, dosHeader->e_lfanew);
 	if(*ntSignature != IMAGE_NT_SIGNATURE)
@@ -59,35 +74,68 @@ size_t PEFormat::loadHeader(SharedPtr<DataSource> source, bool fromMemory)
 
 	offset = dosHeader->e_lfanew + sizeof(uint32_t) + sizeof(IMAGE_FILE_HEADER);
 	info_.entryPoint = optionalHeaderBase->AddressOfEntryPoint;
+	info_.timeStamp = fileHeader->TimeDateStamp;
 	info_.flag = 0;
 	if(fileHeader->Characteristics & IMAGE_FILE_DLL)
 		info_.flag |= ImageFlagLibrary;
 
 	if(optionalHeaderBase->Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
 	{
+		if(!isInSource(offset, sizeof(IMAGE_OPTIONAL_HEADER32)))
+			return 0;
 		IMAGE_OPTIONAL_HEADER32 *optionalHeader = getStructureAtOffset<IMAGE_OPTIONAL_HEADER32>(data, offset);
 		dataDirectory = optionalHeader->DataDirectory;
 		dataDirectoryBase_ = reinterpret_cast<uint8_t *>(dataDirectory) - data;
+		directoryOffset = reinterpret_cast<uint8_t *>(dataDirectory) - reinterpret_cast<uint8_t *>(optionalHeader);
+		numberOfDirectories = optionalHeader->NumberOfRvaAndSizes;
 		info_.baseAddress = optionalHeader->ImageBase;
 		info_.size = optionalHeader->SizeOfImage;
 		info_.architecture = ArchitectureWin32;
+		info_.checkSum = optionalHeader->CheckSum;
 		headerSize = optionalHeader->SizeOfHeaders;
 	}
 	else if(optionalHeaderBase->Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
 	{
+		if(!isInSource(offset, sizeof(IMAGE_OPTIONAL_HEADER64)))
+			return 0;
 		IMAGE_OPTIONAL_HEADER64 *optionalHeader = getStructureAtOffset<IMAGE_OPTIONAL_HEADER64>(data, offset);
 		dataDirectory = optionalHeader->DataDirectory;
 		dataDirectoryBase_ = reinterpret_cast<uint8_t *>(dataDirectory) - data;
+		directoryOffset = reinterpret_cast<uint8_t *>(dataDirectory) - reinterpret_cast<uint8_t *>(optionalHeader);
+		numberOfDirectories = optionalHeader->NumberOfRvaAndSizes;
 		info_.baseAddress = optionalHeader->ImageBase;
 		info_.size = optionalHeader->SizeOfImage;
 		headerSize = optionalHeader->SizeOfHeaders;
+		info_.checkSum = optionalHeader->CheckSum;
 		info_.architecture = ArchitectureWin32AMD64;
 	}
+	else
+		return 0; //unknown optional header
+
+	//directories past NumberOfRvaAndSizes or optional header size aren't there.
+	dataDirectoryCount_ = 0;
+	if(fileHeader->SizeOfOptionalHeader > directoryOffset)
+		dataDirectoryCount_ = (fileHeader->SizeOfOptionalHeader - directoryOffset) / sizeof(IMAGE_DATA_DIRECTORY);
+	if(dataDirectoryCount_ > numberOfDirectories)
+		dataDirectoryCount_ = numberOfDirectories;
+	if(dataDirectoryCount_ > IMAGE_NUMBEROF_DIRECTORY_ENTRIES)
+		dataDirectoryCount_ = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+	if(sourceSize && headerSize > sourceSize)
+		headerSize = sourceSize;
+	if(dataDirectoryBase_ + dataDirectoryCount_ * sizeof(IMAGE_DATA_DIRECTORY) > headerSize)
+		dataDirectoryCount_ = dataDirectoryBase_ < headerSize ? (headerSize - dataDirectoryBase_) / sizeof(IMAGE_DATA_DIRECTORY) : 0;
 	offset += fileHeader->SizeOfOptionalHeader;
 
+	if(!isInSource(offset, fileHeader->NumberOfSections * sizeof(IMAGE_SECTION_HEADER)))
+		return 0;
 	IMAGE_SECTION_HEADER *sectionHeaders = getStructureAtOffset<IMAGE_SECTION_HEADER>(data, offset);
+	sections_.reserve(fileHeader->NumberOfSections);
 	for(int i = 0; i < fileHeader->NumberOfSections; i ++)
 	{
+		//loader requires ascending addresses. rva lookup relies on it for binary search.
+		if(i && sectionHeaders[i].VirtualAddress < sectionHeaders[i - 1].VirtualAddress)
+			return 0;
+
 		Section section;
 		section.baseAddress = sectionHeaders[i].VirtualAddress;
 		section.name.assign(sectionHeaders[i].Name, sectionHeaders[i].Name + 8);
@@ -107,39 +155,105 @@ size_t PEFormat::loadHeader(SharedPtr<DataSource> source, bool fromMemory)
 		if(sectionHeaders[i].Characteristics & IMAGE_SCN_MEM_EXECUTE)
 			section.flag |= SectionFlagExecute;
 
-		if(!fromMemory)
-			section.data = source->getView(sectionHeaders[i].PointerToRawData, sectionHeaders[i].SizeOfRawData);
-		else
-			section.data = source->getView(sectionHeaders[i].VirtualAddress, sectionHeaders[i].SizeOfRawData);
+		size_t rawOffset = fromMemory ? sectionHeaders[i].VirtualAddress : sectionHeaders[i].PointerToRawData;
+		size_t rawSize = sectionHeaders[i].SizeOfRawData;
+		if(sourceSize)
+		{
+			if(rawOffset > sourceSize)
+				rawOffset = sourceSize;
+			if(rawSize > sourceSize - rawOffset)
+				rawSize = sourceSize - rawOffset;
+		}
+		//not through getView(), memory source would take size 0 as whole memory.
+		section.data = MakeShared<DataView>(source, rawOffset, rawSize);
 
 		sections_.push_back(std::move(section));
 	}
 
-	uint8_t *loadConfig = getDataPointerOfRVA(dataDirectory[IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG].VirtualAddress);
+	info_.platformData = 0;
+	info_.platformData1 = 0;
+	size_t loadConfigSize;
+	uint8_t *loadConfig = nullptr;
+	if(dataDirectoryCount_ > IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG)
+		loadConfig = getDataPointerOfRVA(dataDirectory[IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG].VirtualAddress, &loadConfigSize);
 	if(loadConfig)
 	{
-		if(info_.architecture == ArchitectureWin32)
+		if(info_.architecture == ArchitectureWin32 && loadConfigSize >= sizeof(IMAGE_LOAD_CONFIG_DIRECTORY32))
 			info_.platformData = reinterpret_cast<IMAGE_LOAD_CONFIG_DIRECTORY32 *>(loadConfig)->SecurityCookie;
-		else
+		else if(info_.architecture == ArchitectureWin32AMD64 && loadConfigSize >= sizeof(IMAGE_LOAD_CONFIG_DIRECTORY64))
 			info_.platformData = reinterpret_cast<IMAGE_LOAD_CONFIG_DIRECTORY64 *>(loadConfig)->SecurityCookie;
 	}
-	else
-		info_.platformData = 0;
-	info_.platformData1 = dataDirectory[IMAGE_DIRECTORY_ENTRY_TLS].VirtualAddress;
+	if(dataDirectoryCount_ > IMAGE_DIRECTORY_ENTRY_TLS)
+		info_.platformData1 = dataDirectory[IMAGE_DIRECTORY_ENTRY_TLS].VirtualAddress;
 
 	return headerSize;
 }
 
-uint8_t *PEFormat::getDataPointerOfRVA(uint32_t rva)
+size_t PEFormat::getSectionDataSize(const Section &section) const
+{
+	//loaded image has whole virtual size mapped, file only has raw data.
+	if(fromMemory_ && section.size > section.data->size())
+		return static_cast<size_t>(section.size);
+	return section.data->size();
+}
+
+uint8_t *PEFormat::getDataPointerOfRVA(uint32_t rva, size_t *available)
 {
-	for(auto &section : sections_)
-		if(rva >= section.baseAddress && rva < section.baseAddress + section.size)
-			return section.data->get() + rva - section.baseAddress;
-	return nullptr;
+	auto it = binarySearch(sections_.begin(), sections_.end(), [&](const Section *section) -> int {
+		if(rva < section->baseAddress)
+			return 1;
+		if(rva - section->baseAddress >= getSectionDataSize(*section))
+			return -1;
+		return 0;
+	});
+	if(it == sections_.end())
+		return nullptr;
+	size_t offset = static_cast<size_t>(rva - it->baseAddress);
+	if(available)
+		*available = getSectionDataSize(*it) - offset;
+	return it->data->get() + offset;
+}
+
+String PEFormat::readStringOfRVA(uint32_t rva)
+{
+	size_t available;
+	const uint8_t *data = getDataPointerOfRVA(rva, &available);
+	if(!data)
+		return String();
+	if(available > readBudget_)
+		available = readBudget_;
+	size_t length = 0;
+	while(length < available && data[length])
+		length ++;
+	consumeReadBudget(length + 1);
+	return String(data, data + length);
+}
+
+//metadata of a well formed image is read once, so its parse reads at most header and section bytes.
+void PEFormat::resetReadBudget()
+{
+	readBudget_ = header_->size();
+	for(auto &i : sections_)
+		readBudget_ += getSectionDataSize(i);
+}
+
+bool PEFormat::consumeReadBudget(size_t size)
+{
+	if(readBudget_ < size)
+	{
+		readBudget_ = 0;
+		return false;
+	}
+	readBudget_ -= size;
+	return true;
 }
 
 IMAGE_DATA_DIRECTORY *PEFormat::getDataDirectory(size_t index)
 {
+	//absent directory reads as empty one.
+	static IMAGE_DATA_DIRECTORY empty;
+	if(index >= dataDirectoryCount_)
+		return &empty;
 	uint8_t *headerBase = header_->get();
 	IMAGE_DATA_DIRECTORY *dataDirectory = reinterpret_cast<IMAGE_DATA_DIRECTORY *>(headerBase + dataDirectoryBase_);
 	return dataDirectory + index;
@@ -149,13 +263,20 @@ void PEFormat::processRelocation()
 {
 	IMAGE_DATA_DIRECTORY *relocationDirectory = getDataDirectory(IMAGE_DIRECTORY_ENTRY_BASERELOC);
 	size_t relocationSize = relocationDirectory->Size;
-	IMAGE_BASE_RELOCATION *info = reinterpret_cast<IMAGE_BASE_RELOCATION *>(getDataPointerOfRVA(relocationDirectory->VirtualAddress));
+	size_t available;
+	uint8_t *data = getDataPointerOfRVA(relocationDirectory->VirtualAddress, &available);
 
-	if(!info)
+	if(!data || !relocationSize)
 		return;
-	while(true)
+	if(relocationSize > available)
+		relocationSize = available;
+	//each entry takes 2 bytes, so this is an upper bound.
+	relocations_.reserve(relocationSize / sizeof(uint16_t));
+	size_t offset = 0;
+	while(relocationSize - offset >= sizeof(IMAGE_BASE_RELOCATION))
 	{
-		if(reinterpret_cast<size_t>(info) >= reinterpret_cast<size_t>(info) + relocationSize || info->SizeOfBlock == 0)
+		IMAGE_BASE_RELOCATION *info = reinterpret_cast<IMAGE_BASE_RELOCATION *>(data + offset);
+		if(info->SizeOfBlock < sizeof(IMAGE_BASE_RELOCATION) || info->SizeOfBlock > relocationSize - offset)
 			break;
 		uint16_t *ptr = reinterpret_cast<uint16_t *>(info + 1);
 		for(size_t i = 0; i < (info->SizeOfBlock - sizeof(IMAGE_BASE_RELOCATION)) / sizeof(uint16_t); i ++)
@@ -167,33 +288,39 @@ void PEFormat::processRelocation()
 			relocations_.push_back(static_cast<uint64_t>(info->VirtualAddress) + offset);
 			ptr ++;
 		}
-		info = reinterpret_cast<IMAGE_BASE_RELOCATION *>(reinterpret_cast<uint8_t *>(info) + info->SizeOfBlock);
+		offset += info->SizeOfBlock;
 	}
 }
 
 void PEFormat::processImport()
 {
 	IMAGE_DATA_DIRECTORY *importDirectory = getDataDirectory(IMAGE_DIRECTORY_ENTRY_IMPORT);
-	IMAGE_IMPORT_DESCRIPTOR *descriptor = reinterpret_cast<IMAGE_IMPORT_DESCRIPTOR *>(getDataPointerOfRVA(importDirectory->VirtualAddress));
+	size_t available;
+	IMAGE_IMPORT_DESCRIPTOR *descriptor = reinterpret_cast<IMAGE_IMPORT_DESCRIPTOR *>(getDataPointerOfRVA(importDirectory->VirtualAddress, &available));
 
 	if(!descriptor)
 		return;
-	while(true)
+	resetReadBudget();
+	size_t descriptorCount = available / sizeof(IMAGE_IMPORT_DESCRIPTOR);
+	imports_.reserve((importDirectory->Size < available ? importDirectory->Size : available) / sizeof(IMAGE_IMPORT_DESCRIPTOR));
+	size_t entrySize = info_.architecture == ArchitectureWin32AMD64 ? sizeof(uint64_t) : sizeof(uint32_t);
+	for(; descriptorCount > 0 && consumeReadBudget(sizeof(IMAGE_IMPORT_DESCRIPTOR)); descriptorCount --, descriptor ++)
 	{
 		if(descriptor->OriginalFirstThunk == 0)
 			break;
 
 		Import import;
 
-		uint8_t *libraryNamePtr = getDataPointerOfRVA(descriptor->Name);
-		import.libraryName.assign(reinterpret_cast<const char *>(libraryNamePtr));
+		import.libraryName = readStringOfRVA(descriptor->Name);
 
-		uint32_t *nameEntryPtr = reinterpret_cast<uint32_t *>(getDataPointerOfRVA(descriptor->OriginalFirstThunk));
+		size_t entryCount = 0;
+		uint32_t *nameEntryPtr = reinterpret_cast<uint32_t *>(getDataPointerOfRVA(descriptor->OriginalFirstThunk, &entryCount));
+		entryCount /= entrySize;
 		uint64_t iat = descriptor->FirstThunk;
 
-		while(true)
+		for(; entryCount > 0 && consumeReadBudget(entrySize); entryCount --)
 		{
-			if(*nameEntryPtr == 0)
+			if(*nameEntryPtr == 0 && (entrySize == sizeof(uint32_t) || nameEntryPtr[1] == 0))
 				break;
 
 			ImportFunction function;
@@ -209,13 +336,14 @@ void PEFormat::processImport()
 			}
 			else
 			{
-				IMAGE_IMPORT_BY_NAME *nameEntry;
+				//IMAGE_IMPORT_BY_NAME, name follows 2 byte hint.
+				uint32_t nameEntry;
 				if(info_.architecture == ArchitectureWin32AMD64)
-					nameEntry = reinterpret_cast<IMAGE_IMPORT_BY_NAME *>(getDataPointerOfRVA(static_cast<uint32_t>(*reinterpret_cast<uint64_t *>(nameEntryPtr))));
+					nameEntry = static_cast<uint32_t>(*reinterpret_cast<uint64_t *>(nameEntryPtr));
 				else
-					nameEntry = reinterpret_cast<IMAGE_IMPORT_BY_NAME *>(getDataPointerOfRVA(*reinterpret_cast<uint32_t *>(nameEntryPtr)));
+					nameEntry = *reinterpret_cast<uint32_t *>(nameEntryPtr);
 
-				function.name.assign(reinterpret_cast<const char *>(nameEntry->Name));
+				function.name = readStringOfRVA(nameEntry + sizeof(uint16_t));
 				function.nameHash = fnv1a(function.name.c_str(), function.name.length());
 			}
 
@@ -234,44 +362,72 @@ void PEFormat::processImport()
 		}
 
 		imports_.push_back(std::move(import));
-
-		descriptor ++;
 	}
 }
 
 String PEFormat::checkExportForwarder(uint64_t address, size_t exportTableBase, size_t exportTableSize)
 {
 	if(address >= exportTableBase && address < exportTableBase + exportTableSize)
-		for(auto &i : sections_)
-			if(address >= i.baseAddress && address < i.baseAddress + i.size)
-				return String(reinterpret_cast<const char *>(i.data->get() + static_cast<uint32_t>(address - i.baseAddress)));
+		return readStringOfRVA(static_cast<uint32_t>(address));
 	return String();
 }
 
+void parseExportForwarder(ExportFunction &entry)
+{
+	if(!entry.forward.length())
+		return;
+	int point = entry.forward.find('.');
+	if(point == -1)
+		return;
+	entry.forwardLibrary = entry.forward.substr(0, point) + ".dll";
+	if(entry.forward[point + 1] == '#')
+		entry.forwardOrdinal = StringToInt(entry.forward.substr(point + 2));
+	else
+		entry.forwardNameHash = fnv1a(entry.forward.c_str() + point + 1, entry.forward.length() - point - 1);
+}
+
 void PEFormat::processExport()
 {
 	IMAGE_DATA_DIRECTORY *exportDirectory = getDataDirectory(IMAGE_DIRECTORY_ENTRY_EXPORT);
-	IMAGE_EXPORT_DIRECTORY *directory = reinterpret_cast<IMAGE_EXPORT_DIRECTORY *>(getDataPointerOfRVA(exportDirectory->VirtualAddress));
+	size_t available;
+	IMAGE_EXPORT_DIRECTORY *directory = reinterpret_cast<IMAGE_EXPORT_DIRECTORY *>(getDataPointerOfRVA(exportDirectory->VirtualAddress, &available));
 
 	size_t exportTableBase = exportDirectory->VirtualAddress;
 	size_t exportTableSize = exportDirectory->Size;
 
-	if(!directory)
+	if(!directory || available < sizeof(IMAGE_EXPORT_DIRECTORY))
+		return;
+	resetReadBudget();
+
+	//counts are clamped to the tables actually present.
+	size_t functionsAvailable = 0, namesAvailable = 0, ordinalsAvailable = 0;
+	uint32_t *addressOfFunctions = reinterpret_cast<uint32_t *>(getDataPointerOfRVA(directory->AddressOfFunctions, &functionsAvailable));
+	uint32_t *addressOfNames = reinterpret_cast<uint32_t *>(getDataPointerOfRVA(directory->AddressOfNames, &namesAvailable));
+	uint16_t *ordinals = reinterpret_cast<uint16_t *>(getDataPointerOfRVA(directory->AddressOfNameOrdinals, &ordinalsAvailable));
+	size_t numberOfFunctions = directory->NumberOfFunctions;
+	if(numberOfFunctions > functionsAvailable / sizeof(uint32_t))
+		numberOfFunctions = functionsAvailable / sizeof(uint32_t);
+	size_t numberOfNames = directory->NumberOfNames;
+	if(numberOfNames > ordinalsAvailable / sizeof(uint16_t))
+		numberOfNames = ordinalsAvailable / sizeof(uint16_t);
+	if(addressOfNames && numberOfNames > namesAvailable / sizeof(uint32_t))
+		numberOfNames = namesAvailable / sizeof(uint32_t);
+	if(!numberOfFunctions)
 		return;
 
-	bool *checker = new bool[directory->NumberOfFunctions];
-	for(size_t i = 0; i < directory->NumberOfFunctions; i ++)
+	exports_.reserve(numberOfFunctions);
+	bool *checker = new bool[numberOfFunctions];
+	for(size_t i = 0; i < numberOfFunctions; i ++)
 		checker[i] = false;
 
-	uint32_t *addressOfFunctions = reinterpret_cast<uint32_t *>(getDataPointerOfRVA(directory->AddressOfFunctions));
-	uint32_t *addressOfNames = reinterpret_cast<uint32_t *>(getDataPointerOfRVA(directory->AddressOfNames));
-	uint16_t *ordinals = reinterpret_cast<uint16_t *>(getDataPointerOfRVA(directory->AddressOfNameOrdinals));
-	for(size_t i = 0; i < directory->NumberOfNames; i ++)
+	for(size_t i = 0; i < numberOfNames && consumeReadBudget(sizeof(uint32_t) + sizeof(uint16_t)); i ++)
 	{
+		if(ordinals[i] >= numberOfFunctions)
+			continue;
 		ExportFunction entry;
 		if(addressOfNames && addressOfNames[i])
 		{
-			entry.name.assign(reinterpret_cast<const char *>(getDataPointerOfRVA(addressOfNames[i])));
+			entry.name = readStringOfRVA(addressOfNames[i]);
 			entry.nameHash = fnv1a(entry.name.c_str(), entry.name.length());
 		}
 
@@ -280,11 +436,12 @@ void PEFormat::processExport()
 		checker[entry.ordinal] = true;
 		entry.ordinal += directory->Base;
 		entry.forward = checkExportForwarder(entry.address, exportTableBase, exportTableSize);
+		parseExportForwarder(entry);
 
 		exports_.push_back(std::move(entry));
 	}
 
-	for(size_t i = 0; i < directory->NumberOfFunctions; i ++)
+	for(size_t i = 0; i < numberOfFunctions && consumeReadBudget(sizeof(uint32_t)); i ++)
 	{
 		if(checker[i] == true)
 			continue;
@@ -293,6 +450,7 @@ void PEFormat::processExport()
 		entry.ordinal = i + directory->Base;
 		entry.address = addressOfFunctions[i];
 		entry.forward = checkExportForwarder(entry.address, exportTableBase, exportTableSize);
+		parseExportForwarder(entry);
 
 		exports_.push_back(std::move(entry));
 	}
@@ -319,21 +477,23 @@ const String &PEFormat::getFilePath() const
 	return filePath_;
 }
 
-const List<Import> &PEFormat::getImports()
+const Vector<Import> &PEFormat::getImports()
 {
 	if(processedImport_ == false)
 	{
 		processedImport_ = true;
+		ArenaScope scope(arena_.get());
 		processImport();
 	}
 	return imports_;
 }
 
-const List<ExportFunction> &PEFormat::getExports()
+const UniqueVector<ExportFunction> &PEFormat::getExports()
 {
 	if(processedExport_ == false)
 	{
 		processedExport_ = true;
+		ArenaScope scope(arena_.get());
 		processExport();
 	}
 	return exports_;
@@ -344,18 +504,19 @@ const ImageInfo &PEFormat::getInfo() const
 	return info_;
 }
 
-const List<uint64_t> &PEFormat::getRelocations()
+const Vector<uint64_t> &PEFormat::getRelocations()
 {
 	if(processedRelocation_ == false)
 	{
 		processedRelocation_ = true;
+		ArenaScope scope(arena_.get());
 		processRelocation();
 	}
 
 	return relocations_;
 }
 
-const List<Section> &PEFormat::getSections() const
+const Vector<Section> &PEFormat::getSections() const
 {
 	return sections_;
 }
@@ -366,24 +527,26 @@ Image PEFormat::toImage()
 	getExports();
 	getRelocations();
 
+	ArenaScope scope(arena_.get());
 	Image image;
+	image.arena = arena_;
 	image.fileName = getFileName();
 	image.info = info_;
 	image.imports = std::move(imports_);
 	image.sections = std::move(sections_);
 	image.relocations = std::move(relocations_);
 	image.header = std::move(header_);
-	image.exports.assign_move(exports_.begin(), exports_.end());
+	image.exports = Vector<ExportFunction>(std::move(exports_));
 
 	return image;
 }
 
-void PEFormat::setSections(const List<Section> &sections)
+void PEFormat::setSections(const Vector<Section> &sections)
 {
 	sections_ = sections;
 }
 
-void PEFormat::setRelocations(const List<uint64_t> &relocations)
+void PEFormat::setRelocations(const Vector<uint64_t> &relocations)
 {
 	relocations_ = relocations;
 }
@@ -444,8 +607,15 @@ void PEFormat::save(SharedPtr<DataSource> target)
 	}
 
 	//2. Write headers
+	//CheckSum is summed as zero while each part is written, then filled in at the end.
 	uint8_t *originalHeader = header_->get();
 	uint8_t *targetMap = target->map(0);
+	uint32_t checkSum = 0;
+	auto write = [&](size_t writeOffset, const void *source, size_t size) {
+		copyMemory(targetMap + writeOffset, source, size);
+		checkSum = updatePEChecksum(checkSum, writeOffset, reinterpret_cast<const uint8_t *>(source), size);
+	};
+
 	IMAGE_DOS_HEADER *dosHeader = getStructureAtOffset<IMAGE_DOS_HEADER>(originalHeader, 0);
 	IMAGE_FILE_HEADER fileHeader;
 	IMAGE_OPTIONAL_HEADER_BASE optionalHeaderBase;
@@ -457,10 +627,11 @@ void PEFormat::save(SharedPtr<DataSource> target)
 	fileHeader.NumberOfSections = sections_.size();
 
 	size_t offset = 0;
-	copyMemory(targetMap, originalHeader, dosHeader->e_lfanew); offset += dosHeader->e_lfanew;
-	copyMemory(targetMap + offset, &ntSignature, sizeof(ntSignature)); offset += sizeof(ntSignature);
-	copyMemory(targetMap + offset, &fileHeader, sizeof(IMAGE_FILE_HEADER)); offset += sizeof(IMAGE_FILE_HEADER);
+	write(offset, originalHeader, dosHeader->e_lfanew); offset += dosHeader->e_lfanew;
+	write(offset, &ntSignature, sizeof(ntSignature)); offset += sizeof(ntSignature);
+	write(offset, &fileHeader, sizeof(IMAGE_FILE_HEADER)); offset += sizeof(IMAGE_FILE_HEADER);
 
+	size_t checkSumOffset = 0;
 	if(info_.architecture == ArchitectureWin32)
 	{
 		IMAGE_OPTIONAL_HEADER32 optionalHeader;
@@ -468,30 +639,48 @@ void PEFormat::save(SharedPtr<DataSource> target)
 		optionalHeader.SizeOfImage = imageSize;
 		optionalHeader.FileAlignment = fileAlignment;
 		optionalHeader.SectionAlignment = sectionAlignment;
+		optionalHeader.CheckSum = 0;
+		checkSumOffset = offset + offsetof(IMAGE_OPTIONAL_HEADER32, CheckSum);
 
-		copyMemory(targetMap + offset, &optionalHeader, sizeof(IMAGE_OPTIONAL_HEADER32)); offset += sizeof(IMAGE_OPTIONAL_HEADER32);
+		write(offset, &optionalHeader, sizeof(IMAGE_OPTIONAL_HEADER32)); offset += sizeof(IMAGE_OPTIONAL_HEADER32);
 	}
 	else if(info_.architecture == ArchitectureWin32AMD64)
 	{
 		IMAGE_OPTIONAL_HEADER64 optionalHeader;
 		copyMemory(&optionalHeader, getStructureAtOffset<IMAGE_OPTIONAL_HEADER64>(originalHeader, offset), sizeof(IMAGE_OPTIONAL_HEADER64));
-		optionalHeader.SizeOfImage = sectionAlignment;
+		optionalHeader.SizeOfImage = imageSize;
 		optionalHeader.FileAlignment = fileAlignment;
 		optionalHeader.SectionAlignment = sectionAlignment;
+		optionalHeader.CheckSum = 0;
+		checkSumOffset = offset + offsetof(IMAGE_OPTIONAL_HEADER64, CheckSum);
 
-		copyMemory(targetMap + offset, &optionalHeader, sizeof(IMAGE_OPTIONAL_HEADER64)); offset += sizeof(IMAGE_OPTIONAL_HEADER64);
+		write(offset, &optionalHeader, sizeof(IMAGE_OPTIONAL_HEADER64)); offset += sizeof(IMAGE_OPTIONAL_HEADER64);
 	}
 	
 	for(auto &i : sectionHeaders)
 	{
-		copyMemory(targetMap + offset, &i, sizeof(IMAGE_SECTION_HEADER)); 
+		write(offset, &i, sizeof(IMAGE_SECTION_HEADER)); 
 		offset += sizeof(IMAGE_SECTION_HEADER);
 	}
+	//padding is zeroed, as target may be a reused buffer and checksum covers it.
+	if(offset < 0x400)
+		zeroMemory(targetMap + offset, 0x400 - offset);
 
+	//3. Write sections
+	uint32_t fileSize = dataOffset;
 	for(auto &i : sections_)
 	{
 		dataOffset = rawDataMap[static_cast<uint32_t>(i.baseAddress)];
-		copyMemory(targetMap + dataOffset, i.data->get(), i.data->size());
+		write(dataOffset, i.data->get(), i.data->size());
+		size_t rawSize = multipleOf(i.data->size(), fileAlignment);
+		if(rawSize > i.data->size())
+			zeroMemory(targetMap + dataOffset + i.data->size(), rawSize - i.data->size());
+	}
+
+	if(checkSumOffset)
+	{
+		checkSum = finishPEChecksum(checkSum, fileSize);
+		copyMemory(targetMap + checkSumOffset, &checkSum, sizeof(checkSum));
 	}
 
 	target->unmap();
@@ -499,11 +688,14 @@ void PEFormat::save(SharedPtr<DataSource> target)
 
 bool PEFormat::isSystemLibrary(const String &filename)
 {
-	if(filename.substr(0, 4).icompare("api-") == 0)
+	if(filename.view(0, 4).icompare("api-") == 0)
 		return true;
-	const char *systemFiles[] = {"kernel32.dll", "user32.dll", "gdi32.dll", "ntdll.dll", "kernelbase.dll", "shell32.dll", nullptr};
-	for(int i = 0; systemFiles[i] != nullptr; i ++)
-		if(filename.icompare(systemFiles[i]) == 0)
+	//hashes of names, which are compared on a hit so a colliding bundled library still gets bundled.
+	const char *systemFiles[] = {"kernel32.dll", "user32.dll", "gdi32.dll", "ntdll.dll", "kernelbase.dll", "shell32.dll"};
+	const uint32_t systemFileHashes[] = {0xa3e6f6c3, 0xc0323159, 0x8b4d9112, 0xa62a3b3b, 0xbd6d9917, 0x4f644736};
+	uint32_t hash = CaseInsensitiveStringHasher<String>::hash(filename);
+	for(size_t i = 0; i < sizeof(systemFileHashes) / sizeof(systemFileHashes[0]); i ++)
+		if(hash == systemFileHashes[i] && filename.icompare(systemFiles[i]) == 0)
 			return true;
 	return false;
 }
@@ -515,7 +707,7 @@ SharedPtr<FormatBase> loadImport(const String &path, int architecture)
 	if(Win32NativeHelper::get()->isWoW64())
 	{
 		String system32Directory = Win32NativeHelper::get()->getSystem32Directory();
-		if(architecture == ArchitectureWin32 && path.substr(0, system32Directory.length()).icompare(system32Directory) == 0)
+		if(architecture == ArchitectureWin32 && path.view(0, system32Directory.length()).icompare(system32Directory) == 0)
 			newPath = Win32NativeHelper::get()->getSysWOW64Directory() + "\\" + path.substr(system32Directory.length() + 1);
 	}
 #endif
@@ -538,9 +730,9 @@ SharedPtr<FormatBase> FormatBase::loadImport(const String &filename, int archite
 		return ::loadImport(filename, architecture);
 
 	List<String> searchPaths;
+#ifdef _WIN32
 	String currentDirectory = WStringToString(Win32NativeHelper::get()->getCurrentDirectory());
 	searchPaths.push_back(currentDirectory.substr(0, currentDirectory.length() - 1));
-#ifdef _WIN32
 	wchar_t *environmentBlock = Win32NativeHelper::get()->getEnvironments();
 	WString path;
 	while(*environmentBlock)
@@ -582,7 +774,7 @@ SharedPtr<FormatBase> FormatBase::loadImport(const String &filename, int archite
 		SharedPtr<FormatBase> result = ::loadImport(path, architecture);
 		if(!result)
 		{
-			if(path.substr(path.length() - 4).icompare(".dll") != 0)
+			if(path.view(path.length() - 4).icompare(".dll") != 0)
 			{
 				path.append(".dll");
 				result = ::loadImport(path, architecture);
@@ -2,8 +2,10 @@
 
 #include "FormatBase.h"
 #include "File.h"
+#include "Allocator.h"
 #include "../Util/SharedPtr.h"
 #include "../Util/List.h"
+#include "../Util/Vector.h"
 #include "../Util/DataSource.h"
 
 struct _IMAGE_DATA_DIRECTORY;
@@ -11,13 +13,17 @@ typedef _IMAGE_DATA_DIRECTORY IMAGE_DATA_DIRECTORY;
 class PEFormat : public FormatBase
 {
 private:
-	List<Section> sections_;
-	List<Import> imports_;
-	List<uint64_t> relocations_;
-	List<ExportFunction> exports_;
+	SharedPtr<MemoryArena> arena_; //parsed metadata lives here. declared first, so it's released after the members using it.
+	Vector<Section> sections_;
+	Vector<Import> imports_;
+	Vector<uint64_t> relocations_;
+	UniqueVector<ExportFunction> exports_;
 	SharedPtr<DataView> header_;
 	ImageInfo info_;
 	size_t dataDirectoryBase_;
+	size_t dataDirectoryCount_;
+	size_t readBudget_; //bytes metadata parsing may still read, so forged counts and overlapping tables can't take more than linear time.
+	bool fromMemory_;
 	bool processedRelocation_;
 	bool processedImport_;
 	bool processedExport_;
@@ -29,8 +35,12 @@ private:
 	void processRelocation();
 	void processImport();
 	void processExport();
-	uint8_t *getDataPointerOfRVA(uint32_t rva);
-	String PEFormat::checkExportForwarder(uint64_t address, size_t exportTableBase, size_t exportTableSize);
+	size_t getSectionDataSize(const Section &section) const;
+	uint8_t *getDataPointerOfRVA(uint32_t rva, size_t *available = nullptr);
+	String readStringOfRVA(uint32_t rva);
+	void resetReadBudget();
+	bool consumeReadBudget(size_t size);
+	String checkExportForwarder(uint64_t address, size_t exportTableBase, size_t exportTableSize);
 	IMAGE_DATA_DIRECTORY *getDataDirectory(size_t index);
 public:
 	PEFormat();
@@ -42,14 +52,14 @@ public:
 	virtual const String &getFileName() const;
 	virtual const String &getFilePath() const;
 	virtual Image toImage();
-	virtual const List<Import> &getImports();
-	virtual const List<ExportFunction> &getExports();
+	virtual const Vector<Import> &getImports();
+	virtual const UniqueVector<ExportFunction> &getExports();
 	virtual const ImageInfo &getInfo() const;
-	virtual const List<uint64_t> &getRelocations();
-	virtual const List<Section> &getSections() const;
+	virtual const Vector<uint64_t> &getRelocations();
+	virtual const Vector<Section> &getSections() const;
 
-	virtual void setSections(const List<Section> &sections);
-	virtual void setRelocations(const List<uint64_t> &relocations);
+	virtual void setSections(const Vector<Section> &sections);
+	virtual void setRelocations(const Vector<uint64_t> &relocations);
 	virtual void setImageInfo(const ImageInfo &info);
 
 	virtual void save(SharedPtr<DataSource> target);
@@ -0,0 +1,175 @@
+#include "Trace.h"
+
+#ifdef TRACE_EVENTS
+#include "Allocator.h"
+#include "File.h"
+#include "../Util/Util.h"
+#include "../Win32/Win32NativeHelper.h"
+
+#include "../Util/Intrinsic.h"
+
+struct TraceEvent
+{
+	uint64_t start; //tsc
+	uint64_t end;
+	char name[TRACE_NAME_SIZE];
+};
+
+//ring buffer is written only by owning thread. head is published after event is complete,
+//so flush from another thread sees whole events, except ones overwritten during flush.
+struct TraceBuffer
+{
+	volatile long threadId; //0 if slot is free
+	volatile size_t head; //number of events ever recorded
+	TraceEvent *events;
+};
+TraceBuffer traceBuffers[TRACE_THREAD_COUNT];
+
+volatile bool traceEnabled;
+String *tracePath;
+uint64_t traceStartCycles;
+uint64_t traceStartTime; //100ns units
+
+inline long getTraceThreadId()
+{
+#ifdef _WIN64
+	return static_cast<long>(__readgsqword(0x48)); //TEB.ClientId.UniqueThread
+#else
+	return static_cast<long>(__readfsdword(0x24));
+#endif
+}
+
+inline long getTraceProcessId()
+{
+#ifdef _WIN64
+	return static_cast<long>(__readgsqword(0x40)); //TEB.ClientId.UniqueProcess
+#else
+	return static_cast<long>(__readfsdword(0x20));
+#endif
+}
+
+//same slot search as allocator thread caches. events of threads beyond TRACE_THREAD_COUNT are dropped.
+static TraceBuffer *getTraceBuffer()
+{
+	long threadId = getTraceThreadId();
+	size_t start = (threadId >> 2) & (TRACE_THREAD_COUNT - 1);
+	for(size_t i = 0; i < TRACE_THREAD_COUNT; i ++)
+	{
+		TraceBuffer *buffer = &traceBuffers[(start + i) & (TRACE_THREAD_COUNT - 1)];
+		if(buffer->threadId == threadId)
+			return buffer;
+		if(buffer->threadId == 0 && _InterlockedCompareExchange(&buffer->threadId, threadId, 0) == 0)
+		{
+			buffer->events = reinterpret_cast<TraceEvent *>(heapAlloc(sizeof(TraceEvent) * TRACE_BUFFER_SIZE));
+			return buffer;
+		}
+	}
+	return nullptr;
+}
+
+void startTrace(const String &path)
+{
+	tracePath = new String(path);
+	traceStartTime = Win32NativeHelper::get()->getInterruptTime();
+	traceStartCycles = __rdtsc();
+	traceEnabled = true;
+}
+
+bool isTraceEnabled()
+{
+	return traceEnabled;
+}
+
+TraceScope::TraceScope(const char *name, const char *detail) : name_(name), detail_(detail), start_(0)
+{
+	if(traceEnabled)
+		start_ = __rdtsc();
+}
+
+TraceScope::~TraceScope()
+{
+	if(!start_)
+		return;
+	uint64_t end = __rdtsc();
+	TraceBuffer *buffer = getTraceBuffer();
+	if(!buffer)
+		return;
+	TraceEvent &event = buffer->events[buffer->head & (TRACE_BUFFER_SIZE - 1)];
+	event.start = start_;
+	event.end = end;
+	size_t length = 0;
+	for(const char *i = name_; *i && length < TRACE_NAME_SIZE - 1; i ++)
+		event.name[length ++] = *i;
+	if(detail_ && length < TRACE_NAME_SIZE - 2)
+	{
+		event.name[length ++] = ' ';
+		for(const char *i = detail_; *i && length < TRACE_NAME_SIZE - 1; i ++)
+			event.name[length ++] = *i;
+	}
+	event.name[length] = 0;
+	_ReadWriteBarrier();
+	buffer->head = buffer->head + 1;
+}
+
+//microseconds with three decimal places, from tsc ticks per microsecond in 10 bit fixed point.
+static void appendMicroseconds(String &result, uint64_t cycles, uint64_t cyclesPerMicrosecond)
+{
+	uint64_t nanoseconds = divide64(cycles * 1000 << 10, cyclesPerMicrosecond);
+	uint64_t microseconds = divide64(nanoseconds, 1000);
+	uint32_t fraction = static_cast<uint32_t>(nanoseconds - microseconds * 1000);
+	result.append(IntToString(microseconds));
+	result.append(".");
+	result.push_back(static_cast<char>('0' + fraction / 100));
+	result.push_back(static_cast<char>('0' + fraction / 10 % 10));
+	result.push_back(static_cast<char>('0' + fraction % 10));
+}
+
+void flushTrace()
+{
+	if(!traceEnabled)
+		return;
+	//tsc rate is measured over whole trace, as interrupt time alone only advances on timer ticks.
+	uint64_t elapsedCycles = __rdtsc() - traceStartCycles;
+	uint64_t elapsedTime = Win32NativeHelper::get()->getInterruptTime() - traceStartTime;
+	uint64_t cyclesPerMicrosecond = divide64(elapsedCycles * 10 << 10, elapsedTime);
+	if(!cyclesPerMicrosecond)
+		cyclesPerMicrosecond = 1 << 10; //trace shorter than one timer tick, assume 1 ghz.
+
+	String processId = IntToString(getTraceProcessId());
+	String result("{\"traceEvents\":[");
+	bool first = true;
+	for(size_t i = 0; i < TRACE_THREAD_COUNT; i ++)
+	{
+		const TraceBuffer &buffer = traceBuffers[i];
+		if(!buffer.threadId)
+			continue;
+		String threadId = IntToString(buffer.threadId);
+		size_t head = buffer.head;
+		size_t start = head > TRACE_BUFFER_SIZE ? head - TRACE_BUFFER_SIZE : 0;
+		for(size_t j = start; j < head; j ++)
+		{
+			const TraceEvent &event = buffer.events[j & (TRACE_BUFFER_SIZE - 1)];
+			result.append(first ? "\n" : ",\n");
+			first = false;
+			result.append("{\"name\":\"");
+			for(const char *k = event.name; *k; k ++)
+			{
+				if(*k == '"' || *k == '\\')
+					result.push_back('\\');
+				result.push_back(*k);
+			}
+			result.append("\",\"ph\":\"X\",\"pid\":");
+			result.append(processId);
+			result.append(",\"tid\":");
+			result.append(threadId);
+			result.append(",\"ts\":");
+			appendMicroseconds(result, event.start - traceStartCycles, cyclesPerMicrosecond);
+			result.append(",\"dur\":");
+			appendMicroseconds(result, event.end - event.start, cyclesPerMicrosecond);
+			result.append("}");
+		}
+	}
+	result.append("\n],\"displayTimeUnit\":\"ns\"}\n");
+	File::open(*tracePath, true)->write(result.c_str(), result.length());
+}
+#endif
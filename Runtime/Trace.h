@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../Util/String.h"
+
+#ifdef TRACE_EVENTS
+#define TRACE_THREAD_COUNT 16
+#define TRACE_BUFFER_SIZE 4096 //events per thread, oldest are overwritten when full
+#define TRACE_NAME_SIZE 48
+
+//scoped events in chrome trace event format, for chrome://tracing or perfetto.
+//each thread records to its own ring buffer without locking. recording starts on startTrace.
+void startTrace(const String &path);
+bool isTraceEnabled();
+void flushTrace(); //writes all buffered events to path given to startTrace. may be called more than once.
+
+//records one complete event from construction to destruction. detail is appended to name, like a library name.
+class TraceScope
+{
+private:
+	const char *name_;
+	const char *detail_;
+	uint64_t start_;
+
+	TraceScope(const TraceScope &);
+	const TraceScope &operator =(const TraceScope &);
+public:
+	TraceScope(const char *name, const char *detail = nullptr);
+	~TraceScope();
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(traceScope, __LINE__)(__VA_ARGS__)
+#else
+#define TRACE_SCOPE(...)
+#endif
@@ -0,0 +1,337 @@
+#include "../Runtime/Image.h"
+#include "../Runtime/Keystream.h"
+#include "../Runtime/PEFormat.h"
+#include "../Runtime/PEHeader.h"
+#include "../Util/Checksum.h"
+#include "../Util/Vector.h"
+#include "../Win32/Win32ImageLoader.h"
+#include "../Win32/Win32RecordingSystemCaller.h"
+#include "../Benchmark/Benchmark.h"
+#include "../Benchmark/SyntheticPE.h"
+
+#include <stdio.h>
+#include <pthread.h>
+
+//checks for loader and payload code on layouts benchmarks don't reach.
+//exits nonzero on first failure. from repository root, with any compiler:
+//  cc -O2 -c LZMA/LzmaDec.c LZMA/LzmaEnc.c LZMA/LzFind.c
+//  g++ -g -O1 -std=c++11 -pthread -o runtimetest RuntimeTest/RuntimeTest.cpp Win32/Win32ImageLoader.cpp Benchmark/SyntheticPE.cpp Runtime/PEFormat.cpp Runtime/Image.cpp Runtime/Keystream.cpp Runtime/Allocator.cpp Win32/Win32File.cpp Win32/Win32PosixPlatform.cpp LzmaDec.o LzmaEnc.o LzFind.o
+
+namespace
+{
+	bool failed = false;
+
+	void check(bool condition, const char *what, size_t a, size_t b)
+	{
+		if(condition)
+			return;
+		printf("failed: %s (%u, %u)\n", what, static_cast<uint32_t>(a), static_cast<uint32_t>(b));
+		failed = true;
+	}
+
+	void addSection(Image &image, uint64_t baseAddress, uint64_t size, uint32_t flag)
+	{
+		Section section;
+		section.baseAddress = baseAddress;
+		section.size = size;
+		section.flag = flag;
+		image.sections.push_back(std::move(section));
+	}
+
+	//protection and flush calls protectImage makes for a layout, recorded without touching memory.
+	void checkProtectCalls(const Image &image, uint32_t protectCount, uint32_t flushCount, const char *what)
+	{
+		Win32RecordingSystemCaller recorder(nullptr);
+		protectImage(&recorder, 0x10000000, image);
+		check(recorder.getCount(NtProtectVirtualMemory) == protectCount, what, recorder.getCount(NtProtectVirtualMemory), protectCount);
+		check(recorder.getCount(NtFlushInstructionCache) == flushCount, what, recorder.getCount(NtFlushInstructionCache), flushCount);
+		check(recorder.getTotalCount() == protectCount + flushCount, what, recorder.getTotalCount(), protectCount + flushCount);
+	}
+
+	void testProtectImage()
+	{
+		const uint32_t code = SectionFlagCode | SectionFlagRead | SectionFlagExecute;
+		const uint32_t data = SectionFlagData | SectionFlagRead | SectionFlagWrite;
+		const uint32_t rdata = SectionFlagData | SectionFlagRead;
+
+		//sizes not page multiples, so neighbours only merge if their size is rounded.
+		Image merged;
+		addSection(merged, 0x1000, 0x1800, code);
+		addSection(merged, 0x3000, 0x10, code);
+		addSection(merged, 0x4000, 0x200, rdata);
+		addSection(merged, 0x5000, 0x200, rdata);
+		addSection(merged, 0x6000, 0x200, data);
+		checkProtectCalls(merged, 3, 1, "neighbours merged");
+
+		Image gap;
+		addSection(gap, 0x1000, 0x1000, rdata);
+		addSection(gap, 0x3000, 0x1000, rdata);
+		addSection(gap, 0x4000, 0x1000, rdata);
+		checkProtectCalls(gap, 2, 0, "gap between sections");
+
+		//no access section splits range around it and gets no call of its own.
+		Image noAccess;
+		addSection(noAccess, 0x1000, 0x1000, rdata);
+		addSection(noAccess, 0x2000, 0x1000, 0);
+		addSection(noAccess, 0x3000, 0x1000, rdata);
+		addSection(noAccess, 0x4000, 0x1000, 0);
+		checkProtectCalls(noAccess, 2, 0, "sections with protection 0");
+
+		Image onlyNoAccess;
+		addSection(onlyNoAccess, 0x1000, 0x1000, 0);
+		checkProtectCalls(onlyNoAccess, 0, 0, "image with protection 0 only");
+
+		//one flush spans code sections apart from each other.
+		Image splitCode;
+		addSection(splitCode, 0x1000, 0x1000, code);
+		addSection(splitCode, 0x2000, 0x1000, data);
+		addSection(splitCode, 0x3000, 0x1000, code);
+		addSection(splitCode, 0x6000, 0x1000, code | SectionFlagWrite);
+		checkProtectCalls(splitCode, 4, 1, "code sections sharing one flush");
+
+		checkProtectCalls(Image(), 0, 0, "image without sections");
+	}
+
+	const KeystreamKernel keystreamKernels[] = {KeystreamKernelScalar, KeystreamKernelSSE2, KeystreamKernelAVX2};
+	const size_t keystreamKernelCount = sizeof(keystreamKernels) / sizeof(keystreamKernels[0]);
+	const uint32_t keystreamSeed = 0x12345678;
+
+	void fillRandom(uint8_t *data, size_t size, uint32_t &random)
+	{
+		for(size_t i = 0; i < size; i ++)
+			data[i] = static_cast<uint8_t>(nextRandom(random) >> 8);
+	}
+
+	//keystream bytes from offset 0, by scalar kernel in one call.
+	Vector<uint8_t> getKeystream(size_t size)
+	{
+		Vector<uint8_t> result(size);
+		for(size_t i = 0; i < size; i ++)
+			result[i] = 0;
+		keystreamCrypt(keystreamSeed, 0, result.get(), size, KeystreamKernelScalar);
+		return result;
+	}
+
+	//every kernel on every offset and size around block and simd widths, against the same keystream bytes.
+	//bytes around the range must stay as they are.
+	void testKeystreamKernels()
+	{
+		const size_t maxOffset = 300, maxSize = 1200, guard = 64;
+		Vector<uint8_t> keystream = getKeystream(maxOffset + maxSize);
+		Vector<uint8_t> original(guard + maxSize + guard);
+		Vector<uint8_t> data(original.size());
+		uint32_t random = 1;
+		fillRandom(original.get(), original.size(), random);
+
+		for(size_t k = 0; k < keystreamKernelCount; k ++)
+		{
+			size_t mismatches = 0;
+			for(size_t offset = 0; offset <= maxOffset; offset ++)
+				for(size_t size = 0; size <= maxSize; size ++)
+				{
+					size_t end = guard + size + guard;
+					copyMemory(data.get(), original.get(), end);
+					keystreamCrypt(keystreamSeed, offset, data.get() + guard, size, keystreamKernels[k]);
+					for(size_t i = 0; i < end; i ++)
+					{
+						uint8_t expected = original[i];
+						if(i >= guard && i < guard + size)
+							expected ^= keystream[offset + i - guard];
+						if(data[i] != expected)
+						{
+							if(!mismatches)
+								check(false, "keystream kernel matches scalar at offset and size", offset, size);
+							mismatches ++;
+							break;
+						}
+					}
+				}
+			check(mismatches == 0, "keystream kernel mismatches", k, mismatches);
+		}
+	}
+
+	struct KeystreamRange
+	{
+		uint8_t *data;
+		size_t offset;
+		size_t size;
+		KeystreamKernel kernel;
+	};
+
+	void *cryptKeystreamRange(void *argument)
+	{
+		KeystreamRange *range = reinterpret_cast<KeystreamRange *>(argument);
+		keystreamCrypt(keystreamSeed, range->offset, range->data + range->offset, range->size, range->kernel);
+		return nullptr;
+	}
+
+	//buffer cut at random points, not only on block boundaries, each range on its own thread with kernels taking turns.
+	//result must be the whole buffer crypted in one call, and crypting it again must restore it.
+	void testKeystreamSplit()
+	{
+		const size_t size = 0x10000 + 37, maxRanges = 16;
+		Vector<uint8_t> keystream = getKeystream(size);
+		Vector<uint8_t> original(size);
+		Vector<uint8_t> data(size);
+		uint32_t random = 2;
+		fillRandom(original.get(), size, random);
+
+		for(size_t round = 0; round < 64; round ++)
+		{
+			KeystreamRange ranges[maxRanges];
+			pthread_t threads[maxRanges];
+			size_t count = 1 + nextRandom(random) % maxRanges;
+			size_t offset = 0;
+			for(size_t i = 0; i < count; i ++)
+			{
+				ranges[i].data = data.get();
+				ranges[i].offset = offset;
+				ranges[i].size = (i + 1 == count ? size - offset : nextRandom(random) % ((size - offset) / 2 + 1));
+				ranges[i].kernel = keystreamKernels[(round + i) % keystreamKernelCount];
+				offset += ranges[i].size;
+			}
+
+			copyMemory(data.get(), original.get(), size);
+			for(size_t pass = 0; pass < 2; pass ++)
+			{
+				for(size_t i = 0; i < count; i ++)
+					pthread_create(&threads[i], nullptr, cryptKeystreamRange, &ranges[i]);
+				for(size_t i = 0; i < count; i ++)
+					pthread_join(threads[i], nullptr);
+
+				size_t mismatch = size;
+				for(size_t i = 0; i < size && mismatch == size; i ++)
+					if(data[i] != static_cast<uint8_t>(pass ? original[i] : original[i] ^ keystream[i]))
+						mismatch = i;
+				check(mismatch == size, pass ? "keystream split ranges restore data" : "keystream split ranges match one call", round, mismatch);
+			}
+		}
+	}
+
+	const ChecksumKernel checksumKernels[] = {ChecksumKernelScalar, ChecksumKernelSSE2, ChecksumKernelAVX2};
+	const size_t checksumKernelCount = sizeof(checksumKernels) / sizeof(checksumKernels[0]);
+
+	//word at a time with carry folded after each add, as CheckSumMappedFile does. word at checkSumOffset is skipped.
+	uint32_t referencePEChecksum(const uint8_t *file, size_t size, size_t checkSumOffset)
+	{
+		uint32_t sum = 0;
+		for(size_t i = 0; i < size; i += 2)
+		{
+			if(i >= checkSumOffset && i < checkSumOffset + 4)
+				continue;
+			sum += file[i] | (i + 1 < size ? file[i + 1] << 8 : 0);
+			sum = (sum & 0xffff) + (sum >> 16);
+		}
+		return sum + static_cast<uint32_t>(size);
+	}
+
+	//every kernel from every byte misalignment on counts around simd widths, and on words that would wrap 32 bit sums.
+	void testSumWords()
+	{
+		const size_t maxCount = 80;
+		Vector<uint8_t> data(maxCount * 4 + 8);
+		uint32_t random = 3;
+		fillRandom(data.get(), data.size(), random);
+		for(size_t k = 0; k < checksumKernelCount; k ++)
+			for(size_t offset = 0; offset < 8; offset ++)
+				for(size_t count = 0; count <= maxCount; count ++)
+				{
+					uint64_t expected = sumWordsScalar(data.get() + offset, count);
+					uint64_t result = sumWords(data.get() + offset, count, checksumKernels[k]);
+					check(result == expected, "sumWords kernel matches scalar", offset * 1000 + k, count);
+				}
+
+		Vector<uint8_t> full(0x10000 * 4);
+		setMemory(full.get(), 0xff, full.size());
+		for(size_t k = 0; k < checksumKernelCount; k ++)
+			check(sumWords(full.get(), 0x10000, checksumKernels[k]) == 0xffffffffull * 0x10000, "sumWords doesn't wrap", k, 0);
+	}
+
+	//buffer of odd size cut at random points, odd offsets included, and summed in shuffled order with kernels taking turns.
+	void testPEChecksumRanges()
+	{
+		const size_t size = 0x4000 + 13, maxRanges = 12;
+		const size_t noCheckSum = static_cast<size_t>(-1);
+		Vector<uint8_t> data(size);
+		uint32_t random = 4;
+		fillRandom(data.get(), size, random);
+		uint32_t expected = referencePEChecksum(data.get(), size, noCheckSum);
+
+		for(size_t round = 0; round < 256; round ++)
+		{
+			size_t starts[maxRanges + 1];
+			size_t count = 1 + nextRandom(random) % maxRanges;
+			starts[0] = 0;
+			for(size_t i = 1; i < count; i ++)
+				starts[i] = starts[i - 1] + nextRandom(random) % ((size - starts[i - 1]) / 2 + 1);
+			starts[count] = size;
+
+			size_t order[maxRanges];
+			for(size_t i = 0; i < count; i ++)
+				order[i] = i;
+			for(size_t i = count; i > 1; i --)
+			{
+				size_t j = nextRandom(random) % i;
+				size_t temp = order[i - 1];
+				order[i - 1] = order[j];
+				order[j] = temp;
+			}
+
+			uint32_t partial = 0;
+			for(size_t i = 0; i < count; i ++)
+			{
+				size_t range = order[i];
+				partial = updatePEChecksum(partial, starts[range], data.get() + starts[range], starts[range + 1] - starts[range], checksumKernels[(round + i) % checksumKernelCount]);
+			}
+			uint32_t result = finishPEChecksum(partial, static_cast<uint32_t>(size));
+			check(result == expected, "pe checksum of split ranges matches reference", round, result);
+		}
+	}
+
+	//CheckSum PEFormat::save writes while copying headers and sections, against a fold of the saved file.
+	void testSaveChecksum()
+	{
+		const ArchitectureType architectures[] = {ArchitectureWin32, ArchitectureWin32AMD64};
+		for(size_t i = 0; i < sizeof(architectures) / sizeof(architectures[0]); i ++)
+		{
+			SyntheticPEOptions options = {architectures[i], 0x3001, 0x1003, 64, 300, 3, 7, 20, static_cast<uint32_t>(5 + i)};
+			Vector<uint8_t> file = generateSyntheticPE(options);
+			PEFormat format;
+			if(!format.load(file.asDataSource(), false))
+			{
+				check(false, "synthetic pe loads", i, 0);
+				continue;
+			}
+			Vector<uint8_t> output(format.estimateSize());
+			format.save(output.asDataSource());
+
+			const IMAGE_DOS_HEADER *dosHeader = reinterpret_cast<const IMAGE_DOS_HEADER *>(output.get());
+			const IMAGE_FILE_HEADER *fileHeader = reinterpret_cast<const IMAGE_FILE_HEADER *>(output.get() + dosHeader->e_lfanew + sizeof(uint32_t));
+			size_t optionalHeaderOffset = dosHeader->e_lfanew + sizeof(uint32_t) + sizeof(IMAGE_FILE_HEADER);
+			size_t checkSumOffset = optionalHeaderOffset + (architectures[i] == ArchitectureWin32 ? offsetof(IMAGE_OPTIONAL_HEADER32, CheckSum) : offsetof(IMAGE_OPTIONAL_HEADER64, CheckSum));
+			const IMAGE_SECTION_HEADER *sectionHeaders = reinterpret_cast<const IMAGE_SECTION_HEADER *>(output.get() + optionalHeaderOffset + fileHeader->SizeOfOptionalHeader);
+			size_t fileSize = 0;
+			for(size_t j = 0; j < fileHeader->NumberOfSections; j ++)
+				fileSize = max(fileSize, static_cast<size_t>(sectionHeaders[j].PointerToRawData + sectionHeaders[j].SizeOfRawData));
+
+			uint32_t written = *reinterpret_cast<const uint32_t *>(output.get() + checkSumOffset);
+			uint32_t expected = referencePEChecksum(output.get(), fileSize, checkSumOffset);
+			check(fileSize && fileSize <= output.size(), "saved file size", fileSize, output.size());
+			check(written == expected, "saved CheckSum matches reference", written, expected);
+		}
+	}
+}
+
+int main()
+{
+	testProtectImage();
+	testKeystreamKernels();
+	testKeystreamSplit();
+	testSumWords();
+	testPEChecksumRanges();
+	testSaveChecksum();
+	if(failed)
+		return 1;
+	printf("ok\n");
+	return 0;
+}
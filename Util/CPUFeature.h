@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Intrinsic.h"
+
+#ifdef _MSC_VER
+#include <immintrin.h>
+//msvc compiles any intrinsic without /arch, so kernels need no attribute.
+#define TARGET_SSE2
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+enum CPUFeature
+{
+	CPUFeatureSSE2 = 1,
+	CPUFeatureAVX2 = 2,
+	CPUFeatureDetected = 0x40000000,
+};
+
+//features usable by simd kernels. avx2 also needs os to save ymm registers, which xcr0 tells.
+inline uint32_t detectCPUFeatures()
+{
+	int info[4];
+	uint32_t result = 0;
+#ifdef _MSC_VER
+	__cpuid(info, 0);
+#else
+	__cpuid_count(0, 0, info[0], info[1], info[2], info[3]);
+#endif
+	int maxLeaf = info[0];
+
+#ifdef _MSC_VER
+	__cpuid(info, 1);
+#else
+	__cpuid_count(1, 0, info[0], info[1], info[2], info[3]);
+#endif
+	if(info[3] & (1 << 26))
+		result |= CPUFeatureSSE2;
+	bool hasOSXSave = (info[2] & (1 << 27)) != 0;
+	bool hasAVX = (info[2] & (1 << 28)) != 0;
+	if(!hasOSXSave || !hasAVX || maxLeaf < 7)
+		return result;
+
+#ifdef _MSC_VER
+	uint64_t xcr0 = _xgetbv(0);
+#else
+	uint32_t xcr0Low, xcr0High;
+	__asm__ __volatile__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+	uint64_t xcr0 = (static_cast<uint64_t>(xcr0High) << 32) | xcr0Low;
+#endif
+	if((xcr0 & 6) != 6) //xmm and ymm state
+		return result;
+
+#ifdef _MSC_VER
+	__cpuidex(info, 7, 0);
+#else
+	__cpuid_count(7, 0, info[0], info[1], info[2], info[3]);
+#endif
+	if(info[1] & (1 << 5))
+		result |= CPUFeatureAVX2;
+	return result;
+}
+
+//cpuid traps under some hypervisors, so result is kept. racing threads store same value.
+inline uint32_t getCPUFeatures()
+{
+	static uint32_t features; //zero initialized, no constructor to run
+	if(!features)
+		features = detectCPUFeatures() | CPUFeatureDetected;
+	return features;
+}
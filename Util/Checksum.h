@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "CPUFeature.h"
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+//checksum kernels are header only, so Stage1, which links no runtime, verifies stage2 with them too.
+
+enum ChecksumKernel
+{
+	ChecksumKernelAuto, //best one cpu supports
+	ChecksumKernelScalar,
+	ChecksumKernelSSE2,
+	ChecksumKernelAVX2,
+};
+
+inline uint64_t sumWordsScalar(const uint8_t *data, size_t count)
+{
+	uint64_t result = 0;
+	for(size_t i = 0; i < count; i ++)
+		result += reinterpret_cast<const uint32_t *>(data)[i];
+	return result;
+}
+
+//words are zero extended to 64 bit lanes, so sums don't wrap at any size.
+TARGET_SSE2 inline uint64_t sumWordsSSE2(const uint8_t *data, size_t count)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i sum0 = zero, sum1 = zero;
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i * 4));
+		sum0 = _mm_add_epi64(sum0, _mm_unpacklo_epi32(value, zero));
+		sum1 = _mm_add_epi64(sum1, _mm_unpackhi_epi32(value, zero));
+	}
+	uint64_t lanes[2];
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), _mm_add_epi64(sum0, sum1));
+	return lanes[0] + lanes[1] + sumWordsScalar(data + i * 4, count - i);
+}
+
+TARGET_AVX2 inline uint64_t sumWordsAVX2(const uint8_t *data, size_t count)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i sum0 = zero, sum1 = zero;
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i * 4));
+		sum0 = _mm256_add_epi64(sum0, _mm256_unpacklo_epi32(value, zero));
+		sum1 = _mm256_add_epi64(sum1, _mm256_unpackhi_epi32(value, zero));
+	}
+	uint64_t lanes[4];
+	_mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), _mm256_add_epi64(sum0, sum1));
+	_mm256_zeroupper();
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumWordsScalar(data + i * 4, count - i);
+}
+
+//sum of count little endian 32 bit words.
+inline uint64_t sumWords(const uint8_t *data, size_t count, ChecksumKernel kernel = ChecksumKernelAuto)
+{
+	uint32_t features = getCPUFeatures();
+	if((kernel == ChecksumKernelAuto || kernel == ChecksumKernelAVX2) && (features & CPUFeatureAVX2))
+		return sumWordsAVX2(data, count);
+	if(kernel != ChecksumKernelScalar && (features & CPUFeatureSSE2))
+		return sumWordsSSE2(data, count);
+	return sumWordsScalar(data, count);
+}
+
+inline uint32_t foldOnesComplement(uint64_t sum)
+{
+	while(sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return static_cast<uint32_t>(sum);
+}
+
+//pe optional header checksum: 16 bit one's complement sum of file words with CheckSum field as zero, plus file size.
+//ranges may come in any order. offset is their file offset, as a range on odd offset pairs its bytes the other way.
+//odd last byte of a range pairs with zero, which is also what next range on odd offset assumes.
+inline uint32_t updatePEChecksum(uint32_t partial, size_t offset, const uint8_t *data, size_t size, ChecksumKernel kernel = ChecksumKernelAuto)
+{
+	//2^16 is 1 in one's complement arithmetic, so a 32 bit word adds as its two halves.
+	uint64_t sum = sumWords(data, size / 4, kernel);
+	size_t i = size & ~static_cast<size_t>(3);
+	if(i + 2 <= size)
+	{
+		sum += *reinterpret_cast<const uint16_t *>(data + i);
+		i += 2;
+	}
+	if(i < size)
+		sum += data[i];
+
+	uint32_t result = foldOnesComplement(sum);
+	if(offset & 1)
+		result = ((result & 0xff) << 8) | (result >> 8);
+	return foldOnesComplement(static_cast<uint64_t>(partial) + result);
+}
+
+inline uint32_t finishPEChecksum(uint32_t partial, uint32_t fileSize)
+{
+	return foldOnesComplement(partial) + fileSize;
+}
@@ -0,0 +1,475 @@
+#pragma once
+
+//open addressing hash table with robin hood probing. replacement of std::unordered_map.
+//slot hashes live in their own array, so a probe sequence only touches 4 bytes per slot.
+
+#include <cstdint>
+
+#include "TypeTraits.h"
+#include "Util.h"
+#include "String.h"
+
+inline uint32_t hashInteger(uint32_t key)
+{
+	//murmur3 finalizer
+	key ^= key >> 16;
+	key *= 0x85ebca6b;
+	key ^= key >> 13;
+	key *= 0xc2b2ae35;
+	key ^= key >> 16;
+	return key;
+}
+
+inline uint32_t hashInteger(uint64_t key)
+{
+	return hashInteger(static_cast<uint32_t>(key) ^ static_cast<uint32_t>(key >> 32));
+}
+
+template<typename KeyType>
+class DefaultHasher
+{
+public:
+	static uint32_t hash(const KeyType &key)
+	{
+		return hashInteger(static_cast<uint64_t>(key));
+	}
+
+	template<typename LookupType>
+	static bool equal(const KeyType &a, const LookupType &b)
+	{
+		return a == b;
+	}
+};
+
+template<typename KeyType>
+class DefaultHasher<KeyType *>
+{
+public:
+	static uint32_t hash(KeyType *key)
+	{
+		return hashInteger(static_cast<uint64_t>(reinterpret_cast<size_t>(key)));
+	}
+
+	static bool equal(KeyType *a, KeyType *b)
+	{
+		return a == b;
+	}
+};
+
+template<typename CharacterType>
+class DefaultHasher<StringBase<CharacterType>>
+{
+public:
+	static uint32_t hash(const StringBase<CharacterType> &key)
+	{
+		return key.hash();
+	}
+
+	template<typename LookupType>
+	static bool equal(const StringBase<CharacterType> &a, const LookupType &b)
+	{
+		return a.compare(b) == 0;
+	}
+};
+
+//fnv1a over lowercased characters. for narrow strings, this equals fnv1a of the lowercased string.
+template<typename StringType>
+class CaseInsensitiveStringHasher
+{
+public:
+	template<typename CharacterType>
+	static uint32_t hash(const CharacterType *str, size_t length)
+	{
+		return StringBase<CharacterType>::ihash(str, length);
+	}
+
+	static uint32_t hash(const StringType &key)
+	{
+		return key.ihash();
+	}
+
+	template<typename LookupType>
+	static bool equal(const StringType &a, const LookupType &b)
+	{
+		return a.icompare(b) == 0;
+	}
+};
+
+template<typename KeyType, typename ValueType, typename Hasher = DefaultHasher<KeyType>>
+class HashMap
+{
+private:
+	struct HashMapNode
+	{
+		HashMapNode() : key(), value() {}
+		HashMapNode(const KeyType &key_, const ValueType &value_) : key(key_), value(value_) {}
+		HashMapNode(const KeyType &key_, ValueType &&value_) : key(key_), value(std::move(value_)) {}
+		HashMapNode(HashMapNode &&operand) : key(std::move(operand.key)), value(std::move(operand.value)) {}
+		const HashMapNode &operator =(HashMapNode &&operand)
+		{
+			key = std::move(operand.key);
+			value = std::move(operand.value);
+			return *this;
+		}
+
+		KeyType key;
+		ValueType value;
+	};
+	uint32_t *hashes_; //0 marks empty slot.
+	HashMapNode *nodes_;
+	size_t capacity_; //always power of 2
+	size_t size_;
+
+	template<typename NodeType>
+	class HashMapIterator
+	{
+	private:
+		NodeType *nodes_;
+		const uint32_t *hashes_;
+		size_t index_;
+		size_t capacity_;
+
+		void skipEmpty_()
+		{
+			while(index_ < capacity_ && !hashes_[index_])
+				index_ ++;
+		}
+	public:
+		HashMapIterator(NodeType *nodes, const uint32_t *hashes, size_t index, size_t capacity) : nodes_(nodes), hashes_(hashes), index_(index), capacity_(capacity)
+		{
+			skipEmpty_();
+		}
+
+		NodeType &operator *()
+		{
+			return nodes_[index_];
+		}
+
+		NodeType *operator ->()
+		{
+			return &nodes_[index_];
+		}
+
+		bool operator ==(const HashMapIterator &operand)
+		{
+			return index_ == operand.index_;
+		}
+
+		bool operator !=(const HashMapIterator &operand)
+		{
+			return index_ != operand.index_;
+		}
+
+		HashMapIterator &operator ++()
+		{
+			index_ ++;
+			skipEmpty_();
+			return *this;
+		}
+	};
+public:
+	typedef ValueType value_type;
+	typedef HashMapIterator<HashMapNode> iterator;
+	typedef HashMapIterator<const HashMapNode> const_iterator;
+
+private:
+	static uint32_t normalizeHash_(uint32_t hash)
+	{
+		return hash ? hash : 1;
+	}
+
+	//how far slot at index is from its home slot.
+	size_t distance_(size_t index) const
+	{
+		return (index - (hashes_[index] & (capacity_ - 1))) & (capacity_ - 1);
+	}
+
+	template<typename LookupType>
+	size_t find_(const LookupType &key, uint32_t hash) const
+	{
+		if(!size_)
+			return capacity_;
+		hash = normalizeHash_(hash);
+		size_t mask = capacity_ - 1;
+		size_t index = hash & mask;
+		for(size_t distance = 0;; distance ++, index = (index + 1) & mask)
+		{
+			//robin hood invariant: the key would have displaced any slot closer to its home.
+			if(!hashes_[index] || distance_(index) < distance)
+				return capacity_;
+			if(hashes_[index] == hash && Hasher::equal(nodes_[index].key, key))
+				return index;
+		}
+	}
+
+	//hash must be normalized and key must not exist. returns slot of node.
+	size_t place_(uint32_t hash, HashMapNode &&node)
+	{
+		size_t mask = capacity_ - 1;
+		size_t index = hash & mask;
+		size_t distance = 0;
+		size_t result = capacity_;
+		while(true)
+		{
+			if(!hashes_[index])
+			{
+				hashes_[index] = hash;
+				nodes_[index] = std::move(node);
+				size_ ++;
+				return result == capacity_ ? index : result;
+			}
+			size_t existing = distance_(index);
+			if(existing < distance)
+			{
+				//take the slot from richer entry, and continue placing it.
+				uint32_t tempHash = hashes_[index];
+				hashes_[index] = hash;
+				hash = tempHash;
+
+				HashMapNode temp(std::move(nodes_[index]));
+				nodes_[index] = std::move(node);
+				node = std::move(temp);
+
+				if(result == capacity_)
+					result = index;
+				distance = existing;
+			}
+			index = (index + 1) & mask;
+			distance ++;
+		}
+	}
+
+	void rehash_(size_t capacity)
+	{
+		uint32_t *oldHashes = hashes_;
+		HashMapNode *oldNodes = nodes_;
+		size_t oldCapacity = capacity_;
+
+		capacity_ = capacity;
+		hashes_ = new uint32_t[capacity_];
+		zeroMemory(hashes_, sizeof(uint32_t) * capacity_);
+		nodes_ = new HashMapNode[capacity_];
+		size_ = 0;
+
+		for(size_t i = 0; i < oldCapacity; i ++)
+			if(oldHashes[i])
+				place_(oldHashes[i], std::move(oldNodes[i]));
+		if(oldHashes)
+		{
+			delete [] oldHashes;
+			delete [] oldNodes;
+		}
+	}
+
+	template<typename InsertType>
+	iterator insert_(const KeyType &key, InsertType value)
+	{
+		uint32_t hash = Hasher::hash(key);
+		size_t index = find_(key, hash);
+		if(index != capacity_)
+		{
+			nodes_[index].value = static_cast<InsertType>(value);
+			return iterator(nodes_, hashes_, index, capacity_);
+		}
+		//keep load factor under 7/8.
+		if((size_ + 1) * 8 > capacity_ * 7)
+			rehash_(capacity_ ? capacity_ * 2 : 16);
+		index = place_(normalizeHash_(hash), HashMapNode(key, static_cast<InsertType>(value)));
+		return iterator(nodes_, hashes_, index, capacity_);
+	}
+
+	HashMap(const HashMap &);
+	const HashMap &operator =(const HashMap &);
+public:
+	HashMap() : hashes_(nullptr), nodes_(nullptr), capacity_(0), size_(0)
+	{
+	}
+
+	HashMap(HashMap &&operand) : hashes_(operand.hashes_), nodes_(operand.nodes_), capacity_(operand.capacity_), size_(operand.size_)
+	{
+		operand.hashes_ = nullptr;
+		operand.nodes_ = nullptr;
+		operand.capacity_ = 0;
+		operand.size_ = 0;
+	}
+
+	~HashMap()
+	{
+		if(hashes_)
+		{
+			delete [] hashes_;
+			delete [] nodes_;
+		}
+	}
+
+	const HashMap &operator =(HashMap &&operand)
+	{
+		clear();
+		hashes_ = operand.hashes_;
+		nodes_ = operand.nodes_;
+		capacity_ = operand.capacity_;
+		size_ = operand.size_;
+		operand.hashes_ = nullptr;
+		operand.nodes_ = nullptr;
+		operand.capacity_ = 0;
+		operand.size_ = 0;
+		return *this;
+	}
+
+	void clear()
+	{
+		if(hashes_)
+		{
+			delete [] hashes_;
+			delete [] nodes_;
+		}
+		hashes_ = nullptr;
+		nodes_ = nullptr;
+		capacity_ = 0;
+		size_ = 0;
+	}
+
+	void reserve(size_t size)
+	{
+		size_t capacity = 16;
+		while(size * 8 > capacity * 7)
+			capacity *= 2;
+		if(capacity > capacity_)
+			rehash_(capacity);
+	}
+
+	size_t size() const
+	{
+		return size_;
+	}
+
+	//replaces value if key already exists.
+	iterator insert(const KeyType &key, const ValueType &value)
+	{
+		return insert_<const ValueType &>(key, value);
+	}
+
+	iterator insert(const KeyType &key, ValueType &&value)
+	{
+		return insert_<ValueType &&>(key, std::move(value));
+	}
+
+	ValueType &operator [](const KeyType &key)
+	{
+		iterator it = find(key);
+		if(it == end())
+			return insert(key, ValueType())->value;
+		return it->value;
+	}
+
+	bool remove(const KeyType &key)
+	{
+		size_t index = find_(key, Hasher::hash(key));
+		if(index == capacity_)
+			return false;
+
+		//shift following entries back, so no tombstone is needed.
+		size_t mask = capacity_ - 1;
+		size_t next = (index + 1) & mask;
+		while(hashes_[next] && distance_(next) != 0)
+		{
+			hashes_[index] = hashes_[next];
+			nodes_[index] = std::move(nodes_[next]);
+			index = next;
+			next = (next + 1) & mask;
+		}
+		hashes_[index] = 0;
+		nodes_[index] = HashMapNode();
+		size_ --;
+		return true;
+	}
+
+	iterator find(const KeyType &key)
+	{
+		return iterator(nodes_, hashes_, find_(key, Hasher::hash(key)), capacity_);
+	}
+
+	//lookup with hash computed by caller. key may be any type Hasher::equal accepts.
+	template<typename LookupType>
+	iterator find(const LookupType &key, uint32_t hash)
+	{
+		return iterator(nodes_, hashes_, find_(key, hash), capacity_);
+	}
+
+	const_iterator find(const KeyType &key) const
+	{
+		return const_iterator(nodes_, hashes_, find_(key, Hasher::hash(key)), capacity_);
+	}
+
+	template<typename LookupType>
+	const_iterator find(const LookupType &key, uint32_t hash) const
+	{
+		return const_iterator(nodes_, hashes_, find_(key, hash), capacity_);
+	}
+
+	iterator begin()
+	{
+		return iterator(nodes_, hashes_, 0, capacity_);
+	}
+
+	iterator end()
+	{
+		return iterator(nodes_, hashes_, capacity_, capacity_);
+	}
+
+	const_iterator begin() const
+	{
+		return const_iterator(nodes_, hashes_, 0, capacity_);
+	}
+
+	const_iterator end() const
+	{
+		return const_iterator(nodes_, hashes_, capacity_, capacity_);
+	}
+};
+
+template<typename KeyType, typename Hasher = DefaultHasher<KeyType>>
+class HashSet
+{
+private:
+	HashMap<KeyType, bool, Hasher> map_;
+public:
+	//returns false if key already exists.
+	bool insert(const KeyType &key)
+	{
+		size_t oldSize = map_.size();
+		map_.insert(key, true);
+		return map_.size() != oldSize;
+	}
+
+	bool remove(const KeyType &key)
+	{
+		return map_.remove(key);
+	}
+
+	bool contains(const KeyType &key) const
+	{
+		return map_.find(key) != map_.end();
+	}
+
+	template<typename LookupType>
+	bool contains(const LookupType &key, uint32_t hash) const
+	{
+		return map_.find(key, hash) != map_.end();
+	}
+
+	void reserve(size_t size)
+	{
+		map_.reserve(size);
+	}
+
+	size_t size() const
+	{
+		return map_.size();
+	}
+
+	void clear()
+	{
+		map_.clear();
+	}
+};
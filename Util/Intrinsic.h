@@ -0,0 +1,46 @@
+#pragma once
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+
+//msvc intrinsics used by runtime, as gcc builtins. lets runtime build into linux tools like loader benchmark.
+inline long _InterlockedIncrement(volatile long *target)
+{
+	return __sync_add_and_fetch(target, 1);
+}
+
+inline long _InterlockedDecrement(volatile long *target)
+{
+	return __sync_sub_and_fetch(target, 1);
+}
+
+inline long _InterlockedExchange(volatile long *target, long value)
+{
+	return __sync_lock_test_and_set(target, value);
+}
+
+inline long _InterlockedCompareExchange(volatile long *target, long exchange, long comparand)
+{
+	return __sync_val_compare_and_swap(target, comparand, exchange);
+}
+
+inline long _InterlockedExchangeAdd(volatile long *target, long value)
+{
+	return __sync_fetch_and_add(target, value);
+}
+
+inline long long _InterlockedExchangeAdd64(volatile long long *target, long long value)
+{
+	return __sync_fetch_and_add(target, value);
+}
+
+inline long long _InterlockedCompareExchange64(volatile long long *target, long long exchange, long long comparand)
+{
+	return __sync_val_compare_and_swap(target, comparand, exchange);
+}
+
+#define _ReturnAddress() __builtin_return_address(0)
+#define _ReadWriteBarrier() __asm__ __volatile__("" ::: "memory")
+#endif
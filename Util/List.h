@@ -19,7 +19,7 @@ private:
 	};
 	ListNodeBase *head_;
 	
-	template<typename BaseType, typename NodeType, typename ValueType>
+	template<typename BaseType, typename NodeType, typename IteratorValueType>
 	class ListIterator
 	{
 		friend class List;
@@ -28,7 +28,7 @@ private:
 	public:
 		ListIterator(BaseType *item) : item_(item) {}
 
-		ValueType &operator *()
+		IteratorValueType &operator *()
 		{
 			return static_cast<NodeType *>(item_)->data;
 		}
@@ -51,7 +51,7 @@ private:
 			return *this;
 		}
 
-		ValueType *operator ->()
+		IteratorValueType *operator ->()
 		{
 			return &static_cast<NodeType *>(item_)->data;
 		}
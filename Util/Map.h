@@ -1,5 +1,7 @@
 #pragma once
 
+//red-black tree. nodes are also threaded in key order, so iteration doesn't touch the tree.
+
 #include "TypeTraits.h"
 
 template<typename ValueType>
@@ -18,31 +20,34 @@ class Map
 private:
 	struct MapNode
 	{
-		MapNode(const KeyType &key_, const ValueType &value_, MapNode *parent_) : left(nullptr), right(nullptr), key(key_), value(value_), parent(parent_) {}
-		MapNode(const KeyType &key_, ValueType &&value_, MapNode *parent_) : left(nullptr), right(nullptr), key(key_), value(std::move(value_)), parent(parent_) {}
+		MapNode(const KeyType &key_, const ValueType &value_, MapNode *parent_) : left(nullptr), right(nullptr), parent(parent_), next(nullptr), prev(nullptr), red(true), key(key_), value(value_) {}
+		MapNode(const KeyType &key_, ValueType &&value_, MapNode *parent_) : left(nullptr), right(nullptr), parent(parent_), next(nullptr), prev(nullptr), red(true), key(key_), value(std::move(value_)) {}
 		MapNode *left;
 		MapNode *right;
 		MapNode *parent;
+		MapNode *next; //in-order successor
+		MapNode *prev; //in-order predecessor
+		bool red;
 		KeyType key;
 		ValueType value;
 	};
 	MapNode *head_;
+	MapNode *first_;
 
-	template<typename NodeType, typename ValueType>
+	template<typename NodeType, typename IteratorValueType>
 	class MapIterator
 	{
 	private:
 		NodeType *node_;
-		Map *map_;
 	public:
-		MapIterator(NodeType *node, Map *map) : node_(node), map_(map) {}
+		MapIterator(NodeType *node) : node_(node) {}
 
-		MapNode &operator *()
+		NodeType &operator *()
 		{
 			return *node_;
 		}
 
-		MapNode *operator ->()
+		NodeType *operator ->()
 		{
 			return node_;
 		}
@@ -59,7 +64,7 @@ private:
 
 		MapIterator &operator ++()
 		{
-			*this = map_->upper_bound(node_->key);
+			node_ = node_->next;
 			return *this;
 		}
 	};
@@ -69,85 +74,160 @@ public:
 	typedef MapIterator<const MapNode, const value_type> const_iterator;
 
 private:
-	template<typename InsertType>
-	iterator insert_(const KeyType &key, InsertType value)
+	void rotateLeft_(MapNode *node)
 	{
-		if(!head_)
-		{
-			head_ = new MapNode(key, value, nullptr);
-			return iterator(nullptr, this);
-		}
-		MapNode *item = head_;
-		while(true)
+		MapNode *pivot = node->right;
+		node->right = pivot->left;
+		if(pivot->left)
+			pivot->left->parent = node;
+		replaceChild_(node, pivot);
+		pivot->left = node;
+		node->parent = pivot;
+	}
+
+	void rotateRight_(MapNode *node)
+	{
+		MapNode *pivot = node->left;
+		node->left = pivot->right;
+		if(pivot->right)
+			pivot->right->parent = node;
+		replaceChild_(node, pivot);
+		pivot->right = node;
+		node->parent = pivot;
+	}
+
+	//put replacement where node was in node's parent.
+	void replaceChild_(MapNode *node, MapNode *replacement)
+	{
+		replacement->parent = node->parent;
+		if(!node->parent)
+			head_ = replacement;
+		else if(node->parent->left == node)
+			node->parent->left = replacement;
+		else
+			node->parent->right = replacement;
+	}
+
+	void rebalance_(MapNode *node)
+	{
+		while(node->parent && node->parent->red)
 		{
-			if(Comparator()(item->key, key))
+			MapNode *parent = node->parent;
+			MapNode *grandParent = parent->parent; //parent is red, so it is not root.
+			if(parent == grandParent->left)
 			{
-				if(item->right)
+				MapNode *uncle = grandParent->right;
+				if(uncle && uncle->red)
 				{
-					item = item->right;
+					parent->red = false;
+					uncle->red = false;
+					grandParent->red = true;
+					node = grandParent;
 					continue;
 				}
-				item->right = new MapNode(key, value, item);
+				if(node == parent->right)
+				{
+					rotateLeft_(parent);
+					node = parent;
+					parent = node->parent;
+				}
+				parent->red = false;
+				grandParent->red = true;
+				rotateRight_(grandParent);
 			}
 			else
 			{
-				if(item->left)
+				MapNode *uncle = grandParent->left;
+				if(uncle && uncle->red)
 				{
-					item = item->left;
+					parent->red = false;
+					uncle->red = false;
+					grandParent->red = true;
+					node = grandParent;
 					continue;
 				}
-				item->left = new MapNode(key, value, item);
+				if(node == parent->left)
+				{
+					rotateRight_(parent);
+					node = parent;
+					parent = node->parent;
+				}
+				parent->red = false;
+				grandParent->red = true;
+				rotateLeft_(grandParent);
 			}
-			break;
 		}
-		return iterator(item, this);
+		head_->red = false;
 	}
-	
-	template<typename KeyType>
-	MapNode *find_(const KeyType &key)
+
+	template<typename InsertType>
+	iterator insert_(const KeyType &key, InsertType value)
 	{
 		if(!head_)
-			return nullptr;
+		{
+			head_ = new MapNode(key, value, nullptr);
+			head_->red = false;
+			first_ = head_;
+			return iterator(head_);
+		}
 		MapNode *item = head_;
-		while(Comparator()(item->key, key) || Comparator()(key, item->key)) //item->key < key or key > item->key => key != item->key
+		MapNode *node;
+		while(true)
 		{
-			if(Comparator()(item->key, key))
+			if(Comparator()(key, item->key))
 			{
-				if(item->right)
+				if(item->left)
 				{
-					item = item->right;
+					item = item->left;
 					continue;
 				}
-				else
-					return nullptr;
+				//new node comes right before item.
+				node = new MapNode(key, value, item);
+				item->left = node;
+				node->next = item;
+				node->prev = item->prev;
 			}
 			else
 			{
-				if(item->left)
+				if(item->right)
 				{
-					item = item->left;
+					item = item->right;
 					continue;
 				}
-				else
-					return nullptr;
+				//new node comes right after item.
+				node = new MapNode(key, value, item);
+				item->right = node;
+				node->prev = item;
+				node->next = item->next;
 			}
+			break;
 		}
-		return item;
+		if(node->prev)
+			node->prev->next = node;
+		else
+			first_ = node;
+		if(node->next)
+			node->next->prev = node;
+
+		rebalance_(node);
+		return iterator(node);
 	}
 
-	//find lowest value in tree bigger than key.
-	MapNode *upper_bound_(MapNode *current, MapNode *lowest, MapNode *bound)
+	MapNode *find_(const KeyType &key) const
 	{
-		if(!Comparator()(bound->key, current->key)) //!(bound->key < current->key) => bound->key >= current->key
-			return lowest;
-		if(Comparator()(current->key, lowest->key)) //current->key < lowest->key
-			lowest = current;
-		if(current->left)
-			lowest = upper_bound_(current->left, lowest, bound);
-		if(current->right)
-			lowest = upper_bound_(current->right, lowest, bound);
-		return lowest;
+		MapNode *item = head_;
+		while(item)
+		{
+			if(Comparator()(item->key, key))
+				item = item->right;
+			else if(Comparator()(key, item->key))
+				item = item->left;
+			else
+				return item;
+		}
+		return nullptr;
 	}
+
 	void clear_(MapNode *node)
 	{
 		if(!node)
@@ -158,7 +238,7 @@ private:
 	}
 public:
 
-	Map() : head_(nullptr)
+	Map() : head_(nullptr), first_(nullptr)
 	{
 	}
 
@@ -170,6 +250,8 @@ public:
 	void clear()
 	{
 		clear_(head_);
+		head_ = nullptr;
+		first_ = nullptr;
 	}
 
 	iterator insert(const KeyType &key, const ValueType &value)
@@ -190,48 +272,51 @@ public:
 		return it->value;
 	}
 
+	//lowest node whose key is bigger than key.
 	iterator upper_bound(const KeyType &key)
 	{
-		MapNode *node = find_(key);
-		if(!node)
-			return iterator(nullptr, this);
-		if(!node->parent && !node->right)
-			//this is root node and highest node
-			return iterator(nullptr, this);
-		
-		if(node->right) //right node is always lower than parent node.
-			return iterator(upper_bound_(node->right, node->right, node), this);
-
-		MapNode *search = node->parent;
-		while(search)
+		MapNode *item = head_;
+		MapNode *result = nullptr;
+		while(item)
 		{
-			if(!Comparator()(search->key, node->key))//!(search->key < node->key) => search->key >= node->key
-				return iterator(search, this);
-			search = search->parent;
+			if(Comparator()(key, item->key))
+			{
+				result = item;
+				item = item->left;
+			}
+			else
+				item = item->right;
 		}
-		return iterator(nullptr, this);
+		return iterator(result);
 	}
 
 	iterator find(const KeyType &key)
 	{
-		return iterator(find_(key), this);
+		return iterator(find_(key));
 	}
 
 	iterator end()
 	{
-		return iterator(nullptr, this);
+		return iterator(nullptr);
+	}
+
+	const_iterator find(const KeyType &key) const
+	{
+		return const_iterator(find_(key));
+	}
+
+	const_iterator end() const
+	{
+		return const_iterator(nullptr);
 	}
 
 	iterator begin()
 	{
-		MapNode *item = head_;
-		while(true)
-		{
-			if(item->left)
-				item = item->left;
-			else
-				break;
-		}
-		return iterator(item, this);
+		return iterator(first_);
+	}
+
+	const_iterator begin() const
+	{
+		return const_iterator(first_);
 	}
 };
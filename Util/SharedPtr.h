@@ -1,44 +1,81 @@
 #pragma once
 
 #include <cstdint>
+#include "TypeTraits.h"
+
+#ifndef SHAREDPTR_SINGLE_THREADED
+#include "Intrinsic.h"
+#endif
+
+//define SHAREDPTR_SINGLE_THREADED to use plain counts where no pointer is shared across threads.
 
 namespace Impl
 {
-	class RefCounter
+	//reference count and the way to destroy the owned object. lives in one allocation with object when made by MakeShared.
+	class ControlBlock
 	{
 	private:
-		size_t refCount_;
+		volatile long refCount_;
 	public:
-		RefCounter() : refCount_(0) {}
+		ControlBlock() : refCount_(0) {}
+		virtual ~ControlBlock() {}
 
-		void decRef()
-		{
-			refCount_ --;
-		}
+		//destroys owned object and control block itself.
+		virtual void destroy() = 0;
 
 		void addRef()
 		{
+#ifdef SHAREDPTR_SINGLE_THREADED
 			refCount_ ++;
+#else
+			_InterlockedIncrement(&refCount_);
+#endif
+		}
+
+		//returns true when it was the last reference.
+		bool decRef()
+		{
+#ifdef SHAREDPTR_SINGLE_THREADED
+			return -- refCount_ == 0;
+#else
+			return _InterlockedDecrement(&refCount_) == 0;
+#endif
 		}
 
-		size_t refCount()
+		size_t refCount() const
 		{
-			return refCount_;
+			return static_cast<size_t>(refCount_);
 		}
 	};
 
-	class DeleterBase
+	//for objects allocated by caller.
+	template<typename T>
+	class PointerControlBlock : public ControlBlock
 	{
+	private:
+		T *item_;
 	public:
-		virtual void execute(void *) = 0;
+		PointerControlBlock(T *item) : item_(item) {}
+
+		virtual void destroy()
+		{
+			delete item_;
+			delete this;
+		}
 	};
 
 	template<typename T>
-	class Deleter : public DeleterBase
+	class InlineControlBlock : public ControlBlock
 	{
-		virtual void execute(void *ptr)
+	public:
+		T item;
+
+		template<typename... Args>
+		InlineControlBlock(Args &&...args) : item(std::forward<Args>(args)...) {}
+
+		virtual void destroy()
 		{
-			delete reinterpret_cast<T *>(ptr);
+			delete this;
 		}
 	};
 }
@@ -46,16 +83,18 @@ namespace Impl
 template<typename PointerType>
 class SharedPtr
 {
+	template<typename>
 	friend class SharedPtr;
-	template<typename PointerType>
+	template<typename>
 	friend class EnableSharedFromThis;
+	template<typename T, typename... Args>
+	friend SharedPtr<T> MakeShared(Args &&...args);
 private:
 	PointerType *item_;
-	Impl::RefCounter *refCounter_;
-	Impl::DeleterBase *deleter_;
-	SharedPtr(PointerType *item, Impl::RefCounter *refCounter, Impl::DeleterBase *deleter) : item_(nullptr), refCounter_(nullptr), deleter_(nullptr)
+	Impl::ControlBlock *controlBlock_;
+	SharedPtr(PointerType *item, Impl::ControlBlock *controlBlock) : item_(nullptr), controlBlock_(nullptr)
 	{
-		reset(item, refCounter, deleter);
+		reset_(item, controlBlock);
 	}
 
 	void EnableShared(const void *) {} //not inherited
@@ -63,89 +102,81 @@ private:
 	template<typename EnableSharedPointerType>
 	void EnableShared(EnableSharedPointerType *item, typename EnableSharedPointerType::_EnableSharedType * = nullptr)
 	{
-		item_->originalRefCounter_ = refCounter_;
-		item_->originalDeleter_ = deleter_;
+		item_->originalControlBlock_ = controlBlock_;
+	}
+
+	void reset_(PointerType *item, Impl::ControlBlock *controlBlock)
+	{
+		//take new reference first, so resetting to a pointer sharing the same block is safe.
+		if(item)
+			controlBlock->addRef();
+		if(item_ && controlBlock_->decRef())
+			controlBlock_->destroy();
+		item_ = item;
+		controlBlock_ = controlBlock;
+		if(item_)
+			EnableShared(item);
 	}
 public:
-	SharedPtr(PointerType *item) : item_(nullptr), refCounter_(nullptr), deleter_(nullptr)
+	SharedPtr(PointerType *item) : item_(nullptr), controlBlock_(nullptr)
 	{
-		if(!item)
-			reset(nullptr, nullptr, nullptr);
-		else
-			reset(item, new Impl::RefCounter(), new Impl::Deleter<PointerType>());
+		if(item)
+			reset_(item, new Impl::PointerControlBlock<PointerType>(item));
 	}
 
-	SharedPtr() : item_(nullptr), refCounter_(nullptr), deleter_(nullptr) {}
+	SharedPtr() : item_(nullptr), controlBlock_(nullptr) {}
 
-	SharedPtr(const SharedPtr &other) : item_(nullptr), refCounter_(nullptr), deleter_(nullptr)
+	SharedPtr(const SharedPtr &other) : item_(nullptr), controlBlock_(nullptr)
 	{
-		reset(other.item_, other.refCounter_, other.deleter_);
+		reset_(other.item_, other.controlBlock_);
 	}
 
 	template<typename PointerType2>
-	SharedPtr(const SharedPtr<PointerType2> &other) : item_(nullptr), refCounter_(nullptr), deleter_(nullptr)
+	SharedPtr(const SharedPtr<PointerType2> &other) : item_(nullptr), controlBlock_(nullptr)
 	{
-		reset(static_cast<PointerType *>(other.item_), other.refCounter_, other.deleter_);
+		reset_(static_cast<PointerType *>(other.item_), other.controlBlock_);
 	}
 
-	SharedPtr(SharedPtr &&other) : item_(other.item_), refCounter_(other.refCounter_), deleter_(other.deleter_)
+	SharedPtr(SharedPtr &&other) : item_(other.item_), controlBlock_(other.controlBlock_)
 	{
 		other.item_ = nullptr;
-		other.refCounter_ = nullptr;
-		other.deleter_ = nullptr;
+		other.controlBlock_ = nullptr;
 	}
 
 	template<typename PointerType2>
-	SharedPtr(SharedPtr<PointerType2> &&other) : item_(static_cast<PointerType *>(other.item_)), refCounter_(other.refCounter_), deleter_(other.deleter_) 
+	SharedPtr(SharedPtr<PointerType2> &&other) : item_(static_cast<PointerType *>(other.item_)), controlBlock_(other.controlBlock_)
 	{
 		other.item_ = nullptr;
-		other.refCounter_ = nullptr;
-		other.deleter_ = nullptr;
+		other.controlBlock_ = nullptr;
 	}
 
 	~SharedPtr()
 	{
-		reset(nullptr, nullptr, nullptr);
+		reset();
 	}
 
 	const SharedPtr &operator =(const SharedPtr &other)
 	{
-		reset(other.item_, other.refCounter_, other.deleter_);
+		reset_(other.item_, other.controlBlock_);
 		return *this;
 	}
 
 	const SharedPtr &operator =(SharedPtr &&other)
 	{
+		if(this == &other)
+			return *this;
+		reset();
 		item_ = other.item_;
-		refCounter_ = other.refCounter_;
-		deleter_ = other.deleter_;
-		
+		controlBlock_ = other.controlBlock_;
+
 		other.item_ = nullptr;
-		other.refCounter_ = nullptr;
-		other.deleter_ = nullptr;
+		other.controlBlock_ = nullptr;
 		return *this;
 	}
 
-	void reset(PointerType *item = nullptr, Impl::RefCounter *refCounter = nullptr, Impl::DeleterBase *deleter = nullptr)
+	void reset()
 	{
-		if(item_)
-		{
-			refCounter_->decRef();
-			if(refCounter_->refCount() == 0)
-			{
-				deleter_->execute(item_);
-				delete deleter_;
-				delete refCounter_;
-			}
-		}
-		item_ = item;
-		refCounter_ = refCounter;
-		deleter_ = deleter;
-		if(item_)
-		{
-			refCounter->addRef();
-			EnableShared(item);
-		}
+		reset_(nullptr, nullptr);
 	}
 
 	PointerType *operator ->()
@@ -170,7 +201,7 @@ public:
 
 	size_t getRef()
 	{
-		return refCounter_->refCount();
+		return controlBlock_->refCount();
 	}
 
 	bool operator !() const
@@ -182,60 +213,24 @@ public:
 template<typename PointerType>
 class EnableSharedFromThis
 {
-	template<typename PointerType>
+	template<typename>
 	friend class SharedPtr;
 private:
-	Impl::RefCounter *originalRefCounter_;
-	Impl::DeleterBase *originalDeleter_;
+	Impl::ControlBlock *originalControlBlock_;
 public:
 	typedef PointerType _EnableSharedType;
-	EnableSharedFromThis() : originalRefCounter_(nullptr), originalDeleter_(nullptr) {}
+	EnableSharedFromThis() : originalControlBlock_(nullptr) {}
 
 	SharedPtr<PointerType> sharedFromThis()
 	{
-		return SharedPtr<PointerType>(static_cast<PointerType *>(this), originalRefCounter_, originalDeleter_);
+		return SharedPtr<PointerType>(static_cast<PointerType *>(this), originalControlBlock_);
 	}
 };
 
-//VC11 doesn't support variadic templates.. damn
-template<typename PointerType>
-SharedPtr<PointerType> MakeShared()
-{
-	return SharedPtr<PointerType>(new PointerType());
-}
-
-template<typename PointerType, typename T1>
-SharedPtr<PointerType> MakeShared(T1 a1)
-{
-	return SharedPtr<PointerType>(new PointerType(a1));
-}
-
-template<typename PointerType, typename T1, typename T2>
-SharedPtr<PointerType> MakeShared(T1 a1, T2 a2)
-{
-	return SharedPtr<PointerType>(new PointerType(a1, a2));
-}
-
-template<typename PointerType, typename T1, typename T2, typename T3>
-SharedPtr<PointerType> MakeShared(T1 a1, T2 a2, T3 a3)
-{
-	return SharedPtr<PointerType>(new PointerType(a1, a2, a3));
-}
-
-template<typename PointerType, typename T1, typename T2, typename T3, typename T4>
-SharedPtr<PointerType> MakeShared(T1 a1, T2 a2, T3 a3, T4 a4)
-{
-	return SharedPtr<PointerType>(new PointerType(a1, a2, a3, a4));
-}
-
-template<typename PointerType, typename T1, typename T2, typename T3, typename T4, typename T5>
-SharedPtr<PointerType> MakeShared(T1 a1, T2 a2, T3 a3, T4 a4, T5 a5)
+//object and its control block are allocated together.
+template<typename PointerType, typename... Args>
+SharedPtr<PointerType> MakeShared(Args &&...args)
 {
-	return SharedPtr<PointerType>(new PointerType(a1, a2, a3, a4, a5));
+	Impl::InlineControlBlock<PointerType> *block = new Impl::InlineControlBlock<PointerType>(std::forward<Args>(args)...);
+	return SharedPtr<PointerType>(&block->item, block);
 }
-
-template<typename PointerType, typename T1, typename T2, typename T3, typename T4, typename T5, typename T6>
-SharedPtr<PointerType> MakeShared(T1 a1, T2 a2, T3 a3, T4 a4, T5 a5, T6 a6)
-{
-	return SharedPtr<PointerType>(new PointerType(a1, a2, a3, a4, a5, a6));
-}
\ No newline at end of file
@@ -3,85 +3,322 @@
 #include <cstdint>
 
 #include "TypeTraits.h"
+#include "Util.h"
 #include "Vector.h"
 
+template<typename CharacterType>
+inline CharacterType toLowerCharacter(CharacterType x)
+{
+	return (x >= CharacterType('A') && x <= CharacterType('Z') ? x - (CharacterType('A') - CharacterType('a')) : x);
+}
+
+//non-owning range of characters, not necessarily null terminated.
+//valid only while the string it points to is alive and unmodified.
+template<typename CharacterType=char>
+class StringViewBase
+{
+private:
+	const CharacterType *data_;
+	size_t length_;
+public:
+	typedef const CharacterType *const_iterator;
+	typedef CharacterType value_type;
+
+	StringViewBase() : data_(nullptr), length_(0)
+	{
+	}
+
+	StringViewBase(const CharacterType *data, size_t length) : data_(data), length_(length)
+	{
+	}
+
+	StringViewBase(const CharacterType *string) : data_(string), length_(0)
+	{
+		while(string[length_])
+			length_ ++;
+	}
+
+	const CharacterType *data() const
+	{
+		return data_;
+	}
+
+	size_t length() const
+	{
+		return length_;
+	}
+
+	CharacterType operator [](size_t pos) const
+	{
+		return data_[pos];
+	}
+
+	const_iterator begin() const
+	{
+		return data_;
+	}
+
+	const_iterator end() const
+	{
+		return data_ + length_;
+	}
+
+	//out of range start and length are clamped.
+	StringViewBase substr(size_t start, int len = -1) const
+	{
+		if(start > length_)
+			start = length_;
+		if(len == -1 || start + len > length_)
+			len = length_ - start;
+		return StringViewBase(data_ + start, len);
+	}
+
+	int find(CharacterType pattern, size_t start = 0) const
+	{
+		for(size_t i = start; i < length_; i ++)
+			if(data_[i] == pattern)
+				return i;
+		return -1;
+	}
+
+	int rfind(CharacterType pattern, int start = -1) const
+	{
+		if(start == -1)
+			start = length_;
+		for(int i = start - 1; i >= 0; i --)
+			if(data_[i] == pattern)
+				return i;
+		return -1;
+	}
+
+	//shorter one comes first, same as StringBase::compare(const StringBase &).
+	int compare(const StringViewBase &operand) const
+	{
+		if(operand.length_ > length_)
+			return -1;
+		else if(operand.length_ < length_)
+			return 1;
+		for(size_t i = 0; i < length_; i ++)
+			if(data_[i] != operand.data_[i])
+				return data_[i] - operand.data_[i];
+		return 0;
+	}
+
+	int icompare(const StringViewBase &operand) const
+	{
+		if(operand.length_ > length_)
+			return -1;
+		else if(operand.length_ < length_)
+			return 1;
+		for(size_t i = 0; i < length_; i ++)
+			if(toLowerCharacter(data_[i]) != toLowerCharacter(operand.data_[i]))
+				return toLowerCharacter(data_[i]) - toLowerCharacter(operand.data_[i]);
+		return 0;
+	}
+
+	bool operator ==(const StringViewBase &operand) const
+	{
+		return compare(operand) == 0;
+	}
+
+	bool operator !=(const StringViewBase &operand) const
+	{
+		return compare(operand) != 0;
+	}
+};
+
+typedef StringViewBase<char> StringView;
+typedef StringViewBase<wchar_t> WStringView;
+
+//strings up to InlineCapacity - 1 characters, like section names and most dll names, are stored inline without heap allocation.
+//unlike Vector, longer strings own their buffer exclusively; there's no copy on write.
 template<typename CharacterType=char>
-class StringBase : private Vector<CharacterType>
+class StringBase
 {
 private:
-	static size_t length_(const CharacterType *str)
+	enum { InlineCapacity = 16 }; //characters including terminator
+
+	CharacterType *heap_; //nullptr while stored inline
+	size_t length_;
+	size_t capacity_; //characters including terminator
+	mutable uint32_t hash_; //0 if not computed yet
+	mutable uint32_t ihash_;
+	CharacterType inline_[InlineCapacity];
+
+	static size_t stringLength_(const CharacterType *str)
 	{
 		size_t result = 0;
 		while(*str ++)
 			result ++;
 		return result;
 	}
+
+	CharacterType *get() const
+	{
+		if(heap_)
+			return heap_;
+		return const_cast<CharacterType *>(inline_);
+	}
+
+	void initialize_()
+	{
+		heap_ = nullptr;
+		length_ = 0;
+		capacity_ = InlineCapacity;
+		hash_ = 0;
+		ihash_ = 0;
+		inline_[0] = 0;
+	}
+
+	//makes room for length characters plus terminator. returns replaced heap buffer for caller to free, so it can still
+	//copy from a source inside this string.
+	CharacterType *grow_(size_t length, bool preserve)
+	{
+		if(length < capacity_)
+			return nullptr;
+		size_t capacity = capacity_ * 2;
+		if(capacity < length + 1)
+			capacity = length + 1;
+		CharacterType *data = new CharacterType[capacity];
+		if(preserve)
+			copyMemory(data, get(), sizeof(CharacterType) * (length_ + 1));
+		CharacterType *old = heap_;
+		heap_ = data;
+		capacity_ = capacity;
+		return old;
+	}
+
+	void reserve_(size_t length, bool preserve)
+	{
+		CharacterType *old = grow_(length, preserve);
+		if(old)
+			delete [] old;
+	}
+
+	void setLength_(size_t length)
+	{
+		length_ = length;
+		get()[length] = 0;
+		modified_();
+	}
+
+	void modified_()
+	{
+		hash_ = 0;
+		ihash_ = 0;
+	}
+
+	void take_(StringBase &operand)
+	{
+		if(operand.heap_)
+		{
+			heap_ = operand.heap_;
+			capacity_ = operand.capacity_;
+			length_ = operand.length_;
+			hash_ = operand.hash_;
+			ihash_ = operand.ihash_;
+			operand.initialize_();
+		}
+		else
+			assign(operand.inline_, operand.length_);
+	}
 public:
-	typedef typename Vector<CharacterType>::iterator iterator;
-	typedef typename Vector<CharacterType>::const_iterator const_iterator;
+	typedef CharacterType *iterator;
+	typedef const CharacterType *const_iterator;
 	typedef CharacterType value_type;
 
 	StringBase()
 	{
-
+		initialize_();
 	}
 
 	StringBase(const CharacterType *string)
 	{
+		initialize_();
 		assign(string);
 	}
 
-	StringBase(StringBase &&operand) : Vector<CharacterType>(std::move(operand)) {}
-	StringBase(const StringBase &operand) : Vector<CharacterType>(operand) {}
+	StringBase(StringBase &&operand)
+	{
+		initialize_();
+		take_(operand);
+	}
+
+	StringBase(const StringBase &operand)
+	{
+		initialize_();
+		assign(operand.get(), operand.length_);
+	}
+
+	explicit StringBase(const StringViewBase<CharacterType> &operand)
+	{
+		initialize_();
+		assign(operand.data(), operand.length());
+	}
 
 	template<typename IteratorType>
 	StringBase(IteratorType start, IteratorType end)
 	{
+		initialize_();
 		assign(start, end);
 	}
 
+	~StringBase()
+	{
+		if(heap_)
+			delete [] heap_;
+	}
+
 	template<typename IteratorType>
 	void assign(IteratorType start, IteratorType end)
 	{
 		size_t length = end - start;
-		Vector<CharacterType>::resize(length + 1);
+		reserve_(length, false);
 
+		CharacterType *data = get();
 		size_t i = 0;
 		for(IteratorType it = start; it != end; it ++, i ++)
-			get()[i] = *it;
-		get()[length] = 0;
+			data[i] = *it;
+		setLength_(length);
+	}
+
+	void assign(const CharacterType *string, size_t length)
+	{
+		CharacterType *old = grow_(length, false);
+		CharacterType *data = get();
+		if(string >= data && string < data + length_) //part of this one, only overlaps if buffer wasn't replaced
+			moveMemory(data, string, sizeof(CharacterType) * length);
+		else
+			copyMemory(data, string, sizeof(CharacterType) * length);
+		if(old)
+			delete [] old;
+		setLength_(length);
 	}
 
 	void assign(const CharacterType *string)
 	{
-		size_t length = length_(string);
-		if(length)
-		{
-			Vector<CharacterType>::resize(length + 1);
-			Vector<CharacterType>::assign(const_cast<CharacterType *>(string), length + 1);
-		}
+		assign(string, stringLength_(string));
 	}
 
 	void push_back(CharacterType item)
 	{
-		if(size())
-			Vector<CharacterType>::insert(length(), item);
-		else
-		{
-			Vector<CharacterType>::push_back(item);
-			Vector<CharacterType>::push_back(0);
-		}
+		reserve_(length_ + 1, true);
+		get()[length_] = item;
+		setLength_(length_ + 1);
+	}
+
+	void append(const CharacterType *string, size_t length)
+	{
+		CharacterType *old = grow_(length_ + length, true);
+		copyMemory(get() + length_, string, sizeof(CharacterType) * length); //string may be part of this one
+		if(old)
+			delete [] old;
+		setLength_(length_ + length);
 	}
 
 	void append(const StringBase &operand)
 	{
-		if(size())
-		{
-			Vector<CharacterType>::insert(length(), operand);
-			Vector<CharacterType>::resize(size() - 1);
-		}
-		else
-			assign(operand.begin(), operand.end());
+		append(operand.get(), operand.length_);
 	}
 
 	CharacterType at(size_t pos) const
@@ -89,121 +326,159 @@ public:
 		return get()[pos];
 	}
 
-	CharacterType &operator [](size_t pos) const
+	const CharacterType &operator [](size_t pos) const
 	{
 		return get()[pos];
 	}
 
+	CharacterType &operator [](size_t pos)
+	{
+		modified_();
+		return get()[pos];
+	}
+
+	//new characters are zero.
 	void resize(size_t size)
 	{
-		Vector<CharacterType>::resize(size + 1);
-		get()[size] = 0;
+		reserve_(size, true);
+		if(size > length_)
+			zeroMemory(get() + length_, sizeof(CharacterType) * (size - length_));
+		setLength_(size);
 	}
 
 	size_t length() const
 	{
-		size_t size = Vector<CharacterType>::size();
-		return (size != 0 ? size - 1 : 0);
+		return length_;
 	}
 
+	//writing through returned iterators after hash() or ihash() leaves stale cached hashes.
 	iterator begin()
 	{
-		return Vector<CharacterType>::begin();
+		modified_();
+		return get();
 	}
 
 	iterator end()
 	{
-		return Vector<CharacterType>::end();
+		modified_();
+		return get() + length_;
 	}
 
 	const_iterator begin() const
 	{
-		return Vector<CharacterType>::begin();
+		return get();
 	}
 
 	const_iterator end() const
 	{
-		return Vector<CharacterType>::end();
+		return get() + length_;
+	}
+
+	StringViewBase<CharacterType> view(size_t start = 0, int len = -1) const
+	{
+		return StringViewBase<CharacterType>(get(), length_).substr(start, len);
+	}
+
+	operator StringViewBase<CharacterType>() const
+	{
+		return StringViewBase<CharacterType>(get(), length_);
 	}
 
 	StringBase substr(size_t start, int len = -1) const
 	{
-		if(len == -1)
-			len = length() - start;
-		return StringBase(begin() + start, begin() + start + len);
+		return StringBase(view(start, len));
 	}
 
 	const CharacterType *c_str() const
 	{
-		return const_cast<const CharacterType *>(get());
+		return get();
 	}
 
 	int find(CharacterType pattern, size_t start = 0) const
 	{
-		for(size_t i = start; i < length(); i ++)
-			if(get()[i] == pattern)
-				return i;
-		return -1;
+		return view().find(pattern, start);
 	}
 
 	int rfind(CharacterType pattern, int start = -1) const
 	{
-		if(start == -1)
-			start = length();
-		for(int i = start - 1; i >= 0; i --)
-			if(get()[i] == pattern)
-				return i;
-		return -1;
+		return view().rfind(pattern, start);
 	}
 
 	int compare(const CharacterType *operand) const
 	{
-		if(!get())
-			return 1;
+		const CharacterType *data = get();
 		size_t i;
-		for(i = 0; operand[i] != 0 && get()[i] != 0; i ++)
-			if(operand[i] != get()[i])
-				return get()[i] - operand[i];
-		return get()[i] - operand[i];
+		for(i = 0; operand[i] != 0 && data[i] != 0; i ++)
+			if(operand[i] != data[i])
+				return data[i] - operand[i];
+		return data[i] - operand[i];
 	}
 
 	int compare(const StringBase &operand) const
 	{
-		if(operand.size() > size())
-			return -1;
-		else if(operand.size() < size())
-			return 1;
-		return compare(operand.c_str());
+		return view().compare(operand.view());
+	}
+
+	int compare(const StringViewBase<CharacterType> &operand) const
+	{
+		return view().compare(operand);
 	}
 
 	static CharacterType to_lower(CharacterType x)
 	{
-		return (x >= CharacterType('A') && x <= CharacterType('Z') ? x - (CharacterType('A') - CharacterType('a')) : x);
+		return toLowerCharacter(x);
 	}
 
 	int icompare(const CharacterType *operand) const
 	{
-		if(!get())
-			return 1;
+		const CharacterType *data = get();
 		size_t i;
-		for(i = 0; operand[i] != 0 && get()[i] != 0; i ++)
-			if(to_lower(operand[i]) != to_lower(get()[i]))
-				return to_lower(get()[i]) - to_lower(operand[i]);
-		return to_lower(get()[i]) - to_lower(operand[i]);
+		for(i = 0; operand[i] != 0 && data[i] != 0; i ++)
+			if(to_lower(operand[i]) != to_lower(data[i]))
+				return to_lower(data[i]) - to_lower(operand[i]);
+		return to_lower(data[i]) - to_lower(operand[i]);
 	}
 
 	int icompare(const StringBase &operand) const
 	{
-		if(operand.size() > size())
-			return -1;
-		else if(operand.size() < size())
-			return 1;
-		return icompare(operand.c_str());
+		return view().icompare(operand.view());
+	}
+
+	int icompare(const StringViewBase<CharacterType> &operand) const
+	{
+		return view().icompare(operand);
+	}
+
+	//fnv1a over lowercased characters. for narrow strings, this equals fnv1a of the lowercased string.
+	static uint32_t ihash(const CharacterType *str, size_t length)
+	{
+		uint32_t hash = 0x811c9dc5;
+		for(size_t i = 0; i < length; i ++)
+		{
+			hash ^= static_cast<uint8_t>(to_lower(str[i]));
+			hash += (hash << 1) + (hash << 4) + (hash << 7) + (hash << 8) + (hash << 24);
+		}
+		return hash;
+	}
+
+	//fnv1a of characters, cached until the string is modified.
+	uint32_t hash() const
+	{
+		if(!hash_)
+			hash_ = fnv1a(get(), length_ * sizeof(CharacterType));
+		return hash_;
+	}
+
+	uint32_t ihash() const
+	{
+		if(!ihash_)
+			ihash_ = ihash(get(), length_);
+		return ihash_;
 	}
 
 	bool operator ==(const StringBase &operand) const
 	{
-		return compare(operand.c_str()) == 0;
+		return compare(operand) == 0;
 	}
 
 	bool operator ==(const char *operand) const
@@ -213,13 +488,20 @@ public:
 
 	const StringBase &operator =(const StringBase &operand)
 	{
-		Vector<CharacterType>::operator =(operand);
+		if(this != &operand)
+			assign(operand.get(), operand.length_);
 		return *this;
 	}
 
 	const StringBase &operator =(StringBase &&operand)
 	{
-		Vector<CharacterType>::operator =(std::move(operand));
+		if(this != &operand)
+		{
+			if(heap_)
+				delete [] heap_;
+			initialize_();
+			take_(operand);
+		}
 		return *this;
 	}
 
@@ -230,19 +512,21 @@ public:
 
 	bool operator !=(const StringBase &operand) const
 	{
-		return compare(operand.c_str()) != 0;
+		return compare(operand) != 0;
 	}
 
 	StringBase operator +(CharacterType operand) const
 	{
-		String result(*this);
+		StringBase result(*this);
 		result.push_back(operand);
 		return result;
 	}
 
 	StringBase operator +(const StringBase &operand) const
 	{
-		StringBase result(*this);
+		StringBase result;
+		result.reserve_(length_ + operand.length_, false);
+		result.assign(get(), length_);
 		result.append(operand);
 		return result;
 	}
@@ -440,3 +724,24 @@ inline int StringToInt(const String &str)
 
 	return value;
 }
+
+inline String IntToString(uint64_t value)
+{
+	//divide 16 bits at a time, so x86 doesn't need 64-bit division helpers.
+	uint32_t parts[4] = {static_cast<uint32_t>(value >> 48) & 0xffff, static_cast<uint32_t>(value >> 32) & 0xffff,
+		static_cast<uint32_t>(value >> 16) & 0xffff, static_cast<uint32_t>(value) & 0xffff};
+	char buffer[20];
+	size_t pos = sizeof(buffer);
+	do
+	{
+		uint32_t remainder = 0;
+		for(size_t i = 0; i < 4; i ++)
+		{
+			uint32_t current = (remainder << 16) | parts[i];
+			parts[i] = current / 10;
+			remainder = current % 10;
+		}
+		buffer[-- pos] = static_cast<char>('0' + remainder);
+	} while(parts[0] | parts[1] | parts[2] | parts[3]);
+	return String(buffer + pos, buffer + sizeof(buffer));
+}
@@ -2,4 +2,7 @@
 
 #ifdef _MSC_VER
 #include <type_traits> //for std::move. Just including <utility> makes static data entry, So we can't.
+#else
+#include <utility>
+#include <type_traits>
 #endif
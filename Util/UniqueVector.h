@@ -0,0 +1,199 @@
+#pragma once
+
+//vector with single owner. unlike Vector, there's no copy on write,
+//so accessors are plain pointer arithmetic and never copy behind caller's back.
+//use for buffers built up in place; hand over to Vector(UniqueVector &&) when sharing is needed.
+
+#include <cstdint>
+#include "TypeTraits.h"
+#include "Util.h"
+
+template<typename ValueType>
+class UniqueVector
+{
+private:
+	ValueType *data_;
+	size_t size_;
+	size_t alloc_;
+
+	void grow_(size_t size)
+	{
+		if(size <= alloc_)
+			return;
+		size_t alloc = alloc_ * 2;
+		if(alloc < size)
+			alloc = size + 10;
+		reallocate_(alloc);
+	}
+
+	void reallocate_(size_t alloc)
+	{
+		ValueType *newData = new ValueType[alloc];
+		if(data_)
+		{
+			moveElements(newData, data_, size_);
+			delete [] data_;
+		}
+		data_ = newData;
+		alloc_ = alloc;
+	}
+
+	UniqueVector(const UniqueVector &);
+	const UniqueVector &operator =(const UniqueVector &);
+public:
+	typedef ValueType value_type;
+	typedef ValueType *iterator;
+	typedef const ValueType *const_iterator;
+
+	UniqueVector() : data_(nullptr), size_(0), alloc_(0)
+	{
+	}
+
+	//elements of pod types are left uninitialized.
+	explicit UniqueVector(size_t size) : data_(new ValueType[size]), size_(size), alloc_(size)
+	{
+	}
+
+	UniqueVector(UniqueVector &&operand) : data_(operand.data_), size_(operand.size_), alloc_(operand.alloc_)
+	{
+		operand.data_ = nullptr;
+		operand.size_ = 0;
+		operand.alloc_ = 0;
+	}
+
+	~UniqueVector()
+	{
+		if(data_)
+			delete [] data_;
+	}
+
+	const UniqueVector &operator =(UniqueVector &&operand)
+	{
+		if(data_)
+			delete [] data_;
+		data_ = operand.data_;
+		size_ = operand.size_;
+		alloc_ = operand.alloc_;
+		operand.data_ = nullptr;
+		operand.size_ = 0;
+		operand.alloc_ = 0;
+		return *this;
+	}
+
+	//gives up ownership of buffer allocated with new[]. vector is empty afterwards.
+	ValueType *release()
+	{
+		ValueType *result = data_;
+		data_ = nullptr;
+		size_ = 0;
+		alloc_ = 0;
+		return result;
+	}
+
+	void clear()
+	{
+		size_ = 0;
+	}
+
+	void reserve(size_t size)
+	{
+		if(size > alloc_)
+			reallocate_(size);
+	}
+
+	//new elements are value initialized.
+	void resize(size_t size)
+	{
+		grow_(size);
+		if(size > size_)
+			clearElements(data_ + size_, size - size_);
+		size_ = size;
+	}
+
+	//new elements are left as allocated. for buffers about to be overwritten entirely.
+	void resize_uninitialized(size_t size)
+	{
+		grow_(size);
+		size_ = size;
+	}
+
+	void push_back(const ValueType &data)
+	{
+		grow_(size_ + 1);
+		data_[size_ ++] = data;
+	}
+
+	void push_back(ValueType &&data)
+	{
+		grow_(size_ + 1);
+		data_[size_ ++] = std::move(data);
+	}
+
+	void insert(size_t pos, const ValueType *data, size_t size)
+	{
+		grow_(size_ + size);
+		moveElements(data_ + pos + size, data_ + pos, size_ - pos);
+		copyElements(data_ + pos, data, size);
+		size_ += size;
+	}
+
+	void append(const ValueType *data, size_t size)
+	{
+		insert(size_, data, size);
+	}
+
+	void append(const UniqueVector &data)
+	{
+		insert(size_, data.get(), data.size());
+	}
+
+	size_t size() const
+	{
+		return size_;
+	}
+
+	size_t capacity() const
+	{
+		return alloc_;
+	}
+
+	ValueType *get()
+	{
+		return data_;
+	}
+
+	const ValueType *get() const
+	{
+		return data_;
+	}
+
+	ValueType &operator [](size_t index)
+	{
+		return data_[index];
+	}
+
+	const ValueType &operator [](size_t index) const
+	{
+		return data_[index];
+	}
+
+	iterator begin()
+	{
+		return data_;
+	}
+
+	iterator end()
+	{
+		return data_ + size_;
+	}
+
+	const_iterator begin() const
+	{
+		return data_;
+	}
+
+	const_iterator end() const
+	{
+		return data_ + size_;
+	}
+};
@@ -1,12 +1,14 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
+#include "TypeTraits.h"
 
 template<typename IteratorType, typename Comparator>
-typename IteratorType binarySearch(IteratorType begin, IteratorType end, Comparator comparator)
+IteratorType binarySearch(IteratorType begin, IteratorType end, Comparator comparator)
 {
 	int s = 0;
-	int e = end - begin;
+	int e = static_cast<int>(end - begin) - 1;
 
 	while(s <= e)
 	{
@@ -26,15 +28,15 @@ template<int t>
 size_t makePattern(uint8_t val);
 
 template<>
-static size_t makePattern<4>(uint8_t val)
+inline size_t makePattern<4>(uint8_t val)
 {
-	return (val << 24) | (val << 16) | (val << 8) | val;
+	return 0x01010101u * val;
 }
 
 template<>
-static size_t makePattern<8>(uint8_t val)
+inline size_t makePattern<8>(uint8_t val)
 {
-	return ((uint64_t)val << 58) | ((uint64_t)val << 52) | ((uint64_t)val << 48) | ((uint64_t)val << 40) | ((uint64_t)val << 32) | (val << 24) | (val << 16) | (val << 8) | val;;
+	return static_cast<size_t>(0x0101010101010101ull * val);
 }
 
 template<typename DestinationType>
@@ -44,8 +46,10 @@ static void setMemory(DestinationType *dest_, uint8_t val, size_t size)
 	if(!size)
 		return;
 	size_t i;
-	
-	for(i = 0; i < reinterpret_cast<size_t>(dest) % sizeof(size_t); i ++)
+	size_t head = (0 - reinterpret_cast<size_t>(dest)) % sizeof(size_t); //bytes before next boundary
+	if(head > size)
+		head = size;
+	for(i = 0; i < head; i ++)
 		*(dest + i) = val; //align to boundary
 	if(size > sizeof(size_t))
 	{
@@ -65,7 +69,10 @@ static void copyMemory(DestinationType *dest_, const SourceType *src_, size_t si
 	if(!size)
 		return;
 	size_t i;
-	for(i = 0; i < reinterpret_cast<size_t>(src) % sizeof(size_t); i ++)
+	size_t head = (0 - reinterpret_cast<size_t>(src)) % sizeof(size_t); //bytes before next boundary
+	if(head > size)
+		head = size;
+	for(i = 0; i < head; i ++)
 		*(dest + i) = *(src + i); //align to boundary
 	if(size > sizeof(size_t))
 		for(; i <= size - sizeof(size_t); i += sizeof(size_t))
@@ -87,15 +94,13 @@ static void moveMemory(DestinationType *dest_, const SourceType *src_, size_t si
 		return copyMemory(dest_, src_, size);
 	 
 	//overlapping, copy from higher address
-	dest = dest + size - 1;
-	src = src + size - 1;
-
-	while(size--)
+	while(size >= sizeof(size_t))
 	{
-		*dest = *src;
-		dest --;
-		src --;
+		size -= sizeof(size_t);
+		*reinterpret_cast<size_t *>(dest + size) = *reinterpret_cast<const size_t *>(src + size);
 	}
+	while(size--)
+		*(dest + size) = *(src + size);
 }
 
 template<typename DestinationType>
@@ -104,6 +109,57 @@ static void zeroMemory(DestinationType *dest_, size_t size)
 	setMemory(dest_, 0, size);
 }
 
+//element array helpers. pod types go through copyMemory/moveMemory instead of per element assignment.
+template<typename ValueType>
+static typename std::enable_if<std::is_pod<ValueType>::value>::type
+	copyElements(ValueType *dest, const ValueType *src, size_t count)
+{
+	copyMemory(dest, src, sizeof(ValueType) * count);
+}
+
+template<typename ValueType>
+static typename std::enable_if<!std::is_pod<ValueType>::value>::type
+	copyElements(ValueType *dest, const ValueType *src, size_t count)
+{
+	for(size_t i = 0; i < count; i ++)
+		dest[i] = src[i];
+}
+
+//src and dest may overlap. src elements are left moved-from.
+template<typename ValueType>
+static typename std::enable_if<std::is_pod<ValueType>::value>::type
+	moveElements(ValueType *dest, ValueType *src, size_t count)
+{
+	moveMemory(dest, src, sizeof(ValueType) * count);
+}
+
+template<typename ValueType>
+static typename std::enable_if<!std::is_pod<ValueType>::value>::type
+	moveElements(ValueType *dest, ValueType *src, size_t count)
+{
+	if(dest < src)
+		for(size_t i = 0; i < count; i ++)
+			dest[i] = std::move(src[i]);
+	else if(dest > src)
+		for(size_t i = count; i > 0; i --)
+			dest[i - 1] = std::move(src[i - 1]);
+}
+
+template<typename ValueType>
+static typename std::enable_if<std::is_pod<ValueType>::value>::type
+	clearElements(ValueType *dest, size_t count)
+{
+	zeroMemory(dest, sizeof(ValueType) * count);
+}
+
+template<typename ValueType>
+static typename std::enable_if<!std::is_pod<ValueType>::value>::type
+	clearElements(ValueType *dest, size_t count)
+{
+	for(size_t i = 0; i < count; i ++)
+		dest[i] = ValueType();
+}
+
 static size_t multipleOf(size_t value, size_t n)
 {
 	return ((value + n - 1) / n) * n;
@@ -167,7 +223,7 @@ static uint32_t simpleRLEDecompress(const uint8_t *compressedData, uint8_t *deco
 	uint32_t resultSize = 0;
 
 	uint8_t flag;
-	size_t size;
+	uint32_t size;
 	while(controlPtr < control + controlSize)
 	{
 		controlPtr = decodeVarInt(controlPtr, &flag, &size);
@@ -207,4 +263,23 @@ uint32_t fnv1a(const T *data, size_t size)
 	return fnv1a(reinterpret_cast<const uint8_t *>(data), size);
 }
 
-#define max(a, b) ((a) < (b) ? (b) : (a))
\ No newline at end of file
+#define max(a, b) ((a) < (b) ? (b) : (a))
+
+//shift and subtract, as x86 has no crt 64-bit division helper.
+inline uint64_t divide64(uint64_t dividend, uint64_t divisor)
+{
+	if(!divisor)
+		return 0;
+	uint64_t quotient = 0;
+	uint64_t remainder = 0;
+	for(int i = 63; i >= 0; i --)
+	{
+		remainder = (remainder << 1) | ((dividend >> i) & 1);
+		if(remainder >= divisor)
+		{
+			remainder -= divisor;
+			quotient |= 1ull << i;
+		}
+	}
+	return quotient;
+}
@@ -4,6 +4,7 @@
 #include "TypeTraits.h"
 #include "Util.h"
 #include "SharedPtr.h"
+#include "UniqueVector.h"
 
 #include "DataSource.h"
 
@@ -11,12 +12,12 @@ template<typename ValueType>
 class Vector
 {
 private:
-	template<typename ValueType>
-	struct VectorData : public DataSource, public EnableSharedFromThis<VectorData<ValueType>>
+	template<typename DataType>
+	struct VectorData : public DataSource, public EnableSharedFromThis<VectorData<DataType>>
 	{
 		size_t alloc;
 		size_t size;
-		ValueType *data;
+		DataType *data;
 
 		VectorData() : alloc(0), size(0), data(nullptr)
 		{
@@ -31,7 +32,7 @@ private:
 
 		virtual SharedPtr<DataView> getView(uint64_t offset, size_t size)
 		{
-			return MakeShared<DataView>(sharedFromThis(), offset, size);
+			return MakeShared<DataView>(this->sharedFromThis(), offset, size);
 		}
 
 		virtual uint8_t *map(uint64_t offset)
@@ -46,56 +47,47 @@ private:
 	};
 	SharedPtr<VectorData<ValueType>> data_;
 
-	template<typename T = ValueType>
-	static typename std::enable_if<std::is_pod<T>::value>::type
-		_copyData(ValueType *target, ValueType *oldData, size_t size)
+	//grows geometrically so repeated append/push_back is amortized constant.
+	void resize_(size_t size, bool preserve)
 	{
-		copyMemory(target, oldData, sizeof(value_type) * size);
-	}
-
-	template<typename T = ValueType>
-	static typename std::enable_if<!std::is_pod<T>::value>::type
-		_copyData(ValueType *target, ValueType *oldData, size_t size)
-	{
-		for(size_t i = 0; i < size; i ++)
-			target[i] = std::move(oldData[i]);
+		if(data_->alloc < size)
+		{
+			size_t alloc = data_->alloc * 2;
+			if(alloc < size)
+				alloc = size + 10;
+			reallocate_(alloc, preserve);
+		}
+		data_->size = size;
 	}
 
-	void resize_(uint32_t size, bool preserve)
+	void reallocate_(size_t alloc, bool preserve)
 	{
-		if(data_->alloc <= size)
+		ValueType *oldData = data_->data;
+		data_->data = new ValueType[alloc];
+		data_->alloc = alloc;
+		if(oldData)
 		{
-			clone_();
-			data_->alloc *= 2;
-			if(data_->alloc < size)
-				data_->alloc = size + 10;
-			ValueType *oldData = data_->data;
-			data_->data = new ValueType[data_->alloc];
-			if(oldData)
-			{
-				if(preserve)
-					_copyData(data_->data, oldData, data_->size);
-				delete[] oldData;
-			}
+			if(preserve)
+				moveElements(data_->data, oldData, data_->size);
+			delete[] oldData;
 		}
-		data_->size = size;
 	}
 
 	void clone_()
 	{
 		if(!data_)
 		{
-			data_ = new VectorData<ValueType>();
+			data_ = MakeShared<VectorData<ValueType>>();
 			return;
 		}
 		if(data_.getRef() == 1)
 			return;
-		VectorData<ValueType> *newData = new VectorData<ValueType>();
+		SharedPtr<VectorData<ValueType>> newData = MakeShared<VectorData<ValueType>>();
 		newData->alloc = data_->alloc;
 		newData->size = data_->size;
 		newData->data = new ValueType[newData->alloc];
-		_copyData(newData->data, data_->data, data_->size);
-		data_ = SharedPtr<VectorData<ValueType>>(newData);
+		copyElements(newData->data, data_->data, data_->size); //other owners still use the original elements
+		data_ = std::move(newData);
 	}
 public:
 	typedef ValueType value_type;
@@ -106,7 +98,8 @@ public:
 	{
 	}
 
-	Vector(uint32_t size) : data_(new VectorData<ValueType>())
+	//elements of pod types are left uninitialized.
+	Vector(size_t size) : data_(MakeShared<VectorData<ValueType>>())
 	{
 		 data_->size = size;
 		 data_->alloc = size;
@@ -125,8 +118,16 @@ public:
 	{
 	}
 
+	//takes over buffer of operand without copying.
+	Vector(UniqueVector<ValueType> &&operand) : data_(MakeShared<VectorData<ValueType>>())
+	{
+		data_->alloc = operand.capacity();
+		data_->size = operand.size();
+		data_->data = operand.release();
+	}
+
 	template<typename IteratorType>
-	Vector(IteratorType start, IteratorType end) : data_(new VectorData<ValueType>())
+	Vector(IteratorType start, IteratorType end) : data_(MakeShared<VectorData<ValueType>>())
 	{
 		assign(start, end);
 	}
@@ -151,25 +152,34 @@ public:
 	}
 
 	void reserve(size_t size)
+	{
+		clone_();
+		if(data_->alloc < size)
+			reallocate_(size, true);
+	}
+
+	//new elements are value initialized.
+	void resize(size_t size)
 	{
 		clone_();
 		size_t oldSize = data_->size;
 		resize_(size, true);
-		data_->size = oldSize;
+		if(size > oldSize)
+			clearElements(data_->data + oldSize, size - oldSize);
 	}
 
-	void resize(size_t size)
+	//new elements are left as allocated. for buffers about to be overwritten entirely.
+	void resize_uninitialized(size_t size)
 	{
 		clone_();
 		resize_(size, true);
 	}
 
-	void assign(ValueType *data, size_t size)
+	void assign(const ValueType *data, size_t size)
 	{
 		clone_();
 		resize_(size, false);
-		for(size_t i = 0; i < size; i ++)
-			data_->data[i] = data[i];
+		copyElements(data_->data, data, size);
 	}
 
 	template<typename IteratorType>
@@ -230,10 +240,8 @@ public:
 		size_t originalSize = data_->size;
 		resize_(data_->size + size, true);
 
-		for(size_t i = originalSize + size - 1; i >= pos + size; i --)
-			data_->data[i] = data_->data[i - size];
-		for(size_t i = 0; i < size; i ++)
-			data_->data[i + pos] = data[i];
+		moveElements(data_->data + pos + size, data_->data + pos, originalSize - pos);
+		copyElements(data_->data + pos, data, size);
 	}
 
 	void append(const Vector &data)
@@ -255,13 +263,13 @@ public:
 		return data_->size;
 	}
 
-	ValueType &operator[](uint32_t operand)
+	ValueType &operator[](size_t operand)
 	{
 		clone_();
 		return data_->data[operand];
 	}
 
-	const ValueType &operator[](uint32_t operand) const
+	const ValueType &operator[](size_t operand) const
 	{
 		return data_->data[operand];
 	}
@@ -280,11 +288,15 @@ public:
 
 	const_iterator begin() const
 	{
+		if(!data_)
+			return nullptr;
 		return data_->data;
 	}
 
 	const_iterator end() const
 	{
+		if(!data_)
+			return nullptr;
 		return data_->data + data_->size;
 	}
 
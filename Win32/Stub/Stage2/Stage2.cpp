@@ -4,12 +4,48 @@
 #include "../../../Util/DataSource.h"
 #include "../../Win32Loader.h"
 #include "../Win32Stub.h"
+#include "../../../Runtime/Trace.h"
 
-uint8_t *mainData;
-uint8_t *impData;
+//payload sections in original image mapping, which stays mapped until images are unserialized.
+struct PayloadSection
+{
+	const Win32StubPayloadHeader *header;
+	uint32_t seed;
+};
+
+PayloadSection mainPayload;
+PayloadSection impPayload;
 
 void Execute();
 
+PayloadSection getPayloadSection(const Section &section)
+{
+	PayloadSection result;
+	result.header = reinterpret_cast<const Win32StubPayloadHeader *>(section.data->get());
+	result.seed = *reinterpret_cast<const uint32_t *>(section.name.c_str());
+	return result;
+}
+
+void unserializeMainImage(const PayloadSection &payload, Image &mainImage)
+{
+	Win32StubPayloadStream stream(payload.header->cipher, payload.seed, reinterpret_cast<const uint8_t *>(payload.header + 1), payload.header->size);
+	if(!stream.isValid())
+		Win32SystemCaller::get()->terminate();
+	mainImage = Image::unserialize(stream.get(), nullptr);
+}
+
+void unserializeImportImages(const PayloadSection &payload, List<Image> &importImages)
+{
+	Win32StubPayloadStream stream(payload.header->cipher, payload.seed, reinterpret_cast<const uint8_t *>(payload.header + 1), payload.header->size);
+	if(!stream.isValid())
+		Win32SystemCaller::get()->terminate();
+	uint32_t count;
+	if(!stream.read(&count, sizeof(count)))
+		return;
+	for(size_t i = 0; i < count; ++ i)
+		importImages.push_back(Image::unserialize(stream.get(), nullptr));
+}
+
 int Entry()
 {
 	uint8_t *newLocation, *stage2Start;
@@ -27,19 +63,9 @@ int Entry()
 		for(auto &i : format.getSections())
 		{
 			if(cnt == 3)
-			{
-				mainData = new uint8_t[i.data->size()];
-				copyMemory(mainData, i.data->get(), i.data->size());
-				uint32_t seed = *reinterpret_cast<const uint32_t *>(i.name.c_str());
-				simpleDecrypt(seed, mainData, i.data->size());
-			}
+				mainPayload = getPayloadSection(i);
 			else if(cnt == 4)
-			{
-				impData = new uint8_t[i.data->size()];
-				copyMemory(impData, i.data->get(), i.data->size());
-				uint32_t seed = *reinterpret_cast<const uint32_t *>(i.name.c_str());
-				simpleDecrypt(seed, impData, i.data->size());
-			}
+				impPayload = getPayloadSection(i);
 			else
 			{
 				size_t entryAddress = reinterpret_cast<size_t>(Entry);
@@ -69,25 +95,26 @@ void Execute()
 {
 	Win32NativeHelper::get()->init();
 	Win32SystemCaller::get(true);
-	Win32SystemCaller::get()->unmapViewOfSection(reinterpret_cast<void *>(Win32NativeHelper::get()->getMyBase()));
+#ifdef TRACE_EVENTS
+	String tracePath = Win32NativeHelper::get()->getEnvironment("PACKER_STUB_TRACE");
+	if(tracePath.length())
+		startTrace(tracePath);
+#endif
 
-	Image mainImage = Image::unserialize(MakeShared<MemoryDataSource>(mainData)->getView(0), nullptr);
-
-	List<Image> importImages;
-	if(impData)
+	//scope ends before loader.execute, which flushes trace.
+	Win32Loader *loader;
 	{
-		SharedPtr<MemoryDataSource> impDataSource = MakeShared<MemoryDataSource>(impData);
-		uint32_t count = *reinterpret_cast<uint32_t *>(&impData[0]);
-		size_t off = sizeof(count);
-		size_t size = 0;
+		TRACE_SCOPE("Execute");
+		//decoded straight from original image, which is unmapped afterwards so main image can load at its base.
+		Image mainImage;
+		unserializeMainImage(mainPayload, mainImage);
+		List<Image> importImages;
+		if(impPayload.header)
+			unserializeImportImages(impPayload, importImages);
+		Win32SystemCaller::get()->unmapViewOfSection(reinterpret_cast<void *>(Win32NativeHelper::get()->getMyBase()));
 
-		for(size_t j = 0; j < count; ++ j)
-		{
-			importImages.push_back(Image::unserialize(impDataSource->getView(off), &size));
-			off += size;
-		}
+		//allocated, as proxies reach it through loaderInstance_ until process exits.
+		loader = new Win32Loader(std::move(mainImage), std::move(importImages));
 	}
-
-	Win32Loader loader(std::move(mainImage), std::move(importImages));
-	loader.execute();
+	loader->execute();
 }
\ No newline at end of file
@@ -3,17 +3,17 @@
 #include "../../../Runtime/PEFormat.h"
 #include "../../../Util/Util.h"
 #include "../../../Util/Vector.h"
+#include "../../../Util/UniqueVector.h"
 
 #include "../Win32Stub.h"
 
-Vector<uint8_t> encodeVarInt(uint8_t flag, uint32_t number)
+void encodeVarInt(UniqueVector<uint8_t> &result, uint8_t flag, uint32_t number)
 {
 	//f1xxxxxx
 	//f01xxxxx xxxxxxxx
 	//f001xxxx xxxxxxxx xxxxxxxx
 	//f0001xxx xxxxxxxx xxxxxxxx xxxxxxxx
 	//f0000100 xxxxxxxx xxxxxxxx xxxxxxxx xxxxxxxx
-	Vector<uint8_t> result;
 	if(number < 0x40)
 		result.push_back((flag << 7) | 0x40 | number);
 	else if(number < 0x2000)
@@ -42,13 +42,12 @@ Vector<uint8_t> encodeVarInt(uint8_t flag, uint32_t number)
 		result.push_back((number >> 8) & 0xff);
 		result.push_back(number & 0xff);
 	}
-	return result;
 }
 
 Vector<uint8_t> simpleRLECompress(const uint8_t *source, size_t size)
 {
-	Vector<uint8_t> control;
-	Vector<uint8_t> data;
+	UniqueVector<uint8_t> control;
+	UniqueVector<uint8_t> data;
 
 	uint16_t lastData = 0x100;
 	size_t successionCount = 1;
@@ -60,7 +59,7 @@ Vector<uint8_t> simpleRLECompress(const uint8_t *source, size_t size)
 		{
 			if(nonSuccessionCount > 1)
 			{
-				control.append(encodeVarInt(0, nonSuccessionCount - 1));
+				encodeVarInt(control, 0, nonSuccessionCount - 1);
 				successionCount = 1;
 				nonSuccessionCount = 0;
 			}
@@ -71,7 +70,7 @@ Vector<uint8_t> simpleRLECompress(const uint8_t *source, size_t size)
 		{
 			if(successionCount > 1)
 			{
-				control.append(encodeVarInt(1, successionCount));
+				encodeVarInt(control, 1, successionCount);
 				successionCount = 1;
 				nonSuccessionCount = 0;
 			}
@@ -81,16 +80,16 @@ Vector<uint8_t> simpleRLECompress(const uint8_t *source, size_t size)
 		lastData = source[i];
 	}
 	if(nonSuccessionCount > 1)
-		control.append(encodeVarInt(0, nonSuccessionCount - 1));
+		encodeVarInt(control, 0, nonSuccessionCount - 1);
 	if(successionCount > 1)
-		control.append(encodeVarInt(1, successionCount));
+		encodeVarInt(control, 1, successionCount);
 
-	Vector<uint8_t> result(4);
+	UniqueVector<uint8_t> result(4);
 	*reinterpret_cast<uint32_t *>(result.get()) = control.size();
 	result.append(control);
 	result.append(data);
 
-	return result;
+	return Vector<uint8_t>(std::move(result));
 }
 
 void Entry()
@@ -120,8 +119,7 @@ void Entry()
 	for(auto &i : stage2Format.getSections())
 		copyMemory(stage2Data + i.baseAddress, i.data->get(), i.data->size());
 	
-	for(auto &i : stage2Format.getRelocations())
-		*relocationData ++ = i;
+	copyMemory(relocationData, stage2Format.getRelocations().get(), stage2Format.getRelocations().size() * sizeof(uint64_t));
 
 	stage2Header->magic = WIN32_STUB_STAGE2_MAGIC;
 	stage2Header->imageSize = static_cast<size_t>(stage2Format.getInfo().size);
@@ -137,7 +135,7 @@ void Entry()
 	//create PE
 	PEFormat resultFormat;
 	resultFormat.load(stage1, false);
-	List<Section> resultSections(resultFormat.getSections());
+	Vector<Section> resultSections(resultFormat.getSections());
 
 	size_t lastAddress = 0;
 	Section stage2Section;
@@ -163,11 +161,13 @@ void Entry()
 	zeroMemory(resultData.get(), resultData.size());
 	resultFormat.save(resultData.asDataSource());
 	
-	Vector<uint8_t> compressedResult = simpleRLECompress(resultData.get(), resultSize);
+	const Vector<uint8_t> compressedResult = simpleRLECompress(resultData.get(), resultSize);
 	const char *hex = "0123456789ABCDEF";
 
 	result->write("#pragma once\n", 13);
 	result->write("#include <cstdint>\n", 19);
+	String format = String("#define WIN32_STUB_DATA_FORMAT ") + IntToString(WIN32_STUB_FORMAT) + "\n";
+	result->write(format.c_str(), format.length());
 	result->write("uint32_t win32StubSize = 0x", 27);
 
 	result->write(&hex[(resultSize & 0xF0000000) >> 28], 1);
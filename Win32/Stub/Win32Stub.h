@@ -1,7 +1,24 @@
 #pragma once
 
+#include "../../Runtime/Keystream.h"
+#include "../../Util/Checksum.h"
+#include "../../Util/Util.h"
+#include "../../LZMA/Types.h"
+
 #define WIN32_STUB_STAGE2_MAGIC 0xf00df00d
 
+//payload layout stage2 reads. Stubgen records it in StubData.h as WIN32_STUB_DATA_FORMAT, and packer writes the layout
+//of the stub it embeds, so output stays loadable until StubData.h is regenerated with a newer stage2.
+#define WIN32_STUB_FORMAT_BASE 0 //images in ImageFormatBase
+#define WIN32_STUB_FORMAT_BIND 1 //images in ImageFormatBind
+#define WIN32_STUB_FORMAT_STAMP 2 //images in ImageFormatStamp
+#define WIN32_STUB_FORMAT_FORWARDER 3 //images in ImageFormatForwarder
+#define WIN32_STUB_FORMAT_PAYLOAD_HEADER 4 //Win32StubPayloadHeader in front of main and import data, before: chain cipher only
+#define WIN32_STUB_FORMAT WIN32_STUB_FORMAT_PAYLOAD_HEADER //of stage2 built from this tree
+
+#define WIN32_STUB_CIPHER_CHAIN 0 //simpleCrypt, each word keyed by previous plaintext
+#define WIN32_STUB_CIPHER_KEYSTREAM 1 //keystreamCrypt, any block decrypts independently
+
 struct Win32StubStage2Header
 {
 	uint32_t magic;
@@ -12,12 +29,17 @@ struct Win32StubStage2Header
 	uint32_t originalBase;
 };
 
+//plain header in front of encrypted main and import data. seed is first 4 bytes of section name.
+struct Win32StubPayloadHeader
+{
+	uint32_t cipher;
+	uint32_t size; //of encrypted data following header
+};
+
+//sum of 32 bit words, wrapped to 32 bits.
 inline uint32_t buildSignature(const uint8_t *data, size_t size)
 {
-	uint32_t check = 0;
-	for(size_t i = 0; i < size / 4; i ++)
-		check += reinterpret_cast<const uint32_t *>(data)[i];
-	return check;
+	return static_cast<uint32_t>(sumWords(data, size / 4));
 }
 
 inline void simpleCrypt(uint32_t seed, uint8_t *data, size_t size)
@@ -53,4 +75,89 @@ inline void simpleDecrypt(uint32_t seed, uint8_t *data, size_t size)
 	seed ^= lastData;
 	for(; i < size; i ++)
 		data[i] ^= seed;
-}
\ No newline at end of file
+}
+
+inline bool cryptPayload(uint32_t cipher, uint32_t seed, uint8_t *data, size_t size)
+{
+	if(cipher == WIN32_STUB_CIPHER_CHAIN)
+		simpleCrypt(seed, data, size);
+	else if(cipher == WIN32_STUB_CIPHER_KEYSTREAM)
+		keystreamCrypt(seed, 0, data, size);
+	else
+		return false;
+	return true;
+}
+
+inline bool decryptPayload(uint32_t cipher, uint32_t seed, uint8_t *data, size_t size)
+{
+	if(cipher == WIN32_STUB_CIPHER_CHAIN)
+		simpleDecrypt(seed, data, size);
+	else if(cipher == WIN32_STUB_CIPHER_KEYSTREAM)
+		keystreamCrypt(seed, 0, data, size);
+	else
+		return false;
+	return true;
+}
+
+//lzma input stream over an encrypted payload, for Image::unserialize.
+//keystream payload is decrypted as decoder pulls it, straight into decoder's buffer, so it is read once and never copied whole.
+//chain cipher can't start in the middle, so such payload is decrypted into a copy up front.
+class Win32StubPayloadStream
+{
+private:
+	ISeqInStream stream_; //first, so Read gets this object
+	const uint8_t *data_;
+	uint8_t *decrypted_;
+	size_t size_;
+	size_t position_;
+	uint32_t seed_;
+	bool valid_;
+
+	static SRes readCallback(void *p, void *buffer, size_t *size)
+	{
+		Win32StubPayloadStream *self = reinterpret_cast<Win32StubPayloadStream *>(p);
+		if(*size > self->size_ - self->position_)
+			*size = self->size_ - self->position_;
+		copyMemory(reinterpret_cast<uint8_t *>(buffer), self->data_ + self->position_, *size);
+		if(!self->decrypted_)
+			keystreamCrypt(self->seed_, self->position_, reinterpret_cast<uint8_t *>(buffer), *size);
+		self->position_ += *size;
+		return SZ_OK;
+	}
+
+	Win32StubPayloadStream(const Win32StubPayloadStream &);
+	const Win32StubPayloadStream &operator =(const Win32StubPayloadStream &);
+public:
+	Win32StubPayloadStream(uint32_t cipher, uint32_t seed, const uint8_t *data, size_t size) : data_(data), decrypted_(nullptr), size_(size), position_(0), seed_(seed), valid_(true)
+	{
+		stream_.Read = readCallback;
+		if(cipher == WIN32_STUB_CIPHER_KEYSTREAM)
+			return;
+		decrypted_ = new uint8_t[size];
+		copyMemory(decrypted_, data, size);
+		valid_ = decryptPayload(cipher, seed, decrypted_, size);
+		data_ = decrypted_;
+	}
+
+	~Win32StubPayloadStream()
+	{
+		delete [] decrypted_;
+	}
+
+	bool isValid() const
+	{
+		return valid_;
+	}
+
+	ISeqInStream *get()
+	{
+		return &stream_;
+	}
+
+	bool read(void *buffer, size_t size)
+	{
+		size_t readSize = size;
+		readCallback(this, buffer, &readSize);
+		return readSize == size;
+	}
+};
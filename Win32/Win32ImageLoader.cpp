@@ -0,0 +1,331 @@
+#include "Win32ImageLoader.h"
+
+#include "../Util/Util.h"
+#include "../Runtime/PEFormat.h"
+#include "../Runtime/PEHeader.h"
+#include "../Runtime/Trace.h"
+
+uint64_t mapImage(Win32SystemCaller *caller, const Image &image)
+{
+	TRACE_SCOPE("mapImage", image.fileName.c_str());
+	uint64_t desiredAddress = 0;
+	if(!image.relocations.size())
+		desiredAddress = image.info.baseAddress;
+	uint64_t baseAddress = reinterpret_cast<uint64_t>(caller->allocateVirtual(static_cast<size_t>(desiredAddress), static_cast<size_t>(image.info.size), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+	if(!baseAddress)
+		return 0;
+	copyMemory(reinterpret_cast<uint8_t *>(baseAddress), image.header->get(), image.header->size());
+
+	for(auto &i : image.sections)
+		copyMemory(reinterpret_cast<uint8_t *>(baseAddress + i.baseAddress), i.data->get(), i.data->size());
+	return baseAddress;
+}
+
+void relocateImage(uint64_t baseAddress, const Image &image)
+{
+	int64_t diff = baseAddress;
+	diff -= image.info.baseAddress;
+	const uint64_t *relocation = image.relocations.get();
+	size_t relocationCount = image.relocations.size();
+	if(image.info.architecture == ArchitectureWin32)
+		for(size_t j = 0; j < relocationCount; j ++)
+			*reinterpret_cast<int32_t *>(baseAddress + relocation[j]) += static_cast<int32_t>(diff);
+	else
+		for(size_t j = 0; j < relocationCount; j ++)
+			*reinterpret_cast<int64_t *>(baseAddress + relocation[j]) += static_cast<int64_t>(diff);
+}
+
+void protectImage(Win32SystemCaller *caller, uint64_t baseAddress, const Image &image)
+{
+	TRACE_SCOPE("protectImage", image.fileName.c_str());
+	//sections are sorted by address, so neighbours with same protection are merged into one call.
+	uint64_t rangeStart = 0, rangeEnd = 0;
+	uint32_t rangeProtect = 0;
+	uint64_t flushStart = 0, flushEnd = 0;
+	for(auto &i : image.sections)
+	{
+		uint32_t protect = 0;
+		if(i.flag & SectionFlagRead)
+			protect = PAGE_READONLY;
+		if(i.flag & SectionFlagWrite)
+			protect = PAGE_READWRITE;
+		if(i.flag & SectionFlagExecute)
+		{
+			if(i.flag & SectionFlagWrite)
+				protect = PAGE_EXECUTE_READWRITE;
+			else
+				protect = PAGE_EXECUTE_READ;
+		}
+
+		uint64_t start = baseAddress + i.baseAddress;
+		uint64_t end = start + multipleOf(static_cast<size_t>(i.size), 0x1000);
+		if(start != rangeEnd || protect != rangeProtect)
+		{
+			if(rangeProtect && rangeEnd > rangeStart)
+				caller->protectVirtual(reinterpret_cast<void *>(rangeStart), static_cast<size_t>(rangeEnd - rangeStart), rangeProtect);
+			rangeStart = start;
+			rangeProtect = protect;
+		}
+		rangeEnd = end;
+
+		if(i.flag & SectionFlagExecute)
+		{
+			if(flushEnd == flushStart)
+				flushStart = start;
+			flushEnd = end;
+		}
+	}
+	if(rangeProtect && rangeEnd > rangeStart)
+		caller->protectVirtual(reinterpret_cast<void *>(rangeStart), static_cast<size_t>(rangeEnd - rangeStart), rangeProtect);
+	if(flushEnd > flushStart)
+		caller->flushInstructionCache(static_cast<size_t>(flushStart), static_cast<size_t>(flushEnd - flushStart));
+}
+
+//reads info straight from headers of a mapped module, without parsing its directories.
+static void readMappedImageInfo(uint64_t baseAddress, ImageInfo &info)
+{
+	const uint8_t *base = reinterpret_cast<const uint8_t *>(baseAddress);
+	const IMAGE_DOS_HEADER *dosHeader = reinterpret_cast<const IMAGE_DOS_HEADER *>(base);
+	const IMAGE_FILE_HEADER *fileHeader = reinterpret_cast<const IMAGE_FILE_HEADER *>(base + dosHeader->e_lfanew + sizeof(uint32_t));
+	const IMAGE_OPTIONAL_HEADER_BASE *optionalHeaderBase = reinterpret_cast<const IMAGE_OPTIONAL_HEADER_BASE *>(fileHeader + 1);
+
+	info.baseAddress = baseAddress;
+	info.entryPoint = optionalHeaderBase->AddressOfEntryPoint;
+	info.flag = (fileHeader->Characteristics & IMAGE_FILE_DLL ? ImageFlagLibrary : 0);
+	info.platformData = 0;
+	info.platformData1 = 0;
+	info.timeStamp = fileHeader->TimeDateStamp;
+	if(optionalHeaderBase->Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+	{
+		const IMAGE_OPTIONAL_HEADER64 *optionalHeader = reinterpret_cast<const IMAGE_OPTIONAL_HEADER64 *>(optionalHeaderBase);
+		info.architecture = ArchitectureWin32AMD64;
+		info.size = optionalHeader->SizeOfImage;
+		info.checkSum = optionalHeader->CheckSum;
+	}
+	else
+	{
+		const IMAGE_OPTIONAL_HEADER32 *optionalHeader = reinterpret_cast<const IMAGE_OPTIONAL_HEADER32 *>(optionalHeaderBase);
+		info.architecture = ArchitectureWin32;
+		info.size = optionalHeader->SizeOfImage;
+		info.checkSum = optionalHeader->CheckSum;
+	}
+}
+
+//parses exports and imports of a module system loader already mapped.
+static Image parseSystemLibrary(uint64_t baseAddress, const String &normalizedFilename)
+{
+	PEFormat format;
+	format.load(MakeShared<MemoryDataSource>(reinterpret_cast<uint8_t *>(baseAddress)), true);
+	format.setFileName(normalizedFilename);
+	return format.toImage();
+}
+
+String Win32ImportResolver::normalizeLibraryName(const String &filename)
+{
+	String normalizedFilename = filename;
+	int pos;
+	if((pos = filename.rfind('\\')) != -1)
+		normalizedFilename = filename.substr(pos + 1);
+	if(filename.find('.') == -1)
+		normalizedFilename.append(".dll");
+	return normalizedFilename;
+}
+
+void Win32ImportResolver::addLoadedImage(uint64_t baseAddress, Image *image)
+{
+	loadedLibraries_.insert(image->fileName, baseAddress);
+	loadedImages_.insert(baseAddress, image);
+}
+
+//registers a module system loader mapped. without parse, only its headers are read and exports are parsed on first lookup.
+uint64_t Win32ImportResolver::addSystemLibrary(uint64_t baseAddress, const String &normalizedFilename, bool parse)
+{
+	Image *image;
+	if(parse)
+		image = &*systemImages_.push_back(parseSystemLibrary(baseAddress, normalizedFilename));
+	else
+	{
+		image = &*systemImages_.push_back(Image());
+		image->fileName = normalizedFilename;
+		readMappedImageInfo(baseAddress, image->info);
+		unparsedLibraries_.insert(baseAddress);
+	}
+	loadedLibraries_.insert(normalizedFilename, baseAddress);
+	loadedImages_.insert(baseAddress, image);
+	onSystemLibraryAdded(baseAddress, normalizedFilename);
+	return baseAddress;
+}
+
+uint64_t Win32ImportResolver::matchApiSet(const String &normalizedFilename)
+{
+	if(!apiSetLoaded_)
+	{
+		loadApiSet();
+		apiSetLoaded_ = true;
+	}
+
+	//schema names have neither api-/ext- prefix nor extension.
+	size_t length = normalizedFilename.length() - 4;
+	if(length > 4 && normalizedFilename.view(normalizedFilename.length() - 4).icompare(".dll") == 0)
+		length -= 4;
+	auto it = apiSetHosts_.find(normalizedFilename.view(4, static_cast<int>(length)), CaseInsensitiveStringHasher<String>::hash(normalizedFilename.c_str() + 4, length));
+	if(it == apiSetHosts_.end())
+		return 0;
+
+	for(auto &i : it->value)
+	{
+		uint64_t library = loadLibrary(i);
+		if(library)
+		{
+			loadedLibraries_.insert(normalizedFilename, library);
+			return library;
+		}
+	}
+	return 0;
+}
+
+uint64_t Win32ImportResolver::findPreboundLibrary(const Import &import)
+{
+	//stamps are read from mapped headers, so system library whose exports are never looked up isn't parsed at all.
+	String normalizedFilename = normalizeLibraryName(import.libraryName);
+	auto it = loadedLibraries_.find(normalizedFilename);
+	uint64_t baseAddress = (it != loadedLibraries_.end() ? it->value : findSystemLibrary(normalizedFilename));
+	if(!baseAddress)
+		return 0;
+
+	ImageInfo info;
+	readMappedImageInfo(baseAddress, info);
+	if(info.timeStamp != import.timeStamp || info.checkSum != import.checkSum)
+		return 0;
+	if(it != loadedLibraries_.end())
+		return baseAddress;
+	//registered with headers only, so module handle proxies see it.
+	return addSystemLibrary(baseAddress, normalizedFilename, false);
+}
+
+uint64_t Win32ImportResolver::loadLibrary(const String &filename, bool asDataFile)
+{
+	String normalizedFilename = normalizeLibraryName(filename);
+
+	auto it = loadedLibraries_.find(normalizedFilename);
+	if(it != loadedLibraries_.end())
+		return it->value;
+
+	//check if already loaded
+	uint64_t baseAddress = findSystemLibrary(normalizedFilename);
+	if(baseAddress)
+		return addSystemLibrary(baseAddress, normalizedFilename, true);
+
+	StringView temp = normalizedFilename.view(0, 4);
+	if(temp.icompare("api-") == 0 || temp.icompare("ext-") == 0)
+		return matchApiSet(normalizedFilename);
+
+	return loadOtherLibrary(filename, asDataFile);
+}
+
+uint64_t Win32ImportResolver::getFunctionAddress(uint64_t library, const String &functionName, int ordinal)
+{
+	uint32_t functionNameHash = 0;
+	if(functionName.length())
+		functionNameHash = fnv1a(functionName.c_str(), functionName.length());
+	return getFunctionAddress(library, functionNameHash, ordinal);
+}
+
+const ExportFunction *Win32ImportResolver::findExport(uint64_t library, const Image &image, uint32_t functionNameHash, int ordinal)
+{
+	if(functionNameHash != 0)
+	{
+		if(indexedLibraries_.insert(library))
+		{
+			exportsByName_.reserve(exportsByName_.size() + image.exports.size());
+			for(auto &i : image.exports)
+			{
+				//on a hash collision first export wins, as linear search by hash found it.
+				ExportKey key(library, i.nameHash);
+				if(i.nameHash && exportsByName_.find(key) == exportsByName_.end())
+					exportsByName_.insert(key, &i);
+			}
+		}
+		auto it = exportsByName_.find(ExportKey(library, functionNameHash));
+		if(it != exportsByName_.end())
+			return it->value;
+	}
+	if(ordinal != -1)
+		for(auto &i : image.exports)
+			if(i.ordinal == ordinal)
+				return &i;
+	return nullptr;
+}
+
+uint64_t Win32ImportResolver::getFunctionAddress(uint64_t library, uint32_t functionNameHash, int ordinal)
+{
+	auto it = loadedImages_.find(library);
+	if(it != loadedImages_.end())
+	{
+		Image &image = *it->value;
+		if(unparsedLibraries_.remove(library))
+			image = parseSystemLibrary(library, image.fileName);
+		uint64_t proxy = getProxyFunction(image, functionNameHash);
+		if(proxy)
+			return proxy;
+
+		const ExportFunction *item = findExport(library, image, functionNameHash, ordinal);
+		if(item == nullptr)
+			return 0;
+		if(item->forward.length())
+		{
+			//module bases are 64k aligned, so ordinal fits in lower bits.
+			uint64_t key = library | item->ordinal;
+			auto cached = forwarderCache_.find(key);
+			if(cached != forwarderCache_.end())
+				return cached->value;
+
+			uint64_t result = getFunctionAddress(loadLibrary(item->forwardLibrary), item->forwardNameHash, item->forwardOrdinal);
+			if(result)
+				forwarderCache_.insert(key, result);
+			return result;
+		}
+		return item->address + library;
+	}
+	return 0;
+}
+
+void Win32ImportResolver::bindImports(uint64_t baseAddress, const Image &image)
+{
+	TRACE_SCOPE("bindImports", image.fileName.c_str());
+	for(auto &i : image.imports)
+	{
+		uint64_t library;
+		bool prebound = false; //system library is the same build as the packing machine.
+		if(i.bindImage >= 0)
+			library = loadBundledImage(i.bindImage);
+		else if((i.timeStamp || i.checkSum) && (library = findPreboundLibrary(i)) != 0)
+			prebound = true;
+		else
+			library = loadLibrary(i.libraryName);
+		if(!library)
+		{
+			onLibraryNotFound(i.libraryName);
+			continue;
+		}
+
+		for(auto &j : i.functions)
+		{
+			uint64_t function;
+			if(j.bindImage >= 0) //bound at pack time
+				function = loadBundledImage(j.bindImage) + j.bindAddress;
+			else if(j.bindImage == ImportBindSystem && prebound)
+			{
+				function = getProxyFunction(*loadedImages_[library], j.nameHash);
+				if(!function)
+					function = library + j.bindAddress;
+			}
+			else
+				function = getFunctionAddress(library, j.nameHash, j.ordinal);
+			if(image.info.architecture == ArchitectureWin32)
+				*reinterpret_cast<uint32_t *>(j.iat + baseAddress) = static_cast<uint32_t>(function);
+			else
+				*reinterpret_cast<uint64_t *>(j.iat + baseAddress) = static_cast<uint64_t>(function);
+		}
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../Runtime/Image.h"
+#include "../Util/String.h"
+#include "../Util/Vector.h"
+#include "../Util/List.h"
+#include "../Util/Map.h"
+#include "../Util/HashMap.h"
+#include "Win32SysCall.h"
+
+//steps of loading an image that need nothing from the process but system calls.
+//Win32Loader runs them on the native caller, tests and LoaderBenchmark on a posix or recording one.
+
+//allocates image size and copies headers and sections in. image base is requested only if image can't be relocated.
+//returns 0 if allocation fails.
+uint64_t mapImage(Win32SystemCaller *caller, const Image &image);
+//adds difference between mapped and preferred base to every relocated address.
+void relocateImage(uint64_t baseAddress, const Image &image);
+//sets page protection from section flags, merging neighbours with same protection into one call.
+//executable sections are flushed from instruction cache in one call spanning all of them.
+void protectImage(Win32SystemCaller *caller, uint64_t baseAddress, const Image &image);
+
+struct ExportKey
+{
+	ExportKey() : library(0), nameHash(0) {}
+	ExportKey(uint64_t library_, uint32_t nameHash_) : library(library_), nameHash(nameHash_) {}
+	uint64_t library;
+	uint32_t nameHash;
+
+	bool operator ==(const ExportKey &operand) const
+	{
+		return library == operand.library && nameHash == operand.nameHash;
+	}
+};
+
+class ExportKeyHasher
+{
+public:
+	static uint32_t hash(const ExportKey &key)
+	{
+		//nameHash is already fnv1a, just mix in the base.
+		return key.nameHash ^ hashInteger(key.library);
+	}
+
+	static bool equal(const ExportKey &a, const ExportKey &b)
+	{
+		return a == b;
+	}
+};
+
+//finds libraries and their exports for import binding: bundled images, prebound and other system libraries, api sets
+//and forwarders. finding modules the system loader mapped and the api set schema depend on the process, so subclasses
+//give them, Win32Loader from the running process and LoaderBenchmark from stub libraries.
+class Win32ImportResolver
+{
+protected:
+	Map<uint64_t, Image *> loadedImages_; //by base. bundled ones are owned by subclass, system libraries by systemImages_.
+	HashMap<String, uint64_t, CaseInsensitiveStringHasher<String>> loadedLibraries_;
+	List<Image> systemImages_;
+	HashMap<uint64_t, uint64_t> forwarderCache_; //(library base | export ordinal) -> resolved address
+	HashMap<String, Vector<String>, CaseInsensitiveStringHasher<String>> apiSetHosts_; //contract name -> host modules in probe order
+	HashMap<ExportKey, const ExportFunction *, ExportKeyHasher> exportsByName_;
+	HashSet<uint64_t> indexedLibraries_; //libraries whose exports are in exportsByName_
+	HashSet<uint64_t> unparsedLibraries_; //prebound system libraries in loadedImages_ with headers only
+	bool apiSetLoaded_;
+
+	uint64_t addSystemLibrary(uint64_t baseAddress, const String &normalizedFilename, bool parse);
+	uint64_t matchApiSet(const String &normalizedFilename);
+	const ExportFunction *findExport(uint64_t library, const Image &image, uint32_t functionNameHash, int ordinal);
+
+	virtual uint64_t findSystemLibrary(const String &normalizedFilename) = 0; //base of module system loader already mapped, or 0
+	virtual void loadApiSet() = 0; //fills apiSetHosts_ from api set schema
+	virtual void onSystemLibraryAdded(uint64_t baseAddress, const String &normalizedFilename) {}
+	virtual uint64_t loadBundledImage(int32_t index, bool asDataFile = false) = 0;
+	virtual uint64_t loadOtherLibrary(const String &filename, bool asDataFile) = 0; //neither system library nor api set, like bundled ones by name
+	virtual uint64_t getProxyFunction(const Image &image, uint32_t functionNameHash) = 0; //replacement for a system function, or 0
+	virtual void onLibraryNotFound(const String &libraryName) = 0; //imports of library are left unbound if this returns
+public:
+	Win32ImportResolver() : apiSetLoaded_(false) {}
+	virtual ~Win32ImportResolver() {}
+
+	void addLoadedImage(uint64_t baseAddress, Image *image); //image must stay valid while resolver is used
+	uint64_t loadLibrary(const String &filename, bool asDataFile = false);
+	uint64_t findPreboundLibrary(const Import &import); //system library whose stamps match the import's, or 0
+	uint64_t getFunctionAddress(uint64_t library, const String &functionName, int ordinal = -1);
+	uint64_t getFunctionAddress(uint64_t library, uint32_t functionNameHash, int ordinal);
+	void bindImports(uint64_t baseAddress, const Image &image); //fills import address table of mapped image
+
+	static String normalizeLibraryName(const String &filename);
+};
@@ -6,8 +6,9 @@
 #include "Win32SysCall.h"
 #include "../Util/Util.h"
 #include "../Runtime/File.h"
-#include "../Runtime/PEFormat.h"
 #include "../Runtime/PEHeader.h"
+#include "../Runtime/AllocatorStatistics.h"
+#include "../Runtime/Trace.h"
 
 #define DLL_PROCESS_ATTACH   1    
 #define DLL_THREAD_ATTACH    2    
@@ -19,80 +20,17 @@ Win32Loader *loaderInstance_; //TODO: Remove global instance;
 Win32Loader::Win32Loader(Image &&image, List<Image> &&imports) : image_(image), imports_(imports)
 {
 	loaderInstance_ = this;
-}
-
-uint64_t Win32Loader::mapImage(Image &image)
-{
-	uint64_t desiredAddress = 0;
-	if(!image.relocations.size())
-		desiredAddress = image.info.baseAddress;
-	uint64_t baseAddress = reinterpret_cast<uint64_t>(Win32SystemCaller::get()->allocateVirtual(static_cast<size_t>(desiredAddress), static_cast<size_t>(image.info.size), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
-	copyMemory(reinterpret_cast<uint8_t *>(baseAddress), image.header->get(), image.header->size());
-
-	for(auto &i : image.sections)
-		copyMemory(reinterpret_cast<uint8_t *>(baseAddress + i.baseAddress), i.data->get(), i.data->size());
-
-	int64_t diff = baseAddress;
-	diff -= image.info.baseAddress;
-	for(auto &j : image.relocations)
-		if(image.info.architecture == ArchitectureWin32)
-			*reinterpret_cast<int32_t *>(baseAddress + j) += static_cast<int32_t>(diff);
-		else
-			*reinterpret_cast<int64_t *>(baseAddress + j) += static_cast<int64_t>(diff);
-
-	loadedLibraries_.insert(String(image.fileName), baseAddress);
-	loadedImages_.insert(baseAddress, image);
-	return baseAddress;
-}
-
-void Win32Loader::processImports(uint64_t baseAddress, const Image &image)
-{
-	for(auto &i : image.imports)
+	//imports_ only grows at the back, so pointers to the bundled images stay valid.
+	for(auto &i : imports_)
 	{
-		uint64_t library = loadLibrary(i.libraryName);
-		if(!library)
-		{
-			String str = "Can't load library ";
-			str.append(i.libraryName);
-			Win32NativeHelper::get()->showError(str);
-			Win32SystemCaller::get()->terminate();
-		}
-		for(auto &j : i.functions)
-		{
-			uint64_t function = getFunctionAddress(library, j.name, j.ordinal);
-			if(image.info.architecture == ArchitectureWin32)
-				*reinterpret_cast<uint32_t *>(j.iat + baseAddress) = static_cast<uint32_t>(function);
-			else
-				*reinterpret_cast<uint64_t *>(j.iat + baseAddress) = static_cast<uint64_t>(function);
-		}
-	}
-}
-
-void Win32Loader::adjustPageProtection(uint64_t baseAddress, const Image &image)
-{
-	for(auto &i : image.sections)
-	{
-		uint32_t protect = 0;
-		if(i.flag & SectionFlagRead)
-			protect = PAGE_READONLY;
-		if(i.flag & SectionFlagWrite)
-			protect = PAGE_READWRITE;
-		if(i.flag & SectionFlagExecute)
-		{
-			if(i.flag & SectionFlagWrite)
-				protect = PAGE_EXECUTE_READWRITE;
-			else
-				protect = PAGE_EXECUTE_READ;
-		}
-
-		Win32SystemCaller::get()->protectVirtual(reinterpret_cast<void *>(baseAddress + i.baseAddress), static_cast<int32_t>(i.size), protect);
-		if(i.flag & SectionFlagExecute)
-			Win32SystemCaller::get()->flushInstructionCache(static_cast<size_t>(baseAddress + i.baseAddress), static_cast<int32_t>(i.size));
+		bundledImages_.push_back(&i);
+		bundledBases_.push_back(0);
 	}
 }
 
 void Win32Loader::executeEntryPoint(uint64_t baseAddress, const Image &image)
 {
+	TRACE_SCOPE("executeEntryPoint", image.fileName.c_str());
 	//security cookie
 	if(image.info.platformData)
 	{	
@@ -143,226 +81,214 @@ void Win32Loader::executeEntryPointQueue()
 	{
 		uint64_t baseAddress = *i;
 		i = entryPointQueue_.remove(i);
-		executeEntryPoint(baseAddress, loadedImages_[baseAddress]);
+		executeEntryPoint(baseAddress, *loadedImages_[baseAddress]);
 	}
 }
 
 uint64_t Win32Loader::loadImage(Image &image, bool asDataFile)
 {
-	uint64_t baseAddress = mapImage(image);
-	loadedImages_.insert(baseAddress, image);
+	uint64_t baseAddress = mapImage(Win32SystemCaller::get(), image);
+	if(!baseAddress)
+		return 0;
+	relocateImage(baseAddress, image);
+	addLoadedImage(baseAddress, &image);
 	if(!asDataFile)
-		processImports(baseAddress, image);
-	adjustPageProtection(baseAddress, image);
+		bindImports(baseAddress, image);
+	protectImage(Win32SystemCaller::get(), baseAddress, image);
 	if(!asDataFile)
 		entryPointQueue_.push_back(baseAddress);
 	return baseAddress;
 }
 
-void Win32Loader::execute()
+uint64_t Win32Loader::loadBundledImage(int32_t index, bool asDataFile)
 {
-	uint64_t baseAddress = mapImage(image_);
-	Win32NativeHelper::get()->setMyBase(static_cast<size_t>(baseAddress));
-	processImports(baseAddress, image_);
-	adjustPageProtection(baseAddress, image_);
+	if(bundledBases_[index])
+		return bundledBases_[index];
+
+	//already mapped, but its imports are still being processed(circular dependency).
+	auto it = loadedLibraries_.find(bundledImages_[index]->fileName);
+	if(it != loadedLibraries_.end())
+		return it->value;
+
+	bundledBases_[index] = loadImage(*bundledImages_[index], asDataFile);
+	return bundledBases_[index];
+}
 
-	executeEntryPointQueue();
+void Win32Loader::execute()
+{
+	uint64_t baseAddress;
+	{
+		TRACE_SCOPE("Win32Loader::execute");
+		baseAddress = mapImage(Win32SystemCaller::get(), image_);
+		relocateImage(baseAddress, image_);
+		addLoadedImage(baseAddress, &image_);
+		Win32NativeHelper::get()->setMyBase(static_cast<size_t>(baseAddress));
+		bindImports(baseAddress, image_);
+		protectImage(Win32SystemCaller::get(), baseAddress, image_);
+
+		executeEntryPointQueue();
+	}
+	//main entry usually exits process without returning here, so its trace event is never recorded.
+#ifdef ALLOCATOR_STATISTICS
+	writeAllocatorStatistics("stub_allocator.txt");
+#endif
+#ifdef TRACE_EVENTS
+	flushTrace();
+#endif
 	executeEntryPoint(baseAddress, image_);
 }
 
 template<typename HeaderType, typename EntryType, typename HostDescriptorType>
-uint64_t Win32Loader::matchApiSet(const String &filename, uint8_t *apiSetBase)
+void Win32Loader::parseApiSet(uint8_t *apiSetBase)
 {
 	HeaderType *apiSet = reinterpret_cast<HeaderType *>(apiSetBase);
-	auto item = binarySearch(apiSet->Entries, apiSet->Entries + apiSet->NumberOfEntries,
-							 [&](const EntryType *entry) -> int {
-		wchar_t *name = reinterpret_cast<wchar_t *>(apiSetBase + entry->Name);
-		size_t i = 0;
-		for(; i < entry->NameLength / sizeof(wchar_t) - 1; i ++)
-			if(static_cast<char>(WString::to_lower(name[i])) != String::to_lower(filename[i + 4]))
-				return static_cast<char>(WString::to_lower(name[i])) - String::to_lower(filename[i + 4]);
-		return static_cast<char>(WString::to_lower(name[i])) - String::to_lower(filename[i + 4]);
-	});
-	if(item != apiSet->Entries + apiSet->NumberOfEntries)
+	for(size_t i = 0; i < apiSet->NumberOfEntries; i ++)
 	{
-		HostDescriptorType *descriptor = reinterpret_cast<HostDescriptorType *>(apiSetBase + item->HostDescriptor);
-		for(size_t i = descriptor->NumberOfHosts - 1; i >= 0; i --)
+		EntryType *entry = &apiSet->Entries[i];
+		wchar_t *name = reinterpret_cast<wchar_t *>(apiSetBase + entry->Name);
+		HostDescriptorType *descriptor = reinterpret_cast<HostDescriptorType *>(apiSetBase + entry->HostDescriptor);
+
+		Vector<String> hosts;
+		for(size_t j = descriptor->NumberOfHosts; j > 0; j --) //later hosts take precedence.
 		{
-			wchar_t *hostName = reinterpret_cast<wchar_t *>(apiSetBase + descriptor->Hosts[i].HostModuleName);
-			WString moduleName(hostName, hostName + descriptor->Hosts[i].HostModuleNameLength / sizeof(wchar_t));
-			uint64_t library;
-			if((library = reinterpret_cast<uint64_t>(GetModuleHandleWProxy(moduleName.c_str()))) == 0)
-			{
-				library = loadLibrary(WStringToString(moduleName));
-				loadedLibraries_.insert(filename, library);
-			}
-			if(library)
-				return library;
+			wchar_t *hostName = reinterpret_cast<wchar_t *>(apiSetBase + descriptor->Hosts[j - 1].HostModuleName);
+			if(descriptor->Hosts[j - 1].HostModuleNameLength)
+				hosts.push_back(WStringToString(WString(hostName, hostName + descriptor->Hosts[j - 1].HostModuleNameLength / sizeof(wchar_t))));
 		}
-		return 0;
+		apiSetHosts_.insert(WStringToString(WString(name, name + entry->NameLength / sizeof(wchar_t))), std::move(hosts));
 	}
-	return 0;
 }
 
-uint64_t Win32Loader::loadLibrary(const String &filename, bool asDataFile)
+void Win32Loader::loadApiSet()
 {
-	String normalizedFilename = filename;
-	int pos;
-	if((pos = filename.rfind('\\')) != -1)
-		normalizedFilename = filename.substr(pos + 1);
-	if(filename.find('.') == -1)
-		normalizedFilename.append(".dll");
-
-	auto &it = loadedLibraries_.find(normalizedFilename);
-	if(it != loadedLibraries_.end())
-		return it->value;
+	uint8_t *apiSetBase = Win32NativeHelper::get()->getApiSet();
+	if(*reinterpret_cast<uint32_t *>(apiSetBase) == 2) // <= 8.0
+		parseApiSet<API_SET_HEADER, API_SET_ENTRY, API_SET_HOST_DESCRIPTOR>(apiSetBase);
+	else if(*reinterpret_cast<uint32_t *>(apiSetBase) == 4) // > 8.0
+		parseApiSet<API_SET_HEADER2, API_SET_ENTRY2, API_SET_HOST_DESCRIPTOR2>(apiSetBase);
+}
 
-	//check if already loaded
+uint64_t Win32Loader::findSystemLibrary(const String &normalizedFilename)
+{
 	auto &images = Win32NativeHelper::get()->getLoadedImages();
 	WString wstrName(StringToWString(normalizedFilename));
 	for(auto &it = images.begin(); it != images.end(); it ++)
-	{
 		if(wstrName.icompare(it->fileName) == 0)
-		{
-			uint64_t baseAddress = it->baseAddress;
-			PEFormat format;
-			format.load(MakeShared<MemoryDataSource>(reinterpret_cast<uint8_t *>(baseAddress)), true);
-			format.setFileName(normalizedFilename);
-			auto &it = imports_.push_back(format.toImage());
-			loadedLibraries_.insert(normalizedFilename, baseAddress);
-			loadedImages_.insert(baseAddress, *it);
-
-			if(it->fileName.icompare("kernelbase.dll") == 0 || it->fileName.icompare("kernel32.dll") == 0)
-			{
-				//We need to patch ResolveDelayLoadedAPI, as kernelbase itself uses delay loaded dll.
-				for(auto &i : it->imports)
-				{
-					if(i.libraryName.icompare("ntdll.dll") == 0)
-					{
-						for(auto &j : i.functions)
-						{
-							if(j.nameHash == 0x6cac36c1)
-							{
-								size_t dest = static_cast<size_t>(baseAddress + j.iat);
-								size_t old;
-
-								Win32SystemCaller::get()->protectVirtual(reinterpret_cast<void *>(dest), sizeof(size_t), PAGE_READWRITE, &old);
-								*reinterpret_cast<size_t *>(dest) = reinterpret_cast<size_t>(LdrResolveDelayLoadedAPIProxy);
-								Win32SystemCaller::get()->protectVirtual(reinterpret_cast<void *>(dest), sizeof(size_t), old, &old);
-								break;
-							}
-						}
-					}
-				}
-			}
+			return it->baseAddress;
+	return 0;
+}
 
-			return baseAddress;
-		}
-	}
+void Win32Loader::onSystemLibraryAdded(uint64_t baseAddress, const String &normalizedFilename)
+{
+	if(normalizedFilename.icompare("kernelbase.dll") == 0 || normalizedFilename.icompare("kernel32.dll") == 0)
+		patchDelayLoadResolver(baseAddress);
+}
 
-	String temp = normalizedFilename.substr(0, 4);
-	if(temp.icompare("api-") == 0 || temp.icompare("ext-") == 0)
-	{
-		uint8_t *apiSetBase = Win32NativeHelper::get()->getApiSet();
-		if(*reinterpret_cast<uint32_t *>(apiSetBase) == 2) // <= 8.0
-			return matchApiSet<API_SET_HEADER, API_SET_ENTRY, API_SET_HOST_DESCRIPTOR>(filename, apiSetBase);
-		else if(*reinterpret_cast<uint32_t *>(apiSetBase) == 4) // > 8.0
-			return matchApiSet<API_SET_HEADER2, API_SET_ENTRY2, API_SET_HOST_DESCRIPTOR2>(filename, apiSetBase);
-	}
+void Win32Loader::patchDelayLoadResolver(uint64_t baseAddress)
+{
+	//We need to patch ResolveDelayLoadedAPI, as kernelbase itself uses delay loaded dll.
+	//mapped module has the bitness of this process, so thunks are size_t.
+	uint8_t *base = reinterpret_cast<uint8_t *>(baseAddress);
+	const IMAGE_DOS_HEADER *dosHeader = reinterpret_cast<const IMAGE_DOS_HEADER *>(base);
+	const IMAGE_OPTIONAL_HEADER_BASE *optionalHeaderBase = reinterpret_cast<const IMAGE_OPTIONAL_HEADER_BASE *>(base + dosHeader->e_lfanew + sizeof(uint32_t) + sizeof(IMAGE_FILE_HEADER));
+	const IMAGE_DATA_DIRECTORY *dataDirectory;
+	if(optionalHeaderBase->Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+		dataDirectory = reinterpret_cast<const IMAGE_OPTIONAL_HEADER64 *>(optionalHeaderBase)->DataDirectory;
+	else
+		dataDirectory = reinterpret_cast<const IMAGE_OPTIONAL_HEADER32 *>(optionalHeaderBase)->DataDirectory;
+	if(!dataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress)
+		return;
 
-	Image *image = nullptr;
-	for(auto it = imports_.begin(); it != imports_.end(); ++ it)
+	const IMAGE_IMPORT_DESCRIPTOR *descriptor = reinterpret_cast<const IMAGE_IMPORT_DESCRIPTOR *>(base + dataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress);
+	for(; descriptor->Name; descriptor ++)
 	{
-		if(it->fileName.icompare(filename) == 0)
+		if(String(reinterpret_cast<const char *>(base + descriptor->Name)).icompare("ntdll.dll") != 0)
+			continue;
+		const size_t *nameTable = reinterpret_cast<const size_t *>(base + (descriptor->OriginalFirstThunk ? descriptor->OriginalFirstThunk : descriptor->FirstThunk));
+		size_t *iatTable = reinterpret_cast<size_t *>(base + descriptor->FirstThunk);
+		for(size_t i = 0; nameTable[i]; i ++)
 		{
-			uint64_t result = loadImage(*it, asDataFile);
-			imports_.remove(it);
-
-			return result;
+			if(nameTable[i] & (static_cast<size_t>(1) << (sizeof(size_t) * 8 - 1))) //IMAGE_ORDINAL_FLAG32 or 64
+				continue;
+			String name(reinterpret_cast<const IMAGE_IMPORT_BY_NAME *>(base + nameTable[i])->Name);
+			if(fnv1a(name.c_str(), name.length()) != 0x6cac36c1)
+				continue;
+
+			size_t *dest = &iatTable[i];
+			size_t old;
+			Win32SystemCaller::get()->protectVirtual(dest, sizeof(size_t), PAGE_READWRITE, &old);
+			*dest = reinterpret_cast<size_t>(LdrResolveDelayLoadedAPIProxy);
+			Win32SystemCaller::get()->protectVirtual(dest, sizeof(size_t), old, &old);
+			return;
 		}
 	}
+}
+
+uint64_t Win32Loader::loadOtherLibrary(const String &filename, bool asDataFile)
+{
+	for(size_t i = 0; i < bundledImages_.size(); i ++)
+		if(bundledImages_[i]->fileName.icompare(filename) == 0)
+			return loadBundledImage(static_cast<int32_t>(i), asDataFile);
 
 	SharedPtr<FormatBase> format = FormatBase::loadImport(filename, (asDataFile ? -1 : image_.info.architecture));
 	if(!format.get())
 		return 0;
-	return loadImage(format->toImage(), asDataFile);
+	return loadImage(*imports_.push_back(format->toImage()), asDataFile);
 }
 
-uint64_t Win32Loader::getFunctionAddress(uint64_t library, const String &functionName, int ordinal)
+void Win32Loader::onLibraryNotFound(const String &libraryName)
 {
-	auto &it = loadedImages_.find(library);
-	if(it != loadedImages_.end())
-	{
-		uint32_t functionNameHash = fnv1a(functionName.c_str(), functionName.length());
-		const Image &image = it->value;
-		if(image.fileName.icompare("kernel32.dll") == 0 || image.fileName.icompare("kernelbase.dll") == 0)
-		{
-			if(functionNameHash == 0x1cd12702)
-				return reinterpret_cast<uint64_t>(LoadLibraryExWProxy);
-			else if(functionNameHash == 0x6d10460)
-				return reinterpret_cast<uint64_t>(LoadLibraryExAProxy);
-			else if(functionNameHash == 0x41b1eab9)
-				return reinterpret_cast<uint64_t>(LoadLibraryWProxy);
-			else if(functionNameHash == 0x53b2070f)
-				return reinterpret_cast<uint64_t>(LoadLibraryAProxy);
-			else if(functionNameHash == 0xa9d0e95d)
-				return reinterpret_cast<uint64_t>(GetModuleHandleExWProxy);
-			else if(functionNameHash == 0xb3d0f91b)
-				return reinterpret_cast<uint64_t>(GetModuleHandleExAProxy);
-			else if(functionNameHash == 0xd263bde6)
-				return reinterpret_cast<uint64_t>(GetModuleHandleWProxy);
-			else if(functionNameHash == 0xe463da3c)
-				return reinterpret_cast<uint64_t>(GetModuleHandleAProxy);
-			else if(functionNameHash == 0xf8f45725)
-				return reinterpret_cast<uint64_t>(GetProcAddressProxy);
-			else if(functionNameHash == 0x96d3d469)
-				return reinterpret_cast<uint64_t>(LdrResolveDelayLoadedAPIProxy);
-			else if(functionNameHash == 0x99fbc63d)
-				return reinterpret_cast<uint64_t>(GetModuleFileNameAProxy);
-			else if(functionNameHash == 0xa3fbd5fb)
-				return reinterpret_cast<uint64_t>(GetModuleFileNameWProxy);
-			else if(functionNameHash == 0x1c59c83)
-				return reinterpret_cast<uint64_t>(DisableThreadLibraryCallsProxy);
-		}
-		else if(image.fileName.icompare("ntdll.dll") == 0)
-		{
-			if(functionNameHash == 0x7385e79f)
-				return reinterpret_cast<uint64_t>(LdrAddRefDllProxy);
-			else if(functionNameHash == 0x7b566b5f)
-				return reinterpret_cast<uint64_t>(LdrLoadDllProxy);
-			else if(functionNameHash == 0x6cac36c1)
-				return reinterpret_cast<uint64_t>(LdrResolveDelayLoadedAPIProxy);
-			else if(functionNameHash == 0x9b08d96f)
-				return reinterpret_cast<uint64_t>(LdrGetDllHandleProxy);
-			else if(functionNameHash == 0x4738792)
-				return reinterpret_cast<uint64_t>(LdrGetDllHandleExProxy);
-			else if(functionNameHash == 0x1478f484)
-				return reinterpret_cast<uint64_t>(LdrGetProcedureAddressProxy);
-		}
+	String str = "Can't load library ";
+	str.append(libraryName);
+	Win32NativeHelper::get()->showError(str);
+	Win32SystemCaller::get()->terminate();
+}
 
-		ExportFunction *item = nullptr;
-		for(auto &i : image.exports)
-		{
-			if((functionNameHash != 0 && i.nameHash == functionNameHash) || (ordinal != -1 && ordinal == i.ordinal))
-			{
-				item = &i;
-				break;
-			}
-		}
-		if(item == nullptr)
-			return 0;
-		if(item->forward.length())
-		{
-			int point = item->forward.find('.');
-			String dllName = item->forward.substr(0, point);
-			String functionName = item->forward.substr(point + 1);
-			int ordinal = -1;
-			if(functionName[0] == '#')
-				ordinal = StringToInt(functionName.substr(1));
-
-			return getFunctionAddress(loadLibrary(dllName + ".dll"), functionName, ordinal);
-		}
-		return item->address + library;
+uint64_t Win32Loader::getProxyFunction(const Image &image, uint32_t functionNameHash)
+{
+	if(image.fileName.icompare("kernel32.dll") == 0 || image.fileName.icompare("kernelbase.dll") == 0)
+	{
+		if(functionNameHash == 0x1cd12702)
+			return reinterpret_cast<uint64_t>(LoadLibraryExWProxy);
+		else if(functionNameHash == 0x6d10460)
+			return reinterpret_cast<uint64_t>(LoadLibraryExAProxy);
+		else if(functionNameHash == 0x41b1eab9)
+			return reinterpret_cast<uint64_t>(LoadLibraryWProxy);
+		else if(functionNameHash == 0x53b2070f)
+			return reinterpret_cast<uint64_t>(LoadLibraryAProxy);
+		else if(functionNameHash == 0xa9d0e95d)
+			return reinterpret_cast<uint64_t>(GetModuleHandleExWProxy);
+		else if(functionNameHash == 0xb3d0f91b)
+			return reinterpret_cast<uint64_t>(GetModuleHandleExAProxy);
+		else if(functionNameHash == 0xd263bde6)
+			return reinterpret_cast<uint64_t>(GetModuleHandleWProxy);
+		else if(functionNameHash == 0xe463da3c)
+			return reinterpret_cast<uint64_t>(GetModuleHandleAProxy);
+		else if(functionNameHash == 0xf8f45725)
+			return reinterpret_cast<uint64_t>(GetProcAddressProxy);
+		else if(functionNameHash == 0x96d3d469)
+			return reinterpret_cast<uint64_t>(LdrResolveDelayLoadedAPIProxy);
+		else if(functionNameHash == 0x99fbc63d)
+			return reinterpret_cast<uint64_t>(GetModuleFileNameAProxy);
+		else if(functionNameHash == 0xa3fbd5fb)
+			return reinterpret_cast<uint64_t>(GetModuleFileNameWProxy);
+		else if(functionNameHash == 0x1c59c83)
+			return reinterpret_cast<uint64_t>(DisableThreadLibraryCallsProxy);
+	}
+	else if(image.fileName.icompare("ntdll.dll") == 0)
+	{
+		if(functionNameHash == 0x7385e79f)
+			return reinterpret_cast<uint64_t>(LdrAddRefDllProxy);
+		else if(functionNameHash == 0x7b566b5f)
+			return reinterpret_cast<uint64_t>(LdrLoadDllProxy);
+		else if(functionNameHash == 0x6cac36c1)
+			return reinterpret_cast<uint64_t>(LdrResolveDelayLoadedAPIProxy);
+		else if(functionNameHash == 0x9b08d96f)
+			return reinterpret_cast<uint64_t>(LdrGetDllHandleProxy);
+		else if(functionNameHash == 0x4738792)
+			return reinterpret_cast<uint64_t>(LdrGetDllHandleExProxy);
+		else if(functionNameHash == 0x1478f484)
+			return reinterpret_cast<uint64_t>(LdrGetProcedureAddressProxy);
 	}
 	return 0;
 }
@@ -408,7 +334,7 @@ uint32_t __stdcall Win32Loader::GetModuleFileNameAProxy(void *hModule, char *lpF
 	{
 		auto &it = loaderInstance_->loadedImages_.find(reinterpret_cast<uint64_t>(hModule));
 		if(it != loaderInstance_->loadedImages_.end())
-			path = it->value.fileName;
+			path = it->value->fileName;
 	}
 	if(nSize < path.length())
 		return path.length();
@@ -455,7 +381,7 @@ uint32_t __stdcall Win32Loader::GetModuleHandleExWProxy(uint32_t flags, const wc
 		size_t address = reinterpret_cast<size_t>(filename_);
 		for(auto &i : loaderInstance_->loadedImages_)
 		{
-			if(i.key <= address && address <= i.key + i.value.info.size)
+			if(i.key <= address && address <= i.key + i.value->info.size)
 			{
 				*result = reinterpret_cast<void *>(i.key);
 				return 1;
@@ -471,8 +397,8 @@ uint32_t __stdcall Win32Loader::GetModuleHandleExWProxy(uint32_t flags, const wc
 	String filename(WStringToString(WString(filename_)));
 	for(auto &i : loaderInstance_->loadedImages_)
 	{
-		if(i.value.fileName.icompare(filename) == 0 || 
-			i.value.fileName.substr(0, i.value.fileName.length() - 4).icompare(filename) == 0)
+		if(i.value->fileName.icompare(filename) == 0 || 
+			i.value->fileName.view(0, i.value->fileName.length() - 4).icompare(filename) == 0)
 		{
 			*result = reinterpret_cast<void *>(i.key);
 			return 1;
@@ -1,10 +1,13 @@
 #pragma once
 
 #include "../Util/Vector.h"
+#include "../Util/UniqueVector.h"
 #include "../Util/String.h"
 #include "../Util/List.h"
 #include "../Util/Map.h"
+#include "../Util/HashMap.h"
 #include "../Runtime/Image.h"
+#include "Win32ImageLoader.h"
 
 struct _UNICODE_STRING;
 typedef _UNICODE_STRING UNICODE_STRING;
@@ -15,20 +18,16 @@ typedef _ANSI_STRING ANSI_STRING;
 struct _IMAGE_DELAYLOAD_DESCRIPTOR;
 typedef _IMAGE_DELAYLOAD_DESCRIPTOR IMAGE_DELAYLOAD_DESCRIPTOR;
 typedef const IMAGE_DELAYLOAD_DESCRIPTOR *PCIMAGE_DELAYLOAD_DESCRIPTOR;
-class Win32Loader
+
+class Win32Loader : public Win32ImportResolver
 {
 private:
 	Image image_;
 	List<Image> imports_;
+	UniqueVector<Image *> bundledImages_;
+	UniqueVector<uint64_t> bundledBases_;
 	List<uint64_t> entryPointQueue_;
-	Map<uint64_t, Image> loadedImages_;
-	Map<String, uint64_t, CaseInsensitiveStringComparator<String>> loadedLibraries_;
-	uint64_t loadLibrary(const String &filename, bool asDataFile = false);
-	uint64_t getFunctionAddress(uint64_t library, const String &functionName, int ordinal = -1);
 	uint64_t loadImage(Image &image, bool asDataFile = false);
-	uint64_t mapImage(Image &image);
-	void processImports(uint64_t baseAddress, const Image &image);
-	void adjustPageProtection(uint64_t baseAddress, const Image &image);
 	void executeEntryPoint(uint64_t baseAddress, const Image &image);
 	void executeEntryPointQueue();
 
@@ -43,6 +42,7 @@ private:
 	static uint32_t __stdcall GetModuleHandleExAProxy(uint32_t flags, const char *filename_, void **result);
 	static uint32_t __stdcall GetModuleHandleExWProxy(uint32_t flags, const wchar_t *filename_, void **result);
 	static void * __stdcall GetProcAddressProxy(void *library, char *functionName);
+	static void patchDelayLoadResolver(uint64_t baseAddress);
 	static size_t __stdcall DisableThreadLibraryCallsProxy(void *module);
 	static size_t __stdcall LdrAddRefDllProxy(size_t flags, void *library);
 	static size_t __stdcall LdrLoadDllProxy(wchar_t *searchPath, size_t dllCharacteristics, UNICODE_STRING *dllName, void **baseAddress);
@@ -52,7 +52,15 @@ private:
 	static size_t __stdcall LdrGetProcedureAddressProxy(void *BaseAddress, ANSI_STRING *Name, size_t Ordinal, void **ProcedureAddress);
 	
 	template<typename HeaderType, typename EntryType, typename HostDescriptorType>
-	uint64_t matchApiSet(const String &filename, uint8_t *apiSetBase);
+	void parseApiSet(uint8_t *apiSetBase);
+protected:
+	virtual uint64_t findSystemLibrary(const String &normalizedFilename);
+	virtual void loadApiSet();
+	virtual void onSystemLibraryAdded(uint64_t baseAddress, const String &normalizedFilename);
+	virtual uint64_t loadBundledImage(int32_t index, bool asDataFile = false);
+	virtual uint64_t loadOtherLibrary(const String &filename, bool asDataFile);
+	virtual uint64_t getProxyFunction(const Image &image, uint32_t functionNameHash);
+	virtual void onLibraryNotFound(const String &libraryName);
 public:
 	Win32Loader(Image &&image, List<Image> &&imports);
 	virtual ~Win32Loader() {}
@@ -76,6 +76,22 @@ wchar_t *Win32NativeHelper::getEnvironments()
 	return reinterpret_cast<wchar_t *>(myPEB_->ProcessParameters->Environment);
 }
 
+String Win32NativeHelper::getEnvironment(const String &name)
+{
+	//block is NAME=VALUE strings, each null terminated, ending with empty one.
+	WString wideName = StringToWString(name);
+	for(wchar_t *item = getEnvironments(); *item; )
+	{
+		size_t length = 0;
+		while(item[length])
+			length ++;
+		if(length > wideName.length() && item[wideName.length()] == L'=' && WStringView(item, wideName.length()).icompare(wideName) == 0)
+			return WStringToString(WString(item + wideName.length() + 1));
+		item += length + 1;
+	}
+	return String();
+}
+
 uint8_t *Win32NativeHelper::getApiSet()
 {
 	return myPEB_->ApiSet;
@@ -178,6 +194,20 @@ uint32_t Win32NativeHelper::getRandomValue()
 	return ((temp[0] | temp[1]) ^ 0xbeafdead) * temp[0];
 }
 
+uint64_t Win32NativeHelper::getInterruptTime()
+{
+	KUSER_SHARED_DATA *sharedData = reinterpret_cast<KUSER_SHARED_DATA *>(0x7ffe0000);
+	volatile KSYSTEM_TIME *time = &sharedData->InterruptTime;
+	//kernel writes High2Time first and High1Time last, so equal high parts mean a consistent read.
+	while(true)
+	{
+		int32_t high = time->High1Time;
+		uint32_t low = time->LowPart;
+		if(high == time->High2Time)
+			return (static_cast<uint64_t>(static_cast<uint32_t>(high)) << 32) | low;
+	}
+}
+
 void Win32NativeHelper::showError(const String &message)
 {
 
@@ -188,14 +218,23 @@ bool Win32NativeHelper::isWoW64()
 	return isWoW64_;
 }
 
+//with allocator statistics, allocation site is where new was used rather than here.
 void* operator new(size_t num)
 {
+#ifdef ALLOCATOR_STATISTICS
+	return heapAllocFromCaller(num, _ReturnAddress());
+#else
 	return heapAlloc(num);
+#endif
 }
 
 void* operator new[](size_t num)
 {
+#ifdef ALLOCATOR_STATISTICS
+	return heapAllocFromCaller(num, _ReturnAddress());
+#else
 	return heapAlloc(num);
+#endif
 }
 
 void operator delete(void *ptr)
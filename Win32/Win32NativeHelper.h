@@ -34,6 +34,7 @@ public:
 	wchar_t *getCommandLine();
 	wchar_t *getCurrentDirectory();
 	wchar_t *getEnvironments();
+	String getEnvironment(const String &name); //empty if not set
 	PEB *getPEB();
 	List<Win32LoadedImage> getLoadedImages();
 	List<String> getArgumentList();
@@ -48,5 +49,6 @@ public:
 	void showError(const String &message);
 
 	uint32_t getRandomValue();
+	uint64_t getInterruptTime(); //100ns units since boot, monotonic
 	static Win32NativeHelper *get();
 };
@@ -0,0 +1,77 @@
+#include "Win32PosixSystemCaller.h"
+#include "Win32NativeHelper.h"
+#include "../Runtime/Allocator.h"
+
+#include <new>
+#include <time.h>
+
+//definitions Win32SysCall.cpp, Win32NativeHelper.cpp and MSVCHelper.cpp give on windows, for linux builds.
+
+namespace
+{
+	Win32SystemCaller *currentCaller;
+}
+
+Win32SystemCaller *Win32SystemCaller::get(bool forceinit)
+{
+	//local, so allocations from other static constructors find it constructed.
+	static Win32PosixSystemCaller posixCaller;
+	if(currentCaller)
+		return currentCaller;
+	return &posixCaller;
+}
+
+void Win32SystemCaller::set(Win32SystemCaller *caller)
+{
+	currentCaller = caller;
+}
+
+Win32NativeHelper *Win32NativeHelper::get()
+{
+	static Win32NativeHelper helper;
+	return &helper;
+}
+
+wchar_t *Win32NativeHelper::getCurrentDirectory()
+{
+	//paths are passed to open() as given, which resolves relative ones.
+	static wchar_t empty[] = L"";
+	return empty;
+}
+
+uint64_t Win32NativeHelper::getInterruptTime()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return static_cast<uint64_t>(now.tv_sec) * 10000000 + now.tv_nsec / 100;
+}
+
+void *operator new(size_t size)
+{
+	return heapAlloc(size);
+}
+
+void *operator new[](size_t size)
+{
+	return heapAlloc(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+	heapFree(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+	heapFree(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+	heapFree(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+	heapFree(ptr);
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstdint>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Win32SysCall.h"
+#include "../Util/String.h"
+#include "../Util/Util.h"
+
+//system caller backed by posix calls, so loader and file code can run on linux for benchmarks.
+//file handles are descriptors, sections are duplicated descriptors of their file.
+//usage: Win32PosixSystemCaller caller; Win32SystemCaller::set(&caller);
+class Win32PosixSystemCaller : public Win32SystemCaller
+{
+private:
+	enum
+	{
+		MaxViews = 64
+	};
+	struct View
+	{
+		void *address;
+		size_t size;
+	};
+	View views_[MaxViews]; //munmap needs size, which unmapViewOfSection doesn't get.
+
+	static int toDescriptor(void *handle)
+	{
+		return static_cast<int>(reinterpret_cast<intptr_t>(handle));
+	}
+
+	static void *toHandle(int descriptor)
+	{
+		if(descriptor < 0)
+			return INVALID_HANDLE_VALUE;
+		return reinterpret_cast<void *>(static_cast<intptr_t>(descriptor));
+	}
+
+	static int toPosixProtect(size_t protect)
+	{
+		switch(protect)
+		{
+		case PAGE_READONLY:
+		case PAGE_WRITECOPY:
+			return PROT_READ;
+		case PAGE_READWRITE:
+			return PROT_READ | PROT_WRITE;
+		case PAGE_EXECUTE:
+			return PROT_EXEC;
+		case PAGE_EXECUTE_READ:
+		case PAGE_EXECUTE_WRITECOPY:
+			return PROT_READ | PROT_EXEC;
+		case PAGE_EXECUTE_READWRITE:
+			return PROT_READ | PROT_WRITE | PROT_EXEC;
+		}
+		return PROT_NONE;
+	}
+
+	static String toPath(const wchar_t *path, size_t length)
+	{
+		return WStringToString(WString(path, path + length));
+	}
+public:
+	Win32PosixSystemCaller() : Win32SystemCaller(nullptr)
+	{
+		for(size_t i = 0; i < MaxViews; i ++)
+			views_[i].address = nullptr;
+	}
+
+	virtual bool freeVirtual(void *BaseAddress)
+	{
+		//size is stored in a page in front of the region, as MEM_RELEASE frees whole region.
+		uint8_t *region = reinterpret_cast<uint8_t *>(BaseAddress) - 0x1000;
+		return munmap(region, *reinterpret_cast<size_t *>(region)) == 0;
+	}
+
+	virtual void *allocateVirtual(size_t DesiredAddress, size_t RegionSize, size_t AllocationType, size_t Protect)
+	{
+		//desired address is only a hint here. callers relocate when they get another one.
+		size_t size = multipleOf(RegionSize, 0x1000) + 0x1000;
+		void *hint = DesiredAddress ? reinterpret_cast<void *>(DesiredAddress - 0x1000) : nullptr;
+		uint8_t *region = reinterpret_cast<uint8_t *>(mmap(hint, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+		if(region == MAP_FAILED)
+			return nullptr;
+		*reinterpret_cast<size_t *>(region) = size;
+		mprotect(region + 0x1000, size - 0x1000, toPosixProtect(Protect));
+		return region + 0x1000;
+	}
+
+	virtual void protectVirtual(void *BaseAddress, size_t NumberOfBytes, size_t NewAccessProtection, size_t *OldAccessProtection = nullptr)
+	{
+		size_t start = reinterpret_cast<size_t>(BaseAddress) & ~static_cast<size_t>(0xfff);
+		size_t end = multipleOf(reinterpret_cast<size_t>(BaseAddress) + NumberOfBytes, 0x1000);
+		mprotect(reinterpret_cast<void *>(start), end - start, toPosixProtect(NewAccessProtection));
+		if(OldAccessProtection)
+			*OldAccessProtection = PAGE_READWRITE; //not tracked
+	}
+
+	virtual void *createFile(uint32_t DesiredAccess, const wchar_t *Filename, size_t FilenameLength, size_t ShareAccess, size_t CreateDisposition)
+	{
+		int flags = (DesiredAccess & GENERIC_WRITE) ? O_RDWR : O_RDONLY;
+		if(CreateDisposition != FILE_OPEN && CreateDisposition != FILE_OVERWRITE)
+			flags |= O_CREAT;
+		if(CreateDisposition == FILE_SUPERSEDE || CreateDisposition == FILE_OVERWRITE || CreateDisposition == FILE_OVERWRITE_IF)
+			flags |= O_TRUNC;
+		return toHandle(open(toPath(Filename, FilenameLength).c_str(), flags, 0644));
+	}
+
+	virtual size_t writeFile(void *fileHandle, const uint8_t *buffer, size_t bufferSize)
+	{
+		ssize_t written = write(toDescriptor(fileHandle), buffer, bufferSize);
+		return written < 0 ? 0 : static_cast<size_t>(written);
+	}
+
+	virtual void flushFile(void *fileHandle)
+	{
+		fsync(toDescriptor(fileHandle));
+	}
+
+	virtual void closeHandle(void *handle)
+	{
+		close(toDescriptor(handle));
+	}
+
+	virtual void *createSection(void *file, uint32_t flProtect, uint64_t sectionSize, wchar_t *lpName, size_t NameLength)
+	{
+		if(sectionSize)
+		{
+			struct stat info;
+			if(fstat(toDescriptor(file), &info) == 0 && static_cast<uint64_t>(info.st_size) < sectionSize)
+				ftruncate(toDescriptor(file), static_cast<off_t>(sectionSize));
+		}
+		return toHandle(dup(toDescriptor(file)));
+	}
+
+	virtual void *mapViewOfSection(void *section, uint32_t dwDesiredAccess, uint64_t offset, size_t dwNumberOfBytesToMap, size_t lpBaseAddress)
+	{
+		size_t size = dwNumberOfBytesToMap;
+		if(!size)
+		{
+			struct stat info;
+			if(fstat(toDescriptor(section), &info) != 0)
+				return nullptr;
+			size = static_cast<size_t>(info.st_size - offset);
+		}
+		int protect = PROT_READ;
+		int flags = MAP_PRIVATE;
+		if(dwDesiredAccess & FILE_MAP_WRITE)
+		{
+			protect |= PROT_WRITE;
+			flags = MAP_SHARED;
+		}
+		void *address = mmap(reinterpret_cast<void *>(lpBaseAddress), size, protect, flags, toDescriptor(section), static_cast<off_t>(offset));
+		if(address == MAP_FAILED)
+			return nullptr;
+		for(size_t i = 0; i < MaxViews; i ++)
+			if(!views_[i].address)
+			{
+				views_[i].address = address;
+				views_[i].size = size;
+				break;
+			}
+		return address;
+	}
+
+	virtual void unmapViewOfSection(void *lpBaseAddress)
+	{
+		for(size_t i = 0; i < MaxViews; i ++)
+			if(views_[i].address == lpBaseAddress)
+			{
+				munmap(lpBaseAddress, views_[i].size);
+				views_[i].address = nullptr;
+				return;
+			}
+	}
+
+	virtual uint32_t getFileAttributes(const wchar_t *filePath, size_t filePathLen)
+	{
+		struct stat info;
+		if(stat(toPath(filePath, filePathLen).c_str(), &info) != 0)
+			return INVALID_FILE_ATTRIBUTES;
+		return S_ISDIR(info.st_mode) ? 0x10 : 0x80; //FILE_ATTRIBUTE_DIRECTORY, FILE_ATTRIBUTE_NORMAL
+	}
+
+	virtual void setFileSize(void *file, uint64_t size)
+	{
+		ftruncate(toDescriptor(file), static_cast<off_t>(size));
+	}
+
+	virtual void flushInstructionCache(size_t offset, size_t size)
+	{
+		//x86 keeps instruction cache coherent.
+	}
+
+	virtual void terminate()
+	{
+		_exit(1);
+	}
+};
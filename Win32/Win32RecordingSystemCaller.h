@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Win32SysCall.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+//test double which counts and times every system call before forwarding it to backend.
+//backend may be nullptr, in which case calls only get recorded.
+//usage: Win32RecordingSystemCaller recorder(Win32SystemCaller::get()); Win32SystemCaller::set(&recorder);
+class Win32RecordingSystemCaller : public Win32SystemCaller
+{
+private:
+	Win32SystemCaller *backend_;
+	uint32_t count_[SystemCallMax];
+	uint64_t cycles_[SystemCallMax];
+
+	class Record
+	{
+	private:
+		Win32RecordingSystemCaller *owner_;
+		Win32SystemCall call_;
+		uint64_t start_;
+	public:
+		Record(Win32RecordingSystemCaller *owner, Win32SystemCall call) : owner_(owner), call_(call), start_(__rdtsc()) {}
+		~Record()
+		{
+			owner_->count_[call_] ++;
+			owner_->cycles_[call_] += __rdtsc() - start_;
+		}
+	};
+public:
+	Win32RecordingSystemCaller(Win32SystemCaller *backend) : Win32SystemCaller(nullptr), backend_(backend)
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		for(size_t i = 0; i < SystemCallMax; i ++)
+		{
+			count_[i] = 0;
+			cycles_[i] = 0;
+		}
+	}
+
+	uint32_t getCount(Win32SystemCall call) const
+	{
+		return count_[call];
+	}
+
+	uint64_t getCycles(Win32SystemCall call) const
+	{
+		return cycles_[call];
+	}
+
+	uint32_t getTotalCount() const
+	{
+		uint32_t result = 0;
+		for(size_t i = 0; i < SystemCallMax; i ++)
+			result += count_[i];
+		return result;
+	}
+
+	virtual bool freeVirtual(void *BaseAddress)
+	{
+		Record record(this, NtFreeVirtualMemory);
+		return backend_ ? backend_->freeVirtual(BaseAddress) : true;
+	}
+
+	virtual void *allocateVirtual(size_t DesiredAddress, size_t RegionSize, size_t AllocationType, size_t Protect)
+	{
+		Record record(this, NtAllocateVirtualMemory);
+		return backend_ ? backend_->allocateVirtual(DesiredAddress, RegionSize, AllocationType, Protect) : nullptr;
+	}
+
+	virtual void protectVirtual(void *BaseAddress, size_t NumberOfBytes, size_t NewAccessProtection, size_t *OldAccessProtection = nullptr)
+	{
+		Record record(this, NtProtectVirtualMemory);
+		if(backend_)
+			backend_->protectVirtual(BaseAddress, NumberOfBytes, NewAccessProtection, OldAccessProtection);
+	}
+
+	virtual void *createFile(uint32_t DesiredAccess, const wchar_t *Filename, size_t FilenameLength, size_t ShareAccess, size_t CreateDisposition)
+	{
+		Record record(this, NtCreateFile);
+		return backend_ ? backend_->createFile(DesiredAccess, Filename, FilenameLength, ShareAccess, CreateDisposition) : INVALID_HANDLE_VALUE;
+	}
+
+	virtual size_t writeFile(void *fileHandle, const uint8_t *buffer, size_t bufferSize)
+	{
+		Record record(this, NtWriteFile);
+		return backend_ ? backend_->writeFile(fileHandle, buffer, bufferSize) : bufferSize;
+	}
+
+	virtual void flushFile(void *fileHandle)
+	{
+		Record record(this, NtFlushBuffersFile);
+		if(backend_)
+			backend_->flushFile(fileHandle);
+	}
+
+	virtual void closeHandle(void *handle)
+	{
+		Record record(this, NtClose);
+		if(backend_)
+			backend_->closeHandle(handle);
+	}
+
+	virtual void *createSection(void *file, uint32_t flProtect, uint64_t sectionSize, wchar_t *lpName, size_t NameLength)
+	{
+		Record record(this, NtCreateSection);
+		return backend_ ? backend_->createSection(file, flProtect, sectionSize, lpName, NameLength) : INVALID_HANDLE_VALUE;
+	}
+
+	virtual void *mapViewOfSection(void *section, uint32_t dwDesiredAccess, uint64_t offset, size_t dwNumberOfBytesToMap, size_t lpBaseAddress)
+	{
+		Record record(this, NtMapViewOfSection);
+		return backend_ ? backend_->mapViewOfSection(section, dwDesiredAccess, offset, dwNumberOfBytesToMap, lpBaseAddress) : nullptr;
+	}
+
+	virtual void unmapViewOfSection(void *lpBaseAddress)
+	{
+		Record record(this, NtUnmapViewOfSection);
+		if(backend_)
+			backend_->unmapViewOfSection(lpBaseAddress);
+	}
+
+	virtual uint32_t getFileAttributes(const wchar_t *filePath, size_t filePathLen)
+	{
+		Record record(this, NtQueryFullAttributesFile);
+		return backend_ ? backend_->getFileAttributes(filePath, filePathLen) : INVALID_FILE_ATTRIBUTES;
+	}
+
+	virtual void setFileSize(void *file, uint64_t size)
+	{
+		Record record(this, NtSetInformationFile);
+		if(backend_)
+			backend_->setFileSize(file, size);
+	}
+
+	virtual void flushInstructionCache(size_t offset, size_t size)
+	{
+		Record record(this, NtFlushInstructionCache);
+		if(backend_)
+			backend_->flushInstructionCache(offset, size);
+	}
+
+	virtual void terminate()
+	{
+		Record record(this, NtTerminateProcess);
+		if(backend_)
+			backend_->terminate();
+	}
+};
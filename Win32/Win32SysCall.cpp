@@ -80,12 +80,21 @@ void normalizeCreateFileOptions(uint32_t *resultDesiredAccess, uint32_t *resultC
 	}
 }
 
+Win32SystemCaller *replacedCaller_ = nullptr;
+
+void Win32SystemCaller::set(Win32SystemCaller *caller)
+{
+	replacedCaller_ = caller;
+}
+
 Win32SystemCaller *Win32SystemCaller::get(bool forceinit)
 {
 	static bool initialized = false;
 	static uint8_t callerStorage[sizeof(Win32SystemCaller)];
 
 	Win32SystemCaller *result;
+	if(replacedCaller_ && forceinit == false)
+		return replacedCaller_;
 	if(initialized && forceinit == false)
 		result = reinterpret_cast<Win32SystemCaller *>(callerStorage);
 	else
@@ -1,6 +1,11 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
+
+#ifndef _MSC_VER
+#define __cdecl //only meaningful for x86 windows, where system call stubs are built.
+#endif
 
 enum Win32SystemCall
 {
@@ -47,6 +52,7 @@ public:
 	virtual void terminate() = 0;
 
 	static Win32SystemCaller *get(bool forceinit = false);
+	static void set(Win32SystemCaller *caller); //replaces caller returned by get(). nullptr restores native one.
 };
 
 class Win32x86SystemCaller : public Win32SystemCaller